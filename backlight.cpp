@@ -0,0 +1,131 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#include "backlight.h"
+#include <QDebug>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <math.h>
+
+#define BACKLIGHT_FRAME_TIME    16      /* ~60 fps */
+#define BACKLIGHT_GAMMA         2.2
+
+Backlight::Backlight(const QString &path, QObject *parent)
+    : QObject(parent)
+    , m_level(-1)
+    , m_target(0)
+    , m_fromPerceived(0)
+    , m_toPerceived(0)
+    , m_durationMs(0)
+{
+    QByteArray device = path.toLocal8Bit();
+    m_fd = open(device.constData(), O_WRONLY | O_CLOEXEC);
+    if (m_fd < 0)
+        qErrnoWarning(errno, "Cannot open backlight %s", device.constData());
+    m_frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_frameTimer, SIGNAL(timeout()), this, SLOT(frame()));
+}
+
+Backlight::~Backlight()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+int Backlight::level() const
+{
+    return m_level < 0 ? 0 : m_level;
+}
+
+int Backlight::targetLevel() const
+{
+    return m_target;
+}
+
+bool Backlight::isFading() const
+{
+    return m_frameTimer.isActive();
+}
+
+void Backlight::setLevel(int level)
+{
+    m_frameTimer.stop();
+    m_target = qBound(0, level, BACKLIGHT_MAX_LEVEL);
+    write(m_target);
+}
+
+void Backlight::fadeTo(int target, int durationMs)
+{
+    m_target = qBound(0, target, BACKLIGHT_MAX_LEVEL);
+    if (durationMs <= 0 || m_target == level()) {
+        setLevel(m_target);
+        emit fadeFinished(m_target);
+        return;
+    }
+    /* Start from where a possibly interrupted fade left off */
+    m_fromPerceived = toPerceived(level());
+    m_toPerceived = toPerceived(m_target);
+    m_durationMs = durationMs;
+    m_clock.start();
+    m_frameTimer.start(BACKLIGHT_FRAME_TIME);
+    frame();
+}
+
+/* Linear in perceived brightness, so the fade looks even to the eye */
+void Backlight::frame()
+{
+    double t = (double)m_clock.elapsed() / m_durationMs;
+    if (t >= 1.0) {
+        m_frameTimer.stop();
+        write(m_target);
+        emit fadeFinished(m_target);
+        return;
+    }
+    double perceived = m_fromPerceived + (m_toPerceived - m_fromPerceived) * t;
+    write(fromPerceived(perceived));
+}
+
+void Backlight::write(int level)
+{
+    /* Skip redundant sysfs writes */
+    if (level == m_level || m_fd < 0)
+        return;
+    char buf[8];
+    int len = snprintf(buf, sizeof(buf), "%d\n", level);
+    if (pwrite(m_fd, buf, len, 0) != len) {
+        qErrnoWarning(errno, "Backlight write failed");
+        return;
+    }
+    m_level = level;
+}
+
+double Backlight::toPerceived(int level)
+{
+    return pow((double)level / BACKLIGHT_MAX_LEVEL, 1.0 / BACKLIGHT_GAMMA);
+}
+
+int Backlight::fromPerceived(double perceived)
+{
+    return (int)lround(pow(perceived, BACKLIGHT_GAMMA) * BACKLIGHT_MAX_LEVEL);
+}
@@ -0,0 +1,75 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef BACKLIGHT_H
+#define BACKLIGHT_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#define BACKLIGHT_MAX_LEVEL     254
+
+/*
+ * Backlight controller. Keeps the sysfs brightness file open and runs
+ * fades from a frame timer on the event loop: no blocking, no
+ * processEvents(). A new fade or setLevel() interrupts a running fade
+ * and continues from the current level.
+ */
+class Backlight : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Backlight(const QString &path, QObject *parent = nullptr);
+    ~Backlight();
+
+    int level() const;
+    int targetLevel() const;
+    bool isFading() const;
+
+public slots:
+    void setLevel(int level);
+    void fadeTo(int target, int durationMs);
+
+signals:
+    void fadeFinished(int level);
+
+private slots:
+    void frame();
+
+private:
+    void write(int level);
+    static double toPerceived(int level);
+    static int fromPerceived(double perceived);
+
+    int m_fd;
+    int m_level;
+    int m_target;
+    double m_fromPerceived;
+    double m_toPerceived;
+    int m_durationMs;
+    QElapsedTimer m_clock;
+    QTimer m_frameTimer;
+};
+
+#endif // BACKLIGHT_H
@@ -0,0 +1,117 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#include "buzzer.h"
+#include <QDebug>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define BUZZER_MAX_STEPS    8
+
+/* Pattern: priority and alternating on/off durations (ms), 0 terminated */
+struct BuzzerPattern
+{
+    int priority;
+    int steps[BUZZER_MAX_STEPS];
+};
+
+static const struct BuzzerPattern buzzerPatterns[] = {
+    /* KeyClick */          { 1, { 20, 0 } },
+    /* Notify */            { 1, { 10, 0 } },
+    /* Error */             { 2, { 20, 80, 20, 0 } },
+    /* CountdownTick */     { 2, { 10, 0 } },
+    /* CountdownFinal */    { 4, { 500, 0 } },
+    /* Ring */              { 3, { 500, 0 } },
+};
+
+Buzzer::Buzzer(const QString &path, QObject *parent)
+    : QObject(parent)
+    , m_on(true)
+    , m_pattern(nullptr)
+    , m_step(0)
+{
+    QByteArray device = path.toLocal8Bit();
+    m_fd = open(device.constData(), O_WRONLY | O_CLOEXEC);
+    if (m_fd < 0)
+        qErrnoWarning(errno, "Cannot open buzzer %s", device.constData());
+    write(false);
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(step()));
+}
+
+Buzzer::~Buzzer()
+{
+    if (m_fd >= 0) {
+        write(false);
+        close(m_fd);
+    }
+}
+
+bool Buzzer::isPlaying() const
+{
+    return m_pattern != nullptr;
+}
+
+void Buzzer::play(Buzzer::Pattern pattern)
+{
+    const struct BuzzerPattern *requested = &buzzerPatterns[pattern];
+    if (m_pattern && m_pattern->priority > requested->priority)
+        return;
+    m_pattern = requested;
+    m_step = 0;
+    step();
+}
+
+void Buzzer::stop()
+{
+    m_timer.stop();
+    m_pattern = nullptr;
+    write(false);
+}
+
+/* Even steps are 'on', odd steps 'off' */
+void Buzzer::step()
+{
+    if (!m_pattern)
+        return;
+    if (m_step >= BUZZER_MAX_STEPS || m_pattern->steps[m_step] == 0) {
+        stop();
+        return;
+    }
+    write(m_step % 2 == 0);
+    m_timer.start(m_pattern->steps[m_step]);
+    m_step++;
+}
+
+void Buzzer::write(bool on)
+{
+    if (m_fd < 0 || on == m_on)
+        return;
+    const char *value = on ? "1\n" : "0\n";
+    if (pwrite(m_fd, value, 2, 0) != 2) {
+        qErrnoWarning(errno, "Buzzer write failed");
+        return;
+    }
+    m_on = on;
+}
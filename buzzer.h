@@ -0,0 +1,73 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef BUZZER_H
+#define BUZZER_H
+
+#include <QObject>
+#include <QTimer>
+
+struct BuzzerPattern;
+
+/*
+ * Buzzer pattern sequencer. Owns the sysfs buzzer file and plays one
+ * pattern at a time from a single timer. A request with lower priority
+ * than the pattern playing is dropped, equal or higher replaces it.
+ */
+class Buzzer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Pattern {
+        KeyClick,
+        Notify,
+        Error,
+        CountdownTick,
+        CountdownFinal,
+        Ring
+    };
+    Q_ENUM(Pattern)
+
+    explicit Buzzer(const QString &path, QObject *parent = nullptr);
+    ~Buzzer();
+
+    bool isPlaying() const;
+
+public slots:
+    void play(Buzzer::Pattern pattern);
+    void stop();
+
+private slots:
+    void step();
+
+private:
+    void write(bool on);
+
+    int m_fd;
+    bool m_on;
+    QTimer m_timer;
+    const BuzzerPattern *m_pattern;
+    int m_step;
+};
+
+#endif // BUZZER_H
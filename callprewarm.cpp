@@ -0,0 +1,158 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "callprewarm.h"
+#include "callsession.h"
+#include "servicecontrol.h"
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <climits>
+
+CallPrewarm::CallPrewarm(ServiceControl *serviceControl, QObject *parent)
+    : QObject(parent)
+    , m_serviceControl(serviceControl)
+    , m_enabled(false)
+    , m_budget(2)
+    , m_idleTimeout(120000)
+{
+    QFile::remove(CALL_PREWARM_HISTORY_FILE);
+    m_clock.start();
+    m_idleTimer.setSingleShot(true);
+    connect(&m_idleTimer, SIGNAL(timeout()), this, SLOT(cool()));
+    connect(&m_refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+}
+
+void CallPrewarm::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if ( !enabled ) {
+        cool();
+        clearHistory();
+    }
+}
+
+void CallPrewarm::setBudget(int peers, int idleSeconds)
+{
+    m_budget = qMax(0, peers);
+    m_idleTimeout = qMax(1, idleSeconds) * 1000;
+    while ( m_warm.size() > m_budget )
+        m_warm.removeLast();
+}
+
+void CallPrewarm::setPeers(const QStringList &ids, const QStringList &ips)
+{
+    m_ids = ids;
+    m_ips = ips;
+    cool();
+}
+
+void CallPrewarm::called(const QString &id)
+{
+    if ( !m_enabled )
+        return;
+    m_callCounts[id]++;
+    m_lastCalled = id;
+}
+
+void CallPrewarm::clearHistory()
+{
+    m_callCounts.clear();
+    m_lastCalled.clear();
+}
+
+/* Last called first, then by call count. Never called peers stay cold. */
+QStringList CallPrewarm::likelyPeers() const
+{
+    QList<QPair<int, int>> ranked;
+    for (int x = 0; x < m_ids.size() && x < m_ips.size(); x++) {
+        if ( m_ids[x].isEmpty() || m_ips[x].isEmpty() )
+            continue;
+        int count = m_callCounts.value(m_ids[x]);
+        if ( m_ids[x] == m_lastCalled )
+            count = INT_MAX;
+        if ( count > 0 )
+            ranked.append(qMakePair(count, x));
+    }
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](const QPair<int, int> &a, const QPair<int, int> &b) { return a.first > b.first; });
+    QStringList ips;
+    for (int x = 0; x < ranked.size() && x < m_budget; x++)
+        ips.append(m_ips[ranked[x].second]);
+    return ips;
+}
+
+void CallPrewarm::wake()
+{
+    if ( !m_enabled || m_budget == 0 )
+        return;
+    m_idleTimer.start(m_idleTimeout);
+    if ( m_warm.isEmpty() ) {
+        m_warm = likelyPeers();
+        for (const QString &ip : qAsConst(m_warm)) {
+            QString id = m_ids.value(m_ips.indexOf(ip));
+            m_serviceControl->loadUnit(CallSession::clientUnit(id));
+        }
+        if ( !m_warm.isEmpty() )
+            qDebug() << "Prewarm:" << m_warm;
+    }
+    refresh();
+    if ( !m_warm.isEmpty() && !m_refreshTimer.isActive() )
+        m_refreshTimer.start(CALL_PREWARM_REFRESH);
+}
+
+void CallPrewarm::cool()
+{
+    m_idleTimer.stop();
+    m_refreshTimer.stop();
+    m_warm.clear();
+    m_availableAt.clear();
+    m_askedAt.clear();
+}
+
+/* At most one status per warm peer and refresh period */
+void CallPrewarm::refresh()
+{
+    qint64 now = m_clock.elapsed();
+    for (const QString &ip : qAsConst(m_warm)) {
+        if ( m_askedAt.contains(ip) && now - m_askedAt.value(ip) < CALL_PREWARM_REFRESH / 2 )
+            continue;
+        m_askedAt.insert(ip, now);
+        emit command(ip + ",status");
+    }
+}
+
+void CallPrewarm::presence(const QString &ip, const QString &status)
+{
+    if ( status == "available" && m_warm.contains(ip) )
+        m_availableAt.insert(ip, m_clock.elapsed());
+    else if ( status == "busy" || status == "offline" )
+        m_availableAt.remove(ip);
+}
+
+bool CallPrewarm::isAvailable(const QString &ip) const
+{
+    if ( !m_enabled || !m_availableAt.contains(ip) )
+        return false;
+    return m_clock.elapsed() - m_availableAt.value(ip) < CALL_PREWARM_PRESENCE_TTL;
+}
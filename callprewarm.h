@@ -0,0 +1,104 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef CALLPREWARM_H
+#define CALLPREWARM_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QStringList>
+#include <QTimer>
+
+class ServiceControl;
+
+/* Written by earlier versions, removed on start */
+#define CALL_PREWARM_HISTORY_FILE   "/opt/tunnel/callhistory.ini"
+/* 'available' older than this is not trusted for dialing */
+#define CALL_PREWARM_PRESENCE_TTL   30000
+#define CALL_PREWARM_REFRESH        20000
+
+/*
+ * Optional pre-warming of the peers we are most likely to call: the
+ * last called one, then the most called ones, up to the peer budget.
+ * On wake() their tunnel units are loaded into systemd and their
+ * presence is asked with 'status' and kept fresh. A tap on a warm
+ * peer that is known available can skip the status round trip and go
+ * straight to 'prepare'. Everything warm is dropped after the idle
+ * timeout without a new wake(). Who was called is kept in RAM only,
+ * and only while pre-warming is enabled.
+ */
+class CallPrewarm : public QObject
+{
+    Q_OBJECT
+
+public:
+    CallPrewarm(ServiceControl *serviceControl, QObject *parent = nullptr);
+
+    void setEnabled(bool enabled);
+    /* Peers kept warm at once, and seconds until they are dropped */
+    void setBudget(int peers, int idleSeconds);
+    /* Configured contacts, ids and ips in the same order */
+    void setPeers(const QStringList &ids, const QStringList &ips);
+    /* Call history, ranks the peers */
+    void called(const QString &id);
+    void clearHistory();
+
+    bool isAvailable(const QString &ip) const;
+
+public slots:
+    void wake();
+    void cool();
+    /* Every status line from telemetry: available, busy, offline */
+    void presence(const QString &ip, const QString &status);
+
+signals:
+    /* Line for the telemetry FIFO */
+    void command(const QString &line);
+
+private slots:
+    void refresh();
+
+private:
+    QStringList likelyPeers() const;
+
+    ServiceControl *m_serviceControl;
+    /* id -> calls, and the last called id */
+    QHash<QString, int> m_callCounts;
+    QString m_lastCalled;
+    bool m_enabled;
+    int m_budget;
+    int m_idleTimeout;
+    QStringList m_ids;
+    QStringList m_ips;
+    /* ip of warm peers */
+    QStringList m_warm;
+    QElapsedTimer m_clock;
+    /* ip -> time of last 'available' on m_clock */
+    QHash<QString, qint64> m_availableAt;
+    QHash<QString, qint64> m_askedAt;
+    QTimer m_idleTimer;
+    QTimer m_refreshTimer;
+};
+
+#endif // CALLPREWARM_H
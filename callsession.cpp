@@ -0,0 +1,500 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "callsession.h"
+#include "servicecontrol.h"
+#include <QDebug>
+#include <QFile>
+
+#define STATE_BIT(state)        (1 << (state))
+#define CONNECTED_STATES        (STATE_BIT(Connected) | STATE_BIT(Ringing) | STATE_BIT(Active) \
+                                 | STATE_BIT(Incoming) | STATE_BIT(Answering))
+
+const CallSession::Transition CallSession::s_transitions[] = {
+    { Connect,             NoRole, STATE_BIT(Idle) },
+    { GoSecure,            Client, STATE_BIT(Connected) },
+    { RemoteAnswered,      Client, STATE_BIT(Ringing) },
+    { Terminate,           Client, STATE_BIT(Preparing) | STATE_BIT(Connected)
+                                   | STATE_BIT(Ringing) | STATE_BIT(Active) },
+    { ClientConnected,     NoRole, STATE_BIT(Idle) },
+    { RingReceived,        Server, STATE_BIT(Incoming) },
+    { Answer,              Server, STATE_BIT(Incoming) },
+    { Hangup,              Server, STATE_BIT(Incoming) | STATE_BIT(Answering) | STATE_BIT(Active) },
+    /* Only the peer that opened the tunnel can be the initiator */
+    { InitiatorDisconnect, Server, STATE_BIT(Incoming) | STATE_BIT(Answering) | STATE_BIT(Active) },
+    { RemoteHangup,        NoRole, CONNECTED_STATES },
+    { TerminateReady,      NoRole, CONNECTED_STATES | STATE_BIT(Disconnecting) },
+    { Abort,               NoRole, 0xffff & ~STATE_BIT(Idle) },
+};
+
+int CallSession::s_clientFileUsers = 0;
+
+CallSession::CallSession(ServiceControl *serviceControl, TelemetryQueue *telemetry, CallTrace *trace,
+                         QObject *parent)
+    : QObject(parent)
+    , m_serviceControl(serviceControl)
+    , m_telemetry(telemetry)
+    , m_trace(trace)
+    , m_state(Idle)
+    , m_role(NoRole)
+    , m_prepared(false)
+    , m_unitUp(false)
+    , m_audio(false)
+    , m_clientFile(false)
+{
+    m_teardownTimer.setSingleShot(true);
+    connect(&m_teardownTimer, SIGNAL(timeout()), this, SLOT(teardownTimeout()));
+    connect(m_serviceControl, SIGNAL(unitStarted(QString)), this, SLOT(unitStarted(QString)));
+    connect(m_serviceControl, SIGNAL(unitStopped(QString)), this, SLOT(unitStopped(QString)));
+    connect(m_serviceControl, SIGNAL(unitFailed(QString,QString)), this, SLOT(unitFailed(QString,QString)));
+    connect(m_serviceControl, SIGNAL(unitStateChanged(QString,QString)),
+            this, SLOT(unitStateChanged(QString,QString)));
+}
+
+bool CallSession::isConnected() const
+{
+    return (CONNECTED_STATES & STATE_BIT(m_state)) != 0;
+}
+
+QString CallSession::otpPeerIp() const
+{
+    if ( m_role != NoRole && !m_otpPeerIp.isEmpty() )
+        return m_otpPeerIp;
+    if ( m_role == Client )
+        return CALL_CLIENT_OTP_PEER;
+    if ( m_role == Server )
+        return CALL_SERVER_OTP_PEER;
+    return QString();
+}
+
+void CallSession::setOtpPeerIp(const QString &ip)
+{
+    m_otpPeerIp = ip;
+}
+
+QString CallSession::clientUnit(const QString &nodeId)
+{
+    return "connect-with-" + nodeId + "-c.service";
+}
+
+void CallSession::setLocalNode(const QString &id, const QString &ip, const QString &name)
+{
+    m_localId = id;
+    m_localIp = ip;
+    m_localName = name;
+}
+
+bool CallSession::accept(Event event)
+{
+    for (const Transition &transition : s_transitions) {
+        if ( transition.event != event )
+            continue;
+        if ( (transition.states & STATE_BIT(m_state))
+                && (transition.role == NoRole || transition.role == m_role) )
+            return true;
+        break;
+    }
+    qDebug() << "Call: rejected" << event << "in" << m_state << m_role;
+    return false;
+}
+
+void CallSession::setState(State state)
+{
+    if ( state == m_state )
+        return;
+    State previous = m_state;
+    m_state = state;
+    qDebug() << "Call:" << m_peerId << previous << "->" << state;
+    if ( state == Ringing || state == Answering || state == Active )
+        m_audio = true;
+    else if ( state == Connected || state == Incoming )
+        m_audio = false;
+    if ( state == Disconnecting ) {
+        /* Requests not yet sent belong to the call being torn down */
+        m_telemetry->cancel(this);
+        m_teardownTimer.start(CALL_TEARDOWN_TIMEOUT);
+    } else {
+        m_teardownTimer.stop();
+    }
+    emit stateChanged(state, previous);
+}
+
+void CallSession::request(const QString &command, ReplyHandler handler, int timeout)
+{
+    m_telemetry->request(this, m_peerIp, command,
+                         [this, handler](bool replied) { (this->*handler)(replied); }, timeout);
+}
+
+/* Client */
+
+bool CallSession::connectTo(const QString &nodeIp, const QString &nodeId)
+{
+    if ( !accept(Connect) )
+        return false;
+    m_role = Client;
+    m_peerIp = nodeIp;
+    m_peerId = nodeId;
+    m_unit = clientUnit(nodeId);
+    m_prepared = false;
+    m_unitUp = false;
+    setState(Preparing);
+    m_trace->begin(m_peerId, "setup");
+    m_trace->begin(m_peerId, "prepare");
+    m_trace->begin(m_peerId, "service start");
+    /* Independent: peer readies its end while our tunnel unit starts */
+    request(m_peerIp + ",prepare", &CallSession::prepareReplied);
+    qDebug() << "Starting service: " << m_unit;
+    m_serviceControl->startUnit(m_unit);
+    return true;
+}
+
+void CallSession::prepareReplied(bool replied)
+{
+    if ( m_state != Preparing )
+        return;
+    m_trace->end(m_peerId, "prepare", replied);
+    if ( !replied ) {
+        emit failed("Timeout. Aborting.");
+        stopClient();
+        return;
+    }
+    m_prepared = true;
+    if ( m_unitUp )
+        clientUp();
+}
+
+void CallSession::unitStarted(const QString &unit)
+{
+    if ( unit != m_unit || m_state != Preparing )
+        return;
+    m_unitUp = true;
+    m_trace->end(m_peerId, "service start");
+    if ( m_prepared )
+        clientUp();
+}
+
+void CallSession::clientUp()
+{
+    /* Shared by all client sessions, removed with the last one */
+    if ( !m_clientFile ) {
+        m_clientFile = true;
+        if ( s_clientFileUsers++ == 0 ) {
+            QFile touchFile(CALL_CLIENT_FILE);
+            touchFile.open(QIODevice::WriteOnly);
+            touchFile.close();
+        }
+    }
+    m_trace->end(m_peerId, "setup");
+    setState(Connected);
+    /* Let the peer UI know; audio is established by the peer answering */
+    m_trace->begin(m_peerId, "client_connected");
+    request(m_peerIp + ",message,client_connected;" + m_localId + ";" + m_localIp + ";" + m_localName,
+            &CallSession::clientConnectedReplied);
+}
+
+void CallSession::clientConnectedReplied(bool replied)
+{
+    m_trace->end(m_peerId, "client_connected", replied);
+    if ( !replied )
+        emit failed("Timeout. Aborting.");
+}
+
+bool CallSession::goSecure()
+{
+    if ( !accept(GoSecure) )
+        return false;
+    setState(Ringing);
+    m_trace->begin(m_peerId, "ring");
+    request(m_peerIp + ",ring", &CallSession::ringReplied);
+    return true;
+}
+
+void CallSession::ringReplied(bool replied)
+{
+    if ( m_state != Ringing )
+        return;
+    m_trace->end(m_peerId, "ring", replied);
+    if ( !replied ) {
+        emit failed("Timeout. Aborting.");
+        setState(Connected);
+        return;
+    }
+    /* Ring the peer UI. Includes the time the peer takes to accept */
+    emit command(m_peerIp + ",message,ring");
+    m_trace->begin(m_peerId, "remote answer");
+}
+
+bool CallSession::remoteAnswered()
+{
+    if ( !accept(RemoteAnswered) )
+        return false;
+    m_trace->end(m_peerId, "remote answer");
+    setState(Active);
+    return true;
+}
+
+bool CallSession::terminate()
+{
+    if ( !accept(Terminate) )
+        return false;
+    disconnectClient();
+    return true;
+}
+
+void CallSession::disconnectClient()
+{
+    setState(Disconnecting);
+    m_trace->begin(m_peerId, "teardown");
+    m_trace->begin(m_peerId, "terminate");
+    request(m_peerIp + ",terminate", &CallSession::terminateReplied, CALL_TEARDOWN_REPLY_TIMEOUT);
+}
+
+/* On timeout the local tunnel is still taken down. Peer UI messages
+   do not go through the tunnel, so the unit stops in parallel. */
+void CallSession::terminateReplied(bool replied)
+{
+    m_trace->end(m_peerId, "terminate", replied);
+    if ( !replied )
+        emit failed("Timeout. Aborting.");
+    if ( m_state != Disconnecting || m_role != Client )
+        return;
+    /* So the peer can tear down its indications */
+    request(m_peerIp + ",message,initiator_disconnect", &CallSession::initiatorDisconnectReplied,
+            CALL_TEARDOWN_REPLY_TIMEOUT);
+    stopClient();
+}
+
+void CallSession::initiatorDisconnectReplied(bool replied)
+{
+    if ( !replied )
+        qDebug() << "Call: initiator_disconnect not acknowledged";
+}
+
+/* Teardown continues in unitStopped() */
+void CallSession::stopClient()
+{
+    setState(Disconnecting);
+    m_trace->begin(m_peerId, "service stop");
+    m_serviceControl->stopUnit(m_unit);
+}
+
+void CallSession::unitStopped(const QString &unit)
+{
+    if ( unit != m_unit || m_state != Disconnecting )
+        return;
+    m_trace->end(m_peerId, "service stop");
+    finish();
+}
+
+void CallSession::unitFailed(const QString &unit, const QString &result)
+{
+    if ( unit != m_unit || m_state == Idle )
+        return;
+    emit failed("Tunnel " + result);
+    /* Failed start: nothing to stop. Failed stop: clean up locally anyway */
+    if ( m_state == Preparing || m_state == Disconnecting )
+        finish();
+}
+
+/* Tunnel unit went down without us asking */
+void CallSession::unitStateChanged(const QString &unit, const QString &activeState)
+{
+    if ( unit != m_unit || !isConnected() || m_role != Client )
+        return;
+    if ( activeState == "failed" || activeState == "inactive" ) {
+        emit failed("Tunnel down");
+        finish();
+    }
+}
+
+/* Server */
+
+bool CallSession::clientConnected(const QString &nodeId, const QString &nodeIp, const QString &name)
+{
+    if ( !accept(ClientConnected) )
+        return false;
+    m_role = Server;
+    m_peerId = nodeId;
+    m_peerIp = nodeIp;
+    m_peerName = name;
+    setState(Incoming);
+    return true;
+}
+
+bool CallSession::ringReceived()
+{
+    return accept(RingReceived);
+}
+
+bool CallSession::answer()
+{
+    if ( !accept(Answer) )
+        return false;
+    setState(Answering);
+    m_trace->begin(m_peerId, "answer");
+    m_trace->begin(m_peerId, "answer_success");
+    /* Indicate that we answered succesfully, then answer to telemetry */
+    request(m_peerIp + ",message,answer_success", &CallSession::answerSuccessReplied);
+    return true;
+}
+
+void CallSession::answerSuccessReplied(bool replied)
+{
+    if ( m_state != Answering )
+        return;
+    m_trace->end(m_peerId, "answer_success", replied);
+    if ( !replied ) {
+        emit failed("Timeout. Aborting.");
+        m_trace->drop(m_peerId);
+        setState(Incoming);
+        return;
+    }
+    m_trace->begin(m_peerId, "answer reply");
+    request(m_peerIp + ",answer", &CallSession::answerReplied);
+}
+
+void CallSession::answerReplied(bool replied)
+{
+    if ( m_state != Answering )
+        return;
+    m_trace->end(m_peerId, "answer reply", replied);
+    if ( !replied ) {
+        emit failed("Timeout. Aborting.");
+        m_trace->drop(m_peerId);
+        setState(Incoming);
+        return;
+    }
+    /* Audio connect is not acknowledged, 'answer' ends when it is sent */
+    emit command("127.0.0.1,connect_audio_as_server");
+    m_trace->end(m_peerId, "answer");
+    setState(Active);
+}
+
+bool CallSession::hangup()
+{
+    if ( !accept(Hangup) )
+        return false;
+    disconnectServer();
+    return true;
+}
+
+/* Remote (who connected us) pressed 'terminate', we do the same */
+bool CallSession::initiatorDisconnect()
+{
+    if ( !accept(InitiatorDisconnect) )
+        return false;
+    disconnectServer();
+    return true;
+}
+
+void CallSession::disconnectServer()
+{
+    setState(Disconnecting);
+    m_trace->begin(m_peerId, "teardown");
+    m_trace->begin(m_peerId, "hangup");
+    request(m_peerIp + ",hangup", &CallSession::hangupReplied, CALL_TEARDOWN_REPLY_TIMEOUT);
+}
+
+void CallSession::hangupReplied(bool replied)
+{
+    m_trace->end(m_peerId, "hangup", replied);
+    if ( !replied )
+        emit failed("Timeout. Aborting.");
+    if ( m_state == Disconnecting && m_role == Server )
+        finish();
+}
+
+/* Either role */
+
+bool CallSession::remoteHangup()
+{
+    if ( !accept(RemoteHangup) )
+        return false;
+    if ( m_role == Client )
+        disconnectClient();
+    else
+        finish();
+    return true;
+}
+
+/* Peer has torn the call down, or answered our terminate */
+bool CallSession::terminateReady(const QString &ip)
+{
+    if ( ip != m_peerIp || !accept(TerminateReady) )
+        return false;
+    if ( m_state == Disconnecting )
+        return true;
+    if ( m_role == Client )
+        stopClient();
+    else
+        finish();
+    return true;
+}
+
+/* Completion never came: take the local side down regardless */
+void CallSession::teardownTimeout()
+{
+    if ( m_state != Disconnecting )
+        return;
+    emit failed("Teardown timeout");
+    if ( m_role == Client )
+        m_serviceControl->stopUnit(m_unit);
+    finish();
+}
+
+void CallSession::abort()
+{
+    if ( !accept(Abort) )
+        return;
+    if ( m_role == Client )
+        m_serviceControl->stopUnit(m_unit);
+    finish();
+}
+
+/* Local part of every teardown. Requests of this call, sent or not,
+   must not reach the next call of this session. */
+void CallSession::finish()
+{
+    m_telemetry->cancel(this);
+    if ( m_clientFile ) {
+        m_clientFile = false;
+        if ( --s_clientFileUsers == 0 )
+            QFile::remove(CALL_CLIENT_FILE);
+    }
+    /* 'telemetryclient' knows how to terminate audio, based on how it's
+       established (client or server). Only one session has audio. */
+    if ( m_audio )
+        emit command("127.0.0.1,disconnect_audio");
+    m_trace->end(m_peerId, "teardown");
+    m_trace->drop(m_peerId);
+    setState(Idle);
+    m_role = NoRole;
+    m_peerIp.clear();
+    m_peerId.clear();
+    m_peerName.clear();
+    m_otpPeerIp.clear();
+    m_unit.clear();
+    m_audio = false;
+    m_prepared = false;
+    m_unitUp = false;
+}
@@ -0,0 +1,195 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef CALLSESSION_H
+#define CALLSESSION_H
+
+#include <QObject>
+#include <QTimer>
+#include "calltrace.h"
+#include "telemetryqueue.h"
+
+class ServiceControl;
+
+#define CALL_REPLY_TIMEOUT      10000
+/* Teardown waits less for the peer, the local side goes down anyway */
+#define CALL_TEARDOWN_REPLY_TIMEOUT 3000
+/* Safety net: Disconnecting never lasts longer than this */
+#define CALL_TEARDOWN_TIMEOUT   15000
+/* OTP tunnel addresses by our role, when the peer has none configured */
+#define CALL_CLIENT_OTP_PEER    "10.10.0.1"
+#define CALL_SERVER_OTP_PEER    "10.10.0.2"
+#define CALL_CLIENT_FILE        "/tmp/CLIENT_CALL_ACTIVE"
+
+/*
+ * One call with one peer; several sessions can run side by side, one
+ * per peer. We are the client when we opened the OTP tunnel (contact
+ * tapped) and the server when the peer opened it to us. Events are
+ * checked against a table of the state and role they are legal in;
+ * anything else is rejected and logged.
+ *
+ * Commands that expect a reply go through the shared TelemetryQueue.
+ * Steps that do not depend on each other run together: the tunnel
+ * unit is started while the peer handles 'prepare'.
+ *
+ * Peer and role are still readable in stateChanged() to Idle.
+ */
+class CallSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum State {
+        Idle,
+        Preparing,      /* client: prepare sent, tunnel unit starting */
+        Connected,      /* client: tunnel up */
+        Ringing,        /* client: ring sent, waiting for answer */
+        Incoming,       /* server: peer's tunnel is up */
+        Answering,      /* server: answer in progress */
+        Active,         /* audio up */
+        Disconnecting   /* terminate or hangup sent */
+    };
+    Q_ENUM(State)
+    enum Role { NoRole, Client, Server };
+    Q_ENUM(Role)
+    /* External events, internal steps are driven by replies and units */
+    enum Event {
+        Connect,
+        GoSecure,
+        RemoteAnswered,
+        ClientConnected,
+        RingReceived,
+        Answer,
+        Hangup,
+        Terminate,
+        InitiatorDisconnect,
+        RemoteHangup,
+        TerminateReady,
+        Abort
+    };
+    Q_ENUM(Event)
+
+    CallSession(ServiceControl *serviceControl, TelemetryQueue *telemetry, CallTrace *trace,
+                QObject *parent = nullptr);
+
+    State state() const { return m_state; }
+    Role role() const { return m_role; }
+    /* Tunnel is up, in either role */
+    bool isConnected() const;
+    /* Audio was set up or is being set up */
+    bool hasAudio() const { return m_audio; }
+    QString peerIp() const { return m_peerIp; }
+    QString peerId() const { return m_peerId; }
+    QString peerName() const { return m_peerName; }
+    QString otpPeerIp() const;
+    /* Peer's own tunnel address, set before connectTo()/clientConnected() */
+    void setOtpPeerIp(const QString &ip);
+    /* Client side tunnel unit for a peer */
+    static QString clientUnit(const QString &nodeId);
+
+    /* Sent to the peer in client_connected */
+    void setLocalNode(const QString &id, const QString &ip, const QString &name);
+
+public slots:
+    /* User and telemetry events, false when rejected */
+    bool connectTo(const QString &nodeIp, const QString &nodeId);
+    bool goSecure();
+    bool remoteAnswered();
+    bool clientConnected(const QString &nodeId, const QString &nodeIp, const QString &name);
+    bool ringReceived();
+    bool answer();
+    bool hangup();
+    bool terminate();
+    bool initiatorDisconnect();
+    bool remoteHangup();
+    /* Telemetry 'terminate_ready' from ip */
+    bool terminateReady(const QString &ip);
+    /* Local teardown without telling the peer */
+    void abort();
+
+signals:
+    void stateChanged(CallSession::State state, CallSession::State previous);
+    /* Line for the telemetry FIFO */
+    void command(const QString &line);
+    void failed(const QString &reason);
+
+private slots:
+    void unitStarted(const QString &unit);
+    void unitStopped(const QString &unit);
+    void unitFailed(const QString &unit, const QString &result);
+    void unitStateChanged(const QString &unit, const QString &activeState);
+    void teardownTimeout();
+
+private:
+    typedef void (CallSession::*ReplyHandler)(bool replied);
+
+    bool accept(Event event);
+    void setState(State state);
+    void request(const QString &command, ReplyHandler handler, int timeout = CALL_REPLY_TIMEOUT);
+    void clientUp();
+    void disconnectClient();
+    void stopClient();
+    void disconnectServer();
+    void finish();
+
+    void prepareReplied(bool replied);
+    void clientConnectedReplied(bool replied);
+    void ringReplied(bool replied);
+    void answerSuccessReplied(bool replied);
+    void answerReplied(bool replied);
+    void terminateReplied(bool replied);
+    void initiatorDisconnectReplied(bool replied);
+    void hangupReplied(bool replied);
+
+    struct Transition
+    {
+        Event event;
+        Role role;          /* NoRole: either */
+        quint16 states;     /* bit per State the event is legal in */
+    };
+    static const Transition s_transitions[];
+
+    /* Client sessions holding CALL_CLIENT_FILE */
+    static int s_clientFileUsers;
+
+    ServiceControl *m_serviceControl;
+    TelemetryQueue *m_telemetry;
+    CallTrace *m_trace;
+    State m_state;
+    Role m_role;
+    QString m_peerIp;
+    QString m_peerId;
+    QString m_peerName;
+    QString m_otpPeerIp;
+    QString m_unit;
+    QString m_localId;
+    QString m_localIp;
+    QString m_localName;
+    bool m_prepared;
+    bool m_unitUp;
+    bool m_audio;
+    bool m_clientFile;
+    QTimer m_teardownTimer;
+};
+
+#endif // CALLSESSION_H
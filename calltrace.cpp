@@ -0,0 +1,128 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "calltrace.h"
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+
+static const int s_bucketLimitsMs[CALL_TRACE_BUCKETS - 1] = { 50, 100, 200, 500, 1000, 2000, 5000, 10000 };
+
+CallTrace::CallTrace()
+{
+    m_clock.start();
+}
+
+QString CallTrace::key(const QString &peer, const QString &phase)
+{
+    return peer + '\n' + phase;
+}
+
+void CallTrace::begin(const QString &peer, const QString &phase)
+{
+    m_open.insert(key(peer, phase), m_clock.nsecsElapsed() / 1000);
+}
+
+void CallTrace::end(const QString &peer, const QString &phase, bool ok)
+{
+    auto it = m_open.find(key(peer, phase));
+    if ( it == m_open.end() )
+        return;
+    qint64 us = m_clock.nsecsElapsed() / 1000 - it.value();
+    m_open.erase(it);
+
+    Histogram &histogram = m_histograms[peer][phase];
+    if ( !ok ) {
+        histogram.timeouts++;
+        qDebug() << "Call trace:" << peer << phase << "timeout after" << us / 1000 << "ms";
+        return;
+    }
+    int bucket = 0;
+    while ( bucket < CALL_TRACE_BUCKETS - 1 && us >= s_bucketLimitsMs[bucket] * 1000LL )
+        bucket++;
+    histogram.buckets[bucket]++;
+    if ( histogram.count == 0 || us < histogram.minUs )
+        histogram.minUs = us;
+    if ( us > histogram.maxUs )
+        histogram.maxUs = us;
+    histogram.sumUs += us;
+    histogram.count++;
+    qDebug() << "Call trace:" << peer << phase << us / 1000.0 << "ms";
+}
+
+void CallTrace::drop(const QString &peer)
+{
+    QString prefix = peer + '\n';
+    for (auto it = m_open.begin(); it != m_open.end(); ) {
+        if ( it.key().startsWith(prefix) )
+            it = m_open.erase(it);
+        else
+            ++it;
+    }
+}
+
+void CallTrace::clear()
+{
+    m_open.clear();
+    m_histograms.clear();
+}
+
+QString CallTrace::report() const
+{
+    QString text;
+    QTextStream out(&text);
+    out << QString("%1 %2 %3 %4 %5 %6 ")
+           .arg("phase", -18).arg("n", 4).arg("t/o", 4)
+           .arg("min", 7).arg("avg", 7).arg("max", 7);
+    for (int limit : s_bucketLimitsMs)
+        out << QString("<%1").arg(limit, 5);
+    out << QString(" >=%1").arg(s_bucketLimitsMs[CALL_TRACE_BUCKETS - 2]) << Qt::endl;
+
+    for (auto peer = m_histograms.constBegin(); peer != m_histograms.constEnd(); ++peer) {
+        out << "peer " << peer.key() << Qt::endl;
+        for (auto phase = peer.value().constBegin(); phase != peer.value().constEnd(); ++phase) {
+            const Histogram &histogram = phase.value();
+            double avgMs = histogram.count ? histogram.sumUs / 1000.0 / histogram.count : 0;
+            out << QString("%1 %2 %3 %4 %5 %6 ")
+                   .arg(phase.key(), -18).arg(histogram.count, 4).arg(histogram.timeouts, 4)
+                   .arg(histogram.minUs / 1000.0, 7, 'f', 0).arg(avgMs, 7, 'f', 0)
+                   .arg(histogram.maxUs / 1000.0, 7, 'f', 0);
+            for (int bucket = 0; bucket < CALL_TRACE_BUCKETS; bucket++)
+                out << QString("%1").arg(histogram.buckets[bucket], bucket < CALL_TRACE_BUCKETS - 1 ? 6 : 8);
+            out << Qt::endl;
+        }
+    }
+    return text;
+}
+
+bool CallTrace::exportTo(const QString &fileName) const
+{
+    QFile file(fileName);
+    if ( !file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text) ) {
+        qDebug() << "Call trace export error:" << fileName << file.errorString();
+        return false;
+    }
+    QTextStream out(&file);
+    out << report();
+    return true;
+}
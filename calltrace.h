@@ -0,0 +1,76 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef CALLTRACE_H
+#define CALLTRACE_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QString>
+
+#define CALL_TRACE_FILE         "/tmp/sinm-call.trace"
+#define CALL_TRACE_BUCKETS      9
+
+/*
+ * Call phase timing, per peer. begin() and end() bracket a phase on the
+ * monotonic clock; finished phases are kept as a latency histogram per
+ * peer and phase, with bucket limits 50 ms .. 10 s and one for slower.
+ * A phase that ends without its reply counts as a timeout. GUI thread
+ * only.
+ */
+class CallTrace
+{
+public:
+    CallTrace();
+
+    void begin(const QString &peer, const QString &phase);
+    /* No-op when the phase was not begun */
+    void end(const QString &peer, const QString &phase, bool ok = true);
+    /* Forget phases still open, e.g. at teardown */
+    void drop(const QString &peer);
+    void clear();
+
+    QString report() const;
+    bool exportTo(const QString &fileName = CALL_TRACE_FILE) const;
+
+private:
+    struct Histogram
+    {
+        int buckets[CALL_TRACE_BUCKETS] = {};
+        int count = 0;
+        int timeouts = 0;
+        qint64 sumUs = 0;
+        qint64 minUs = 0;
+        qint64 maxUs = 0;
+    };
+
+    static QString key(const QString &peer, const QString &phase);
+
+    QElapsedTimer m_clock;
+    QHash<QString, qint64> m_open;
+    /* peer -> phase -> histogram, sorted for the report */
+    QMap<QString, QMap<QString, Histogram>> m_histograms;
+};
+
+#endif // CALLTRACE_H
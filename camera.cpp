@@ -0,0 +1,237 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "camera.h"
+#include "imagedecoder.h"
+#include "jobrunner.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QPainter>
+#include <QThread>
+#include <QTimer>
+
+/* Script source */
+
+ScriptCameraSource::ScriptCameraSource(JobRunner *jobs, QObject *parent)
+    : CameraSource(parent)
+    , m_jobs(jobs)
+{
+}
+
+void ScriptCameraSource::capture(const QString &fileName)
+{
+    m_fileName = fileName;
+    QFile::remove(fileName);
+    QFile::remove(CAMERA_PIC_FILE);
+    m_job = m_jobs->start("/bin/takepicture.sh", { fileName }, CAMERA_CAPTURE_TIMEOUT);
+    connect(m_job, SIGNAL(finished(Job*)), this, SLOT(jobFinished(Job*)));
+}
+
+void ScriptCameraSource::cancel()
+{
+    if (m_job) {
+        m_job->disconnect(this);
+        m_job->cancel();
+    }
+}
+
+void ScriptCameraSource::jobFinished(Job *job)
+{
+    if (!job->succeeded()) {
+        emit failed(QString("takepicture.sh: %1").arg(job->status() == Job::TimedOut ? "timed out" : "failed"));
+        return;
+    }
+    if (QFile::exists(m_fileName))
+        emit captured(m_fileName);
+    else if (QFile::exists(CAMERA_PIC_FILE))
+        emit captured(CAMERA_PIC_FILE);
+    else
+        emit failed("takepicture.sh: no picture");
+}
+
+/* File source */
+
+FileCameraSource::FileCameraSource(const QString &fileName, QObject *parent)
+    : CameraSource(parent)
+    , m_source(fileName)
+{
+}
+
+void FileCameraSource::capture(const QString &fileName)
+{
+    Q_UNUSED(fileName)
+    QTimer::singleShot(0, this, [this]() {
+        if (QFile::exists(m_source))
+            emit captured(m_source);
+        else
+            emit failed("No such file: " + m_source);
+    });
+}
+
+/* Pattern source */
+
+PatternCameraSource::PatternCameraSource(QObject *parent)
+    : CameraSource(parent)
+    , m_frame(0)
+{
+}
+
+/* Drawn and encoded on a thread, like a camera would take its time */
+void PatternCameraSource::capture(const QString &fileName)
+{
+    int frame = ++m_frame;
+    QThread *thread = QThread::create([fileName, frame]() {
+        QImage image(1920, 1080, QImage::Format_RGB32);
+        QPainter painter(&image);
+        const QColor bars[] = { Qt::white, Qt::yellow, Qt::cyan, Qt::green,
+                                Qt::magenta, Qt::red, Qt::blue, Qt::black };
+        int width = image.width() / 8;
+        for (int i = 0; i < 8; i++)
+            painter.fillRect(i * width, 0, width, image.height(), bars[i]);
+        painter.setPen(Qt::black);
+        painter.fillRect(0, image.height() - 200, image.width(), 200, Qt::gray);
+        QFont font = painter.font();
+        font.setPixelSize(96);
+        painter.setFont(font);
+        painter.drawText(QRect(0, image.height() - 200, image.width(), 200), Qt::AlignCenter,
+                         QString("#%1  %2").arg(frame).arg(QTime::currentTime().toString("hh:mm:ss.zzz")));
+        painter.end();
+        image.save(fileName, "JPG");
+    });
+    connect(thread, &QThread::finished, this, [this, thread, fileName]() {
+        thread->deleteLater();
+        if (QFile::exists(fileName))
+            emit captured(fileName);
+        else
+            emit failed("Pattern write failed: " + fileName);
+    });
+    thread->start();
+}
+
+/* Camera */
+
+Camera::Camera(CameraSource *source, ImageDecoder *decoder, QObject *parent)
+    : QObject(parent)
+    , m_source(source)
+    , m_decoder(decoder)
+    , m_busy(false)
+    , m_previewId(0)
+    , m_fullId(0)
+    , m_previewMs(-1)
+    , m_fullMs(-1)
+{
+    connect(m_source, SIGNAL(captured(QString)), this, SLOT(sourceCaptured(QString)));
+    connect(m_source, SIGNAL(failed(QString)), this, SLOT(sourceFailed(QString)));
+    connect(m_decoder, SIGNAL(decoded(int,QImage)), this, SLOT(imageDecoded(int,QImage)));
+    connect(m_decoder, SIGNAL(failed(int,QString)), this, SLOT(imageDecodeFailed(int,QString)));
+}
+
+CameraSource *Camera::createSource(JobRunner *jobs, QObject *parent)
+{
+    QString source = qEnvironmentVariable("SINM_CAMERA");
+    if (source == "pattern")
+        return new PatternCameraSource(parent);
+    if (source.startsWith("file:"))
+        return new FileCameraSource(source.mid(5), parent);
+    return new ScriptCameraSource(jobs, parent);
+}
+
+void Camera::setBusy(bool busy)
+{
+    if (busy == m_busy)
+        return;
+    m_busy = busy;
+    emit busyChanged(m_busy);
+}
+
+void Camera::capture()
+{
+    if (m_busy)
+        return;
+    setBusy(true);
+    m_previewId = 0;
+    m_fullId = 0;
+    m_previewMs = -1;
+    m_fullMs = -1;
+    m_shutter.start();
+    m_source->capture(CAMERA_SHM_FILE);
+}
+
+void Camera::cancel()
+{
+    if (!m_busy)
+        return;
+    m_source->cancel();
+    m_previewId = 0;
+    m_fullId = 0;
+    setBusy(false);
+}
+
+void Camera::sourceCaptured(const QString &fileName)
+{
+    if (!m_busy)
+        return;
+    m_fileName = fileName;
+    /* Two threads in the pool: the small decode finishes first */
+    m_previewId = m_decoder->decodeFile(fileName, QSize(CAMERA_PREVIEW_SIZE, CAMERA_PREVIEW_SIZE));
+    m_fullId = m_decoder->decodeFile(fileName, m_displaySize, Qt::IgnoreAspectRatio);
+}
+
+void Camera::sourceFailed(const QString &error)
+{
+    if (!m_busy)
+        return;
+    qDebug() << "Camera:" << error;
+    setBusy(false);
+    emit failed(error);
+}
+
+void Camera::imageDecoded(int id, const QImage &image)
+{
+    if (id == m_previewId) {
+        m_previewId = 0;
+        m_previewMs = m_shutter.elapsed();
+        /* Full image may have won the race */
+        if (m_fullId)
+            emit preview(image);
+    } else if (id == m_fullId) {
+        m_fullId = 0;
+        m_fullMs = m_shutter.elapsed();
+        qDebug() << "Camera: shutter to preview" << m_previewMs << "ms, to full image" << m_fullMs << "ms";
+        setBusy(false);
+        emit captured(image);
+    }
+}
+
+void Camera::imageDecodeFailed(int id, const QString &error)
+{
+    if (id == m_previewId) {
+        m_previewId = 0;
+    } else if (id == m_fullId) {
+        m_fullId = 0;
+        qDebug() << "Camera: decode failed:" << error;
+        setBusy(false);
+        emit failed(error);
+    }
+}
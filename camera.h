@@ -0,0 +1,162 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPointer>
+#include <QSize>
+
+class ImageDecoder;
+class Job;
+class JobRunner;
+
+/* Frames go to tmpfs, never to flash */
+#define CAMERA_SHM_FILE         "/dev/shm/sinm-camera.jpg"
+/* Where takepicture.sh writes when it ignores the output argument */
+#define CAMERA_PIC_FILE         "/tmp/image.png"
+#define CAMERA_CAPTURE_TIMEOUT  15000
+#define CAMERA_PREVIEW_SIZE     320
+
+/* Where frames come from. capture() writes one encoded frame and
+   reports the file it ended up in. */
+class CameraSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CameraSource(QObject *parent = nullptr) : QObject(parent) {}
+    virtual void capture(const QString &fileName) = 0;
+    virtual void cancel() {}
+
+signals:
+    void captured(const QString &fileName);
+    void failed(const QString &error);
+};
+
+/* /bin/takepicture.sh, given the output file as its argument. Both
+   output files are removed first, a frame left from an earlier capture
+   is never reported as new. */
+class ScriptCameraSource : public CameraSource
+{
+    Q_OBJECT
+
+public:
+    ScriptCameraSource(JobRunner *jobs, QObject *parent = nullptr);
+    void capture(const QString &fileName) override;
+    void cancel() override;
+
+private slots:
+    void jobFinished(Job *job);
+
+private:
+    JobRunner *m_jobs;
+    QPointer<Job> m_job;
+    QString m_fileName;
+};
+
+/* Existing image file, for running without a camera
+   (SINM_CAMERA=file:<path>) */
+class FileCameraSource : public CameraSource
+{
+    Q_OBJECT
+
+public:
+    FileCameraSource(const QString &fileName, QObject *parent = nullptr);
+    void capture(const QString &fileName) override;
+
+private:
+    QString m_source;
+};
+
+/* Generated colour bars with a frame counter (SINM_CAMERA=pattern) */
+class PatternCameraSource : public CameraSource
+{
+    Q_OBJECT
+
+public:
+    explicit PatternCameraSource(QObject *parent = nullptr);
+    void capture(const QString &fileName) override;
+
+private:
+    int m_frame;
+};
+
+/*
+ * Picture capture. The frame is taken by a CameraSource into
+ * CAMERA_SHM_FILE and decoded twice on the ImageDecoder pool: a
+ * CAMERA_PREVIEW_SIZE preview that shows at once, and the display
+ * size image. Shutter to preview and shutter to full image times are
+ * logged for every capture.
+ */
+class Camera : public QObject
+{
+    Q_OBJECT
+
+public:
+    Camera(CameraSource *source, ImageDecoder *decoder, QObject *parent = nullptr);
+    /* Script source, or a stand-in picked by SINM_CAMERA */
+    static CameraSource *createSource(JobRunner *jobs, QObject *parent = nullptr);
+
+    bool isBusy() const { return m_busy; }
+    /* File of the last captured frame */
+    QString fileName() const { return m_fileName; }
+    void setDisplaySize(const QSize &size) { m_displaySize = size; }
+    qint64 lastPreviewMs() const { return m_previewMs; }
+    qint64 lastFullMs() const { return m_fullMs; }
+
+public slots:
+    void capture();
+    void cancel();
+
+signals:
+    void busyChanged(bool busy);
+    void preview(const QImage &image);
+    void captured(const QImage &image);
+    void failed(const QString &error);
+
+private slots:
+    void sourceCaptured(const QString &fileName);
+    void sourceFailed(const QString &error);
+    void imageDecoded(int id, const QImage &image);
+    void imageDecodeFailed(int id, const QString &error);
+
+private:
+    void setBusy(bool busy);
+
+    CameraSource *m_source;
+    ImageDecoder *m_decoder;
+    QSize m_displaySize;
+    bool m_busy;
+    QElapsedTimer m_shutter;
+    int m_previewId;
+    int m_fullId;
+    QString m_fileName;
+    qint64 m_previewMs;
+    qint64 m_fullMs;
+};
+
+#endif // CAMERA_H
@@ -0,0 +1,198 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#include "configloader.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/inotify.h>
+
+/* Editors and QSaveFile write in several steps, settle before reload */
+#define CONFIG_RELOAD_DELAY     200
+
+ConfigLoader::ConfigLoader(const QString &settingsFile, const QString &userPrefFile,
+                           const QString &uiElementsFile, const QString &wgFile,
+                           QObject *parent)
+    : QObject(parent)
+    , m_notify(nullptr)
+    , m_settingsFile(settingsFile)
+    , m_userPrefFile(userPrefFile)
+    , m_uiElementsFile(uiElementsFile)
+    , m_wgFile(wgFile)
+{
+    m_userPrefStore = new SettingsStore(m_userPrefFile, this);
+    m_uiPrefStore = new SettingsStore(m_uiElementsFile, this);
+    connect(m_userPrefStore, SIGNAL(valueChanged(QString)), this, SLOT(storeChanged()));
+    connect(m_uiPrefStore, SIGNAL(valueChanged(QString)), this, SLOT(storeChanged()));
+    m_snapshot = ConfigSnapshotPtr(parse(0));
+
+    m_reloadTimer.setSingleShot(true);
+    connect(&m_reloadTimer, SIGNAL(timeout()), this, SLOT(reloadChanged()));
+
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        qErrnoWarning(errno, "inotify_init1 failed, configuration hot reload disabled");
+        return;
+    }
+    watch(m_settingsFile);
+    watch(m_userPrefFile);
+    watch(m_uiElementsFile);
+    watch(m_wgFile);
+    m_notify = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+    connect(m_notify, SIGNAL(activated(int)), this, SLOT(readInotify()));
+}
+
+ConfigLoader::~ConfigLoader()
+{
+    if (m_inotifyFd >= 0)
+        close(m_inotifyFd);
+}
+
+ConfigSnapshotPtr ConfigLoader::snapshot() const
+{
+    return std::atomic_load(&m_snapshot);
+}
+
+/* Directories are watched, not files: atomic writers replace the file
+   with rename() and a file watch would be lost with the old inode. */
+void ConfigLoader::watch(const QString &file)
+{
+    QString dir = QFileInfo(file).absolutePath();
+    if (m_watchDirs.values().contains(dir))
+        return;
+    QByteArray path = QFile::encodeName(dir);
+    int wd = inotify_add_watch(m_inotifyFd, path.constData(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+        qErrnoWarning(errno, "inotify watch failed: %s", path.constData());
+        return;
+    }
+    m_watchDirs.insert(wd, dir);
+}
+
+void ConfigLoader::readInotify()
+{
+    /* Aligned as required for struct inotify_event */
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const QStringList files = { m_settingsFile, m_userPrefFile, m_uiElementsFile, m_wgFile };
+
+    for (;;) {
+        ssize_t len = read(m_inotifyFd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+        for (char *ptr = buf; ptr < buf + len; ) {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0)
+                continue;
+            QString path = m_watchDirs.value(event->wd) + "/" + QFile::decodeName(event->name);
+            if (files.contains(path) && !m_changedFiles.contains(path))
+                m_changedFiles.append(path);
+        }
+    }
+    if (!m_changedFiles.isEmpty())
+        m_reloadTimer.start(CONFIG_RELOAD_DELAY);
+}
+
+void ConfigLoader::reloadChanged()
+{
+    QStringList files = m_changedFiles;
+    m_changedFiles.clear();
+    /* Content the store already holds is our own write coming back */
+    if ( files.contains(m_userPrefFile) && !m_userPrefStore->reload() )
+        files.removeAll(m_userPrefFile);
+    if ( files.contains(m_uiElementsFile) && !m_uiPrefStore->reload() )
+        files.removeAll(m_uiElementsFile);
+    ConfigSnapshotPtr next(parse(snapshot()->generation + 1));
+    std::atomic_store(&m_snapshot, next);
+    if ( !files.isEmpty() )
+        emit changed(next, files);
+}
+
+/* Set from the UI: new snapshot, nothing to report */
+void ConfigLoader::storeChanged()
+{
+    if ( !m_reloadTimer.isActive() )
+        m_reloadTimer.start(CONFIG_RELOAD_DELAY);
+}
+
+void ConfigLoader::reload()
+{
+    m_changedFiles = QStringList({ m_settingsFile, m_userPrefFile, m_uiElementsFile, m_wgFile });
+    reloadChanged();
+}
+
+ConfigSnapshot *ConfigLoader::parse(quint64 generation) const
+{
+    ConfigSnapshot *config = new ConfigSnapshot;
+    config->generation = generation;
+
+    QSettings settings(m_settingsFile, QSettings::IniFormat);
+    config->myNodeId = settings.value("my_id").toString();
+    config->myNodeIp = settings.value("my_ip").toString();
+    config->myNodeName = settings.value("my_name").toString();
+    for (int x=0; x < NODECOUNT; x++ ) {
+        config->nodeName[x] = settings.value("node_name_"+QString::number(x), "").toString();
+        config->nodeIp[x] = settings.value("node_ip_"+QString::number(x), "").toString();
+        config->nodeId[x] = settings.value("node_id_"+QString::number(x), "").toString();
+        config->nodeOtpIp[x] = settings.value("node_otp_ip_"+QString::number(x), "").toString();
+    }
+    for (int x=0; x < CONNPOINTCOUNT; x++ ) {
+        config->connectionPointName[x] = settings.value("conn_point_name_"+QString::number(x), "").toString();
+    }
+    config->connectionProfile = settings.value("connection_profile","wan").toString();
+
+    /* Written by the UI too, read from the store */
+    const SettingsStore *userPref = m_userPrefStore;
+    config->volume = userPref->string("volume","70").toInt();
+    config->beepActive = userPref->string("beep") == "1";
+    config->pinCode = userPref->string("pincode","1234");
+    config->settingsPinCode = userPref->string("settings_pincode","4321");
+    config->autoerase = userPref->string("autoerase","true") != "false";
+    config->prewarm = userPref->string("prewarm","false") == "true";
+    config->prewarmPeers = userPref->string("prewarm_peers","2").toInt();
+    config->prewarmIdle = userPref->string("prewarm_idle","120").toInt();
+
+    const SettingsStore *uiElements = m_uiPrefStore;
+    config->messagingTitle = uiElements->string("message_title","Messaging:");
+    config->commCheckButton = uiElements->string("commcheck_button","COMM CHECK");
+    config->eraseButton = uiElements->string("erase_button","ERASE");
+    config->secureVoiceInactiveNotify = uiElements->string("voice_inactive_notify","SECURE VOICE INACTIVE");
+    config->secureVoiceActiveNotify = uiElements->string("voice_active_notify","SECURE VOICE ACTIVE");
+    config->goSecureButton = uiElements->string("go_secure_button","Go Secure");
+    config->terminateSecureButton = uiElements->string("terminate_secure_button","Terminate");
+    config->systemName = uiElements->string("system_name","CommUnit");
+    config->pinEntryTitleVault = uiElements->string("pintitle_vault","Enter vault PIN");
+    config->pinEntryTitleVaultChecking = uiElements->string("pintitle_vault_check","Checking...");
+    config->pinEntryTitleAccessPin = uiElements->string("pintitle_access","Set calibration data:");
+    config->cameraButtonVisible = uiElements->boolean("cam_enabled",false);
+    config->audioMixerOutputDevice = uiElements->string("audio_device","PCM");
+
+    QSettings wg(m_wgFile, QSettings::IniFormat);
+    config->gatewayEndpoint = wg.value("WireGuardPeer/Endpoint").toString();
+
+    return config;
+}
@@ -0,0 +1,140 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef CONFIGLOADER_H
+#define CONFIGLOADER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QTimer>
+#include <memory>
+#include "nodes.h"
+#include "settingsstore.h"
+
+/* All configuration files parsed into one immutable value */
+struct ConfigSnapshot
+{
+    /* sinm.ini */
+    QString myNodeId;
+    QString myNodeIp;
+    QString myNodeName;
+    QString nodeName[NODECOUNT];
+    QString nodeIp[NODECOUNT];
+    QString nodeId[NODECOUNT];
+    /* Peer's OTP tunnel address, empty: fixed by call role */
+    QString nodeOtpIp[NODECOUNT];
+    QString connectionPointName[CONNPOINTCOUNT];
+    QString connectionProfile;
+
+    /* userpreferences.ini */
+    int volume;
+    bool beepActive;
+    QString pinCode;
+    QString settingsPinCode;
+    bool autoerase;
+    bool prewarm;
+    int prewarmPeers;
+    int prewarmIdle;
+
+    /* userinterface.ini */
+    QString messagingTitle;
+    QString commCheckButton;
+    QString eraseButton;
+    QString secureVoiceInactiveNotify;
+    QString secureVoiceActiveNotify;
+    QString goSecureButton;
+    QString terminateSecureButton;
+    QString systemName;
+    QString pinEntryTitleVault;
+    QString pinEntryTitleVaultChecking;
+    QString pinEntryTitleAccessPin;
+    bool cameraButtonVisible;
+    QString audioMixerOutputDevice;
+
+    /* wg0.netdev */
+    QString gatewayEndpoint;
+
+    /* Increments on every reload */
+    quint64 generation;
+};
+
+typedef std::shared_ptr<const ConfigSnapshot> ConfigSnapshotPtr;
+
+/*
+ * Loads the configuration files into a ConfigSnapshot and reloads it
+ * when inotify reports one of them written or replaced. The current
+ * snapshot is swapped atomically, so snapshot() is safe from any thread
+ * and a reader keeps a consistent view for as long as it holds the
+ * pointer.
+ *
+ * userpreferences.ini and userinterface.ini are also written by the
+ * UI. Both are read and written only through the SettingsStore owned
+ * here: an external edit is merged under unsaved values, and the
+ * store's own write-behind is not reported as a change.
+ */
+class ConfigLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    ConfigLoader(const QString &settingsFile, const QString &userPrefFile,
+                 const QString &uiElementsFile, const QString &wgFile,
+                 QObject *parent = nullptr);
+    ~ConfigLoader();
+
+    ConfigSnapshotPtr snapshot() const;
+    SettingsStore *userPreferences() const { return m_userPrefStore; }
+    SettingsStore *uiPreferences() const { return m_uiPrefStore; }
+
+public slots:
+    void reload();
+
+signals:
+    /* Files that changed, by full path */
+    void changed(ConfigSnapshotPtr snapshot, const QStringList &files);
+
+private slots:
+    void readInotify();
+    void reloadChanged();
+    void storeChanged();
+
+private:
+    void watch(const QString &file);
+    ConfigSnapshot *parse(quint64 generation) const;
+
+    ConfigSnapshotPtr m_snapshot;
+    int m_inotifyFd;
+    QSocketNotifier *m_notify;
+    QHash<int, QString> m_watchDirs;
+    QString m_settingsFile;
+    QString m_userPrefFile;
+    QString m_uiElementsFile;
+    QString m_wgFile;
+    SettingsStore *m_userPrefStore;
+    SettingsStore *m_uiPrefStore;
+    QStringList m_changedFiles;
+    QTimer m_reloadTimer;
+};
+
+#endif // CONFIGLOADER_H
@@ -0,0 +1,181 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "gallery.h"
+#include "imagedecoder.h"
+#include <QDebug>
+
+Gallery::Gallery(ImageDecoder *decoder, QObject *parent)
+    : QObject(parent)
+    , m_decoder(decoder)
+    , m_bytes(0)
+    , m_nextId(1)
+    , m_thumbs(GALLERY_THUMB_BUDGET)
+    , m_views(GALLERY_VIEW_BUDGET)
+{
+    connect(m_decoder, SIGNAL(decoded(int,QImage)), this, SLOT(decoded(int,QImage)));
+    connect(m_decoder, SIGNAL(failed(int,QString)), this, SLOT(decodeFailed(int,QString)));
+}
+
+int Gallery::add(const QByteArray &data, Source source, const QImage &view)
+{
+    Entry entry;
+    entry.id = m_nextId++;
+    entry.source = source;
+    entry.time = QDateTime::currentDateTime();
+    entry.data = data;
+    m_entries.prepend(entry);
+    m_bytes += data.size();
+    if (!view.isNull())
+        m_views.insert(entry.id, new QImage(view), cost(view));
+    evict();
+    emit changed();
+    return entry.id;
+}
+
+QList<int> Gallery::ids() const
+{
+    QList<int> ids;
+    for (const Entry &entry : m_entries)
+        ids.append(entry.id);
+    return ids;
+}
+
+bool Gallery::contains(int id) const
+{
+    return entry(id) != nullptr;
+}
+
+Gallery::Source Gallery::source(int id) const
+{
+    const Entry *found = entry(id);
+    return found ? found->source : Received;
+}
+
+QDateTime Gallery::time(int id) const
+{
+    const Entry *found = entry(id);
+    return found ? found->time : QDateTime();
+}
+
+QByteArray Gallery::data(int id) const
+{
+    const Entry *found = entry(id);
+    return found ? found->data : QByteArray();
+}
+
+QImage Gallery::thumbnail(int id)
+{
+    if (QImage *image = m_thumbs.object(id))
+        return *image;
+    const Entry *found = entry(id);
+    if (found && !m_thumbRequests.values().contains(id)) {
+        int request = m_decoder->decodeData(found->data, QSize(GALLERY_THUMB_WIDTH, GALLERY_THUMB_HEIGHT));
+        m_thumbRequests.insert(request, id);
+    }
+    return QImage();
+}
+
+QImage Gallery::view(int id, const QSize &size)
+{
+    /* The picture label does not change size, a new one starts over */
+    if (m_viewSize.isValid() && size != m_viewSize) {
+        m_views.clear();
+        m_viewRequests.clear();
+    }
+    m_viewSize = size;
+    if (QImage *image = m_views.object(id))
+        return *image;
+    const Entry *found = entry(id);
+    if (found && !m_viewRequests.values().contains(id)) {
+        int request = m_decoder->decodeData(found->data, size, Qt::IgnoreAspectRatio);
+        m_viewRequests.insert(request, id);
+    }
+    return QImage();
+}
+
+/* Used by erase, decodes still running are dropped when they finish */
+void Gallery::clear()
+{
+    m_entries.clear();
+    m_bytes = 0;
+    m_thumbs.clear();
+    m_views.clear();
+    m_thumbRequests.clear();
+    m_viewRequests.clear();
+    emit changed();
+}
+
+void Gallery::decoded(int request, const QImage &image)
+{
+    if (m_thumbRequests.contains(request)) {
+        int id = m_thumbRequests.take(request);
+        if (!contains(id))
+            return;
+        m_thumbs.insert(id, new QImage(image), cost(image));
+        emit thumbnailReady(id, image);
+    } else if (m_viewRequests.contains(request)) {
+        int id = m_viewRequests.take(request);
+        if (!contains(id))
+            return;
+        m_views.insert(id, new QImage(image), cost(image));
+        emit viewReady(id, image);
+    }
+}
+
+void Gallery::decodeFailed(int request, const QString &error)
+{
+    if (m_thumbRequests.remove(request))
+        return;
+    if (m_viewRequests.contains(request)) {
+        int id = m_viewRequests.take(request);
+        qDebug() << "Gallery decode error:" << id << error;
+        emit viewFailed(id, error);
+    }
+}
+
+const Gallery::Entry *Gallery::entry(int id) const
+{
+    for (const Entry &entry : m_entries) {
+        if (entry.id == id)
+            return &entry;
+    }
+    return nullptr;
+}
+
+/* Oldest go first, the newest picture always stays */
+void Gallery::evict()
+{
+    while (m_entries.size() > 1
+           && (m_entries.size() > GALLERY_MAX_IMAGES || m_bytes > GALLERY_MAX_BYTES)) {
+        Entry oldest = m_entries.takeLast();
+        m_bytes -= oldest.data.size();
+        m_thumbs.remove(oldest.id);
+        m_views.remove(oldest.id);
+    }
+}
+
+int Gallery::cost(const QImage &image)
+{
+    return int(qMax<qint64>(1, image.sizeInBytes()));
+}
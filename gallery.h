@@ -0,0 +1,115 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef GALLERY_H
+#define GALLERY_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QCache>
+#include <QDateTime>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QSize>
+
+class ImageDecoder;
+
+#define GALLERY_MAX_IMAGES      24
+/* Encoded files as received or captured */
+#define GALLERY_MAX_BYTES       (48 * 1024 * 1024)
+/* Decoded images, ARGB32 at display size */
+#define GALLERY_THUMB_BUDGET    (2 * 1024 * 1024)
+#define GALLERY_VIEW_BUDGET     (24 * 1024 * 1024)
+#define GALLERY_THUMB_WIDTH     112
+#define GALLERY_THUMB_HEIGHT    84
+
+/*
+ * Recent pictures kept in RAM only, newest first. The encoded files
+ * are bounded by count and size; what is decoded from them lives in
+ * two LRU caches under fixed byte budgets, thumbnails and images at
+ * display size, so flipping between recent pictures does not decode
+ * again. Misses are decoded on ImageDecoder's threads and announced
+ * with thumbnailReady() and viewReady().
+ */
+class Gallery : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Source { Received, Captured };
+
+    explicit Gallery(ImageDecoder *decoder, QObject *parent = nullptr);
+
+    /* A decoded display size image, when the caller has one, is cached */
+    int add(const QByteArray &data, Source source, const QImage &view = QImage());
+    QList<int> ids() const;
+    bool contains(int id) const;
+    Source source(int id) const;
+    QDateTime time(int id) const;
+    /* Encoded file, empty once evicted */
+    QByteArray data(int id) const;
+
+    /* Cached image or null, a miss starts decoding */
+    QImage thumbnail(int id);
+    QImage view(int id, const QSize &size);
+
+public slots:
+    void clear();
+
+signals:
+    void changed();
+    void thumbnailReady(int id, const QImage &image);
+    void viewReady(int id, const QImage &image);
+    void viewFailed(int id, const QString &error);
+
+private slots:
+    void decoded(int request, const QImage &image);
+    void decodeFailed(int request, const QString &error);
+
+private:
+    struct Entry
+    {
+        int id;
+        Source source;
+        QDateTime time;
+        QByteArray data;
+    };
+
+    const Entry *entry(int id) const;
+    void evict();
+    static int cost(const QImage &image);
+
+    ImageDecoder *m_decoder;
+    QList<Entry> m_entries;
+    qint64 m_bytes;
+    int m_nextId;
+    QCache<int, QImage> m_thumbs;
+    QCache<int, QImage> m_views;
+    QSize m_viewSize;
+    /* Decoder request id to picture id */
+    QHash<int, int> m_thumbRequests;
+    QHash<int, int> m_viewRequests;
+};
+
+#endif // GALLERY_H
@@ -0,0 +1,160 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#include "gpioreader.h"
+#include <QDebug>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#define GPIO_READ_BATCH     64
+
+GpioReader::GpioReader(const QString &devicePath, QObject *parent)
+    : QObject(parent)
+    , m_notify(nullptr)
+    , m_dropUntilSync(false)
+{
+    QByteArray device = devicePath.toLocal8Bit();
+    m_fd = open(device.constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0) {
+        qErrnoWarning(errno, "Cannot open input device %s", device.constData());
+        return;
+    }
+    /* Kernel timestamps in monotonic time, comparable with clock_gettime() */
+    int clockId = CLOCK_MONOTONIC;
+    if (ioctl(m_fd, EVIOCSCLOCKID, &clockId) < 0) {
+        qErrnoWarning(errno, "EVIOCSCLOCKID failed on %s", device.constData());
+    }
+    m_pendingFrame.reserve(GPIO_READ_BATCH);
+    m_notify = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notify, SIGNAL(activated(int)), this, SLOT(readEvents()));
+}
+
+GpioReader::~GpioReader()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool GpioReader::isOpen() const
+{
+    return m_fd >= 0;
+}
+
+int GpioReader::fd() const
+{
+    return m_fd;
+}
+
+GpioReader::LatencyStats GpioReader::latencyStats() const
+{
+    return m_latency;
+}
+
+void GpioReader::resetLatencyStats()
+{
+    m_latency = LatencyStats();
+}
+
+/* Drain everything the kernel has queued. EAGAIN means we're done for
+   this wakeup, not an error. */
+void GpioReader::readEvents()
+{
+    struct input_event events[GPIO_READ_BATCH];
+    QVector<QVector<struct input_event>> frames;
+
+    for (;;) {
+        ssize_t len = read(m_fd, events, sizeof(events));
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            qErrnoWarning(errno, "GPIO input read error");
+            /* Device gone (ENODEV): stop polling instead of spinning */
+            m_notify->setEnabled(false);
+            break;
+        }
+        if (len == 0)
+            break;
+
+        int count = len / sizeof(struct input_event);
+        for (int i = 0; i < count; i++) {
+            const struct input_event &ev = events[i];
+            if (ev.type == EV_SYN && ev.code == SYN_DROPPED) {
+                /* Kernel buffer overrun: discard until next SYN_REPORT */
+                m_pendingFrame.clear();
+                m_dropUntilSync = true;
+                continue;
+            }
+            if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
+                if (!m_dropUntilSync && !m_pendingFrame.isEmpty())
+                    frames.append(m_pendingFrame);
+                m_pendingFrame.clear();
+                m_dropUntilSync = false;
+                continue;
+            }
+            if (!m_dropUntilSync)
+                m_pendingFrame.append(ev);
+        }
+        if (len < (ssize_t)sizeof(events))
+            break;
+    }
+
+    /* Dispatch after draining, handlers may re-enter the event loop */
+    for (const QVector<struct input_event> &frame : frames)
+        dispatchFrame(frame);
+}
+
+void GpioReader::dispatchFrame(const QVector<struct input_event> &frame)
+{
+    for (const struct input_event &ev : frame) {
+        if (ev.type != EV_KEY)
+            continue;
+        /* Auto-repeat (value 2) has no action on these keys */
+        if (ev.value == 2)
+            continue;
+        emit keyEvent(ev.code, ev.value);
+        qint64 timestamp = eventTimeUs(ev);
+        qint64 latency = monotonicNowUs() - timestamp;
+        m_latency.count++;
+        m_latency.lastUs = latency;
+        m_latency.totalUs += latency;
+        if (latency > m_latency.maxUs)
+            m_latency.maxUs = latency;
+        emit keyHandled(ev.code, ev.value, timestamp, latency);
+    }
+}
+
+qint64 GpioReader::eventTimeUs(const struct input_event &event)
+{
+    return (qint64)event.input_event_sec * 1000000 + event.input_event_usec;
+}
+
+qint64 GpioReader::monotonicNowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (qint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
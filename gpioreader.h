@@ -0,0 +1,83 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef GPIOREADER_H
+#define GPIOREADER_H
+
+#include <QObject>
+#include <QSocketNotifier>
+#include <QVector>
+#include <linux/input.h>
+
+/*
+ * Non-blocking evdev reader for reTerminal GPIO keys.
+ *
+ * Every notifier activation drains all queued events from the device,
+ * groups them into EV_SYN frames and emits one keyEvent() per EV_KEY
+ * in a completed frame. Kernel timestamps are taken from CLOCK_MONOTONIC
+ * so that time from key press to handled can be measured.
+ */
+class GpioReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct LatencyStats
+    {
+        quint64 count = 0;
+        qint64 lastUs = 0;
+        qint64 maxUs = 0;
+        qint64 totalUs = 0;
+    };
+
+    explicit GpioReader(const QString &devicePath, QObject *parent = nullptr);
+    ~GpioReader();
+
+    bool isOpen() const;
+    int fd() const;
+    LatencyStats latencyStats() const;
+    void resetLatencyStats();
+    static qint64 monotonicNowUs();
+
+signals:
+    /* Emitted for each EV_KEY of a completed frame. Latency is recorded
+       when the (directly connected) receivers return. */
+    void keyEvent(int code, int value);
+    /* Emitted after keyEvent() receivers returned. Timestamp is the
+       kernel CLOCK_MONOTONIC time of the event in microseconds. */
+    void keyHandled(int code, int value, qint64 timestampUs, qint64 latencyUs);
+
+private slots:
+    void readEvents();
+
+private:
+    void dispatchFrame(const QVector<struct input_event> &frame);
+    static qint64 eventTimeUs(const struct input_event &event);
+
+    int m_fd;
+    QSocketNotifier *m_notify;
+    QVector<struct input_event> m_pendingFrame;
+    bool m_dropUntilSync;
+    LatencyStats m_latency;
+};
+
+#endif // GPIOREADER_H
@@ -0,0 +1,119 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "imagedecoder.h"
+#include <QBuffer>
+#include <QImageReader>
+#include <QRunnable>
+
+/* One request, runs on the pool */
+class DecodeTask : public QRunnable
+{
+public:
+    DecodeTask(ImageDecoder *decoder, int id, const QString &fileName, const QByteArray &data,
+               const QSize &targetSize, Qt::AspectRatioMode mode)
+        : m_decoder(decoder)
+        , m_id(id)
+        , m_fileName(fileName)
+        , m_data(data)
+        , m_targetSize(targetSize)
+        , m_mode(mode)
+    {
+    }
+
+    void run() override
+    {
+        QBuffer buffer(&m_data);
+        QImageReader reader;
+        if (m_fileName.isEmpty()) {
+            buffer.open(QIODevice::ReadOnly);
+            reader.setDevice(&buffer);
+        } else {
+            reader.setFileName(m_fileName);
+        }
+        /* Camera JPEGs carry their orientation in EXIF. The scaled
+           size applies before the rotation, fit the rotated picture
+           and turn the result back. */
+        reader.setAutoTransform(true);
+        bool rotated = reader.transformation() & QImageIOHandler::TransformationRotate90;
+        QSize size = reader.size();
+        if (rotated)
+            size.transpose();
+        if (size.isValid() && m_targetSize.isValid()
+                && (size.width() > m_targetSize.width() || size.height() > m_targetSize.height())) {
+            QSize scaled = size.scaled(m_targetSize, m_mode);
+            if (rotated)
+                scaled.transpose();
+            reader.setScaledSize(scaled);
+        }
+        QImage image = reader.read();
+        m_decoder->finish(m_id, image, image.isNull() ? reader.errorString() : QString());
+    }
+
+private:
+    ImageDecoder *m_decoder;
+    int m_id;
+    QString m_fileName;
+    QByteArray m_data;
+    QSize m_targetSize;
+    Qt::AspectRatioMode m_mode;
+};
+
+ImageDecoder::ImageDecoder(QObject *parent)
+    : QObject(parent)
+    , m_nextId(1)
+{
+    m_pool.setMaxThreadCount(IMAGE_DECODE_THREADS);
+}
+
+/* Tasks call back into this object, let them finish first */
+ImageDecoder::~ImageDecoder()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+int ImageDecoder::decodeFile(const QString &fileName, const QSize &targetSize, Qt::AspectRatioMode mode)
+{
+    int id = m_nextId++;
+    m_pool.start(new DecodeTask(this, id, fileName, QByteArray(), targetSize, mode));
+    return id;
+}
+
+int ImageDecoder::decodeData(const QByteArray &data, const QSize &targetSize, Qt::AspectRatioMode mode)
+{
+    int id = m_nextId++;
+    m_pool.start(new DecodeTask(this, id, QString(), data, targetSize, mode));
+    return id;
+}
+
+/* Called on a pool thread, signals are emitted on the GUI thread */
+void ImageDecoder::finish(int id, const QImage &image, const QString &error)
+{
+    QMetaObject::invokeMethod(this, [this, id, image, error]() {
+        if (image.isNull())
+            emit failed(id, error);
+        else
+            emit decoded(id, image);
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,67 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QThreadPool>
+
+#define IMAGE_DECODE_THREADS    2
+
+/*
+ * Decodes images on a small thread pool, straight to the size they
+ * are shown at: QImageReader::setScaledSize() lets the JPEG decoder
+ * skip work and never holds the full resolution frame. Each request
+ * gets an id, returned with decoded() or failed() on the GUI thread;
+ * callers drop results of requests they no longer want.
+ */
+class ImageDecoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImageDecoder(QObject *parent = nullptr);
+    ~ImageDecoder();
+
+    int decodeFile(const QString &fileName, const QSize &targetSize,
+                   Qt::AspectRatioMode mode = Qt::KeepAspectRatio);
+    int decodeData(const QByteArray &data, const QSize &targetSize,
+                   Qt::AspectRatioMode mode = Qt::KeepAspectRatio);
+
+signals:
+    void decoded(int id, const QImage &image);
+    void failed(int id, const QString &error);
+
+private:
+    friend class DecodeTask;
+    void finish(int id, const QImage &image, const QString &error);
+
+    QThreadPool m_pool;
+    int m_nextId;
+};
+
+#endif // IMAGEDECODER_H
@@ -0,0 +1,431 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "imagedelta.h"
+#include <QBitArray>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <string.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static QByteArray sha256(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+/* Full resolution, one pixel layout for every comparison and paste */
+static QImage decodeFull(const QByteArray &data)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+    reader.setAutoTransform(true);
+    QImage image = reader.read();
+    if (image.isNull())
+        return image;
+    return image.convertToFormat(QImage::Format_RGB32);
+}
+
+static QByteArray encodeJpeg(const QImage &image, int quality)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "JPEG", quality);
+    return data;
+}
+
+/* Sum of absolute byte differences over one tile. A tile row is at
+   most DELTA_TILE_SIZE * 4 bytes, 16 bit lanes cannot overflow. */
+static quint32 tileSad(const QImage &a, const QImage &b, int x, int y, int width, int height)
+{
+    const int bytes = width * 4;
+    quint32 sum = 0;
+#if defined(__ARM_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (int row = 0; row < height; row++) {
+        const uchar *pa = a.constScanLine(y + row) + x * 4;
+        const uchar *pb = b.constScanLine(y + row) + x * 4;
+        int i = 0;
+        for (; i + 16 <= bytes; i += 16)
+            acc = vpadalq_u8(acc, vabdq_u8(vld1q_u8(pa + i), vld1q_u8(pb + i)));
+        for (; i < bytes; i++)
+            sum += qAbs(int(pa[i]) - int(pb[i]));
+    }
+    uint64x2_t wide = vpaddlq_u32(vpaddlq_u16(acc));
+    sum += quint32(vgetq_lane_u64(wide, 0) + vgetq_lane_u64(wide, 1));
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (int row = 0; row < height; row++) {
+        const uchar *pa = a.constScanLine(y + row) + x * 4;
+        const uchar *pb = b.constScanLine(y + row) + x * 4;
+        int i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i *)(pa + i));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(pb + i));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+        }
+        for (; i < bytes; i++)
+            sum += qAbs(int(pa[i]) - int(pb[i]));
+    }
+    sum += quint32(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#else
+    for (int row = 0; row < height; row++) {
+        const uchar *pa = a.constScanLine(y + row) + x * 4;
+        const uchar *pb = b.constScanLine(y + row) + x * 4;
+        for (int i = 0; i < bytes; i++)
+            sum += qAbs(int(pa[i]) - int(pb[i]));
+    }
+#endif
+    return sum;
+}
+
+static void copyTile(QImage &to, int toX, int toY, const QImage &from, int fromX, int fromY,
+                     int width, int height)
+{
+    for (int row = 0; row < height; row++)
+        memcpy(to.scanLine(toY + row) + toX * 4, from.constScanLine(fromY + row) + fromX * 4, width * 4);
+}
+
+/* Changed tiles go to the mosaic in order, DELTA_MOSAIC_COLUMNS a row */
+static void pasteMosaic(QImage &target, const QImage &mosaic, const QBitArray &changed)
+{
+    const int columns = (target.width() + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+    int slot = 0;
+    for (int tile = 0; tile < changed.size(); tile++) {
+        if (!changed.testBit(tile))
+            continue;
+        int x = (tile % columns) * DELTA_TILE_SIZE;
+        int y = (tile / columns) * DELTA_TILE_SIZE;
+        copyTile(target, x, y, mosaic,
+                 (slot % DELTA_MOSAIC_COLUMNS) * DELTA_TILE_SIZE, (slot / DELTA_MOSAIC_COLUMNS) * DELTA_TILE_SIZE,
+                 qMin(DELTA_TILE_SIZE, target.width() - x), qMin(DELTA_TILE_SIZE, target.height() - y));
+        slot++;
+    }
+}
+
+/* Delta of image against base, result is what the peer will rebuild */
+static QByteArray makeDelta(const QByteArray &baseId, const QImage &base, const QImage &image, QImage *result)
+{
+    const int columns = (image.width() + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+    const int rows = (image.height() + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+    QBitArray changed(columns * rows);
+    int count = 0;
+    for (int tile = 0; tile < changed.size(); tile++) {
+        int x = (tile % columns) * DELTA_TILE_SIZE;
+        int y = (tile / columns) * DELTA_TILE_SIZE;
+        int width = qMin(DELTA_TILE_SIZE, image.width() - x);
+        int height = qMin(DELTA_TILE_SIZE, image.height() - y);
+        if (tileSad(base, image, x, y, width, height) > quint32(DELTA_TILE_THRESHOLD * width * height * 4)) {
+            changed.setBit(tile);
+            count++;
+        }
+    }
+
+    QByteArray patch;
+    *result = base;
+    if (count > 0) {
+        /* Tiles sit on JPEG block boundaries, they do not bleed */
+        QImage mosaic(qMin(count, DELTA_MOSAIC_COLUMNS) * DELTA_TILE_SIZE,
+                      ((count + DELTA_MOSAIC_COLUMNS - 1) / DELTA_MOSAIC_COLUMNS) * DELTA_TILE_SIZE,
+                      QImage::Format_RGB32);
+        mosaic.fill(Qt::black);
+        int slot = 0;
+        for (int tile = 0; tile < changed.size(); tile++) {
+            if (!changed.testBit(tile))
+                continue;
+            int x = (tile % columns) * DELTA_TILE_SIZE;
+            int y = (tile / columns) * DELTA_TILE_SIZE;
+            copyTile(mosaic, (slot % DELTA_MOSAIC_COLUMNS) * DELTA_TILE_SIZE,
+                     (slot / DELTA_MOSAIC_COLUMNS) * DELTA_TILE_SIZE, image, x, y,
+                     qMin(DELTA_TILE_SIZE, image.width() - x), qMin(DELTA_TILE_SIZE, image.height() - y));
+            slot++;
+        }
+        patch = encodeJpeg(mosaic, DELTA_JPEG_QUALITY);
+        /* Paste what the peer decodes, not what we had */
+        QImage decoded = decodeFull(patch);
+        if (decoded.size() != mosaic.size())
+            return QByteArray();
+        pasteMosaic(*result, decoded, changed);
+    }
+
+    QByteArray data(DELTA_MAGIC);
+    QDataStream out(&data, QIODevice::WriteOnly | QIODevice::Append);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << baseId << qint32(image.width()) << qint32(image.height()) << qint32(DELTA_TILE_SIZE)
+        << changed << patch;
+    return data;
+}
+
+static QImage applyDelta(const QByteArray &baseId, const QImage &base, const QByteArray &data, QString *error)
+{
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_12);
+    in.skipRawData(int(strlen(DELTA_MAGIC)));
+    QByteArray id;
+    qint32 width, height, tileSize;
+    QBitArray changed;
+    QByteArray patch;
+    in >> id >> width >> height >> tileSize >> changed >> patch;
+    if (in.status() != QDataStream::Ok || tileSize != DELTA_TILE_SIZE) {
+        *error = "bad delta";
+        return QImage();
+    }
+    if (id != baseId || base.size() != QSize(width, height)) {
+        *error = "missing reference picture";
+        return QImage();
+    }
+    const int tiles = ((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+    const int count = changed.count(true);
+    QImage result = base;
+    if (changed.size() != tiles) {
+        *error = "bad delta";
+        return QImage();
+    }
+    if (count > 0) {
+        QImage mosaic = decodeFull(patch);
+        if (mosaic.width() < qMin(count, DELTA_MOSAIC_COLUMNS) * tileSize
+                || mosaic.height() < ((count + DELTA_MOSAIC_COLUMNS - 1) / DELTA_MOSAIC_COLUMNS) * tileSize) {
+            *error = "bad delta mosaic";
+            return QImage();
+        }
+        pasteMosaic(result, mosaic, changed);
+    }
+    return result;
+}
+
+class DeltaTask : public QRunnable
+{
+public:
+    enum Mode { Encode, Decode, Keep };
+
+    DeltaTask(ImageDelta *delta, Mode mode, const QString &peer, quint64 generation, const QByteArray &data)
+        : m_delta(delta)
+        , m_mode(mode)
+        , m_peer(peer)
+        , m_generation(generation)
+        , m_data(data)
+    {
+    }
+
+    void run() override
+    {
+        switch (m_mode) {
+        case Encode:
+            encode();
+            break;
+        case Decode:
+            decode();
+            break;
+        case Keep:
+            m_delta->setReceived(m_peer, m_generation, { sha256(m_data), decodeFull(m_data) });
+            break;
+        }
+    }
+
+private:
+    void encode()
+    {
+        QImage image = decodeFull(m_data);
+        if (image.isNull()) {
+            m_delta->finishEncode(m_peer, m_generation, m_data, true);
+            return;
+        }
+        ImageDelta::Reference base = m_delta->sentReference(m_peer);
+        QByteArray delta;
+        QImage result;
+        if (!base.image.isNull() && base.image.size() == image.size())
+            delta = makeDelta(base.id, base.image, image, &result);
+        if (delta.isEmpty() || qint64(delta.size()) * 100 > qint64(m_data.size()) * DELTA_MAX_PERCENT) {
+            m_delta->setPending(m_peer, m_generation, { sha256(m_data), image });
+            m_delta->finishEncode(m_peer, m_generation, m_data, true);
+        } else {
+            m_delta->setPending(m_peer, m_generation, { sha256(delta), result });
+            m_delta->finishEncode(m_peer, m_generation, delta, false);
+        }
+    }
+
+    void decode()
+    {
+        ImageDelta::Reference base = m_delta->receivedReference(m_peer);
+        QString error;
+        QImage image = applyDelta(base.id, base.image, m_data, &error);
+        if (image.isNull()) {
+            m_delta->finishDecode(m_peer, m_generation, QByteArray(), error);
+            return;
+        }
+        m_delta->setReceived(m_peer, m_generation, { sha256(m_data), image });
+        m_delta->finishDecode(m_peer, m_generation, encodeJpeg(image, DELTA_OUTPUT_QUALITY), QString());
+    }
+
+    ImageDelta *m_delta;
+    Mode m_mode;
+    QString m_peer;
+    quint64 m_generation;
+    QByteArray m_data;
+};
+
+ImageDelta::ImageDelta(QObject *parent)
+    : QObject(parent)
+    , m_generation(0)
+{
+    /* One thread keeps the tasks in order */
+    m_pool.setMaxThreadCount(1);
+}
+
+/* Tasks call back into this object, let them finish first */
+ImageDelta::~ImageDelta()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+bool ImageDelta::isDelta(const QByteArray &data)
+{
+    return data.startsWith(DELTA_MAGIC);
+}
+
+void ImageDelta::start(int mode, const QString &peer, const QByteArray &data)
+{
+    QMutexLocker locker(&m_lock);
+    m_pool.start(new DeltaTask(this, DeltaTask::Mode(mode), peer, m_peers[peer].generation, data));
+}
+
+void ImageDelta::encode(const QString &peer, const QByteArray &file)
+{
+    start(DeltaTask::Encode, peer, file);
+}
+
+void ImageDelta::commitSent(const QString &peer)
+{
+    QMutexLocker locker(&m_lock);
+    Peer &state = m_peers[peer];
+    if (!state.pending.image.isNull())
+        state.sent = state.pending;
+    state.pending = Reference();
+}
+
+/* The peer lost or never had the reference, start over with a key frame */
+void ImageDelta::dropSent(const QString &peer)
+{
+    QMutexLocker locker(&m_lock);
+    Peer &state = m_peers[peer];
+    state.sent = Reference();
+    state.pending = Reference();
+}
+
+void ImageDelta::decode(const QString &peer, const QByteArray &data)
+{
+    start(DeltaTask::Decode, peer, data);
+}
+
+void ImageDelta::keepReceived(const QString &peer, const QByteArray &file)
+{
+    start(DeltaTask::Keep, peer, file);
+}
+
+/* Results of the peer's tasks still running are dropped */
+void ImageDelta::reset(const QString &peer)
+{
+    QMutexLocker locker(&m_lock);
+    Peer state;
+    state.generation = ++m_generation;
+    m_peers.insert(peer, state);
+}
+
+void ImageDelta::clear()
+{
+    QMutexLocker locker(&m_lock);
+    for (auto it = m_peers.begin(); it != m_peers.end(); ++it) {
+        Peer state;
+        state.generation = ++m_generation;
+        it.value() = state;
+    }
+}
+
+bool ImageDelta::isCurrent(const QString &peer, quint64 generation) const
+{
+    QMutexLocker locker(&m_lock);
+    return m_peers.value(peer).generation == generation;
+}
+
+ImageDelta::Reference ImageDelta::sentReference(const QString &peer)
+{
+    QMutexLocker locker(&m_lock);
+    return m_peers.value(peer).sent;
+}
+
+ImageDelta::Reference ImageDelta::receivedReference(const QString &peer)
+{
+    QMutexLocker locker(&m_lock);
+    return m_peers.value(peer).received;
+}
+
+void ImageDelta::setPending(const QString &peer, quint64 generation, const Reference &reference)
+{
+    QMutexLocker locker(&m_lock);
+    Peer &state = m_peers[peer];
+    if (generation == state.generation)
+        state.pending = reference;
+}
+
+void ImageDelta::setReceived(const QString &peer, quint64 generation, const Reference &reference)
+{
+    QMutexLocker locker(&m_lock);
+    Peer &state = m_peers[peer];
+    if (generation == state.generation)
+        state.received = reference;
+}
+
+/* Called on the pool thread, signals are emitted on the GUI thread */
+void ImageDelta::finishEncode(const QString &peer, quint64 generation, const QByteArray &data, bool keyframe)
+{
+    QMetaObject::invokeMethod(this, [this, peer, generation, data, keyframe]() {
+        if (isCurrent(peer, generation))
+            emit encoded(peer, data, keyframe);
+    }, Qt::QueuedConnection);
+}
+
+void ImageDelta::finishDecode(const QString &peer, quint64 generation, const QByteArray &file, const QString &error)
+{
+    QMetaObject::invokeMethod(this, [this, peer, generation, file, error]() {
+        if (!isCurrent(peer, generation))
+            return;
+        if (file.isEmpty()) {
+            qDebug() << "Picture delta error:" << peer << error;
+            emit decodeFailed(peer, error);
+        } else {
+            emit decoded(peer, file);
+        }
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,123 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef IMAGEDELTA_H
+#define IMAGEDELTA_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QThreadPool>
+
+#define DELTA_MAGIC             "SINMDLT1"
+#define DELTA_TILE_SIZE         16
+/* Mean absolute difference per colour byte before a tile is resent */
+#define DELTA_TILE_THRESHOLD    6
+#define DELTA_JPEG_QUALITY      85
+#define DELTA_MOSAIC_COLUMNS    64
+/* A delta larger than this share of the key frame is not worth it */
+#define DELTA_MAX_PERCENT       50
+/* Reconstructed pictures handed to the gallery */
+#define DELTA_OUTPUT_QUALITY    90
+
+/*
+ * Picture codec for repeated shots of the same scene. A picture is
+ * compared tile by tile, without motion search, against the last one
+ * the peer is known to hold; only changed tiles are sent, packed into
+ * one JPEG mosaic. Both ends paste the same decoded mosaic into the
+ * same reference, so their references stay identical. When there is
+ * no reference, the size changed or the delta is not much smaller,
+ * the original file goes as a key frame. References are kept per
+ * peer, by its OTP ip, so calls side by side each have their own.
+ *
+ * Work runs in order on one thread of its own. The sender's reference
+ * only moves on commitSent(), once the peer has the picture. A peer
+ * that cannot rebuild a delta asks for a key frame; dropSent() makes
+ * the next picture go as one.
+ */
+class ImageDelta : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImageDelta(QObject *parent = nullptr);
+    ~ImageDelta();
+
+    static bool isDelta(const QByteArray &data);
+
+    void encode(const QString &peer, const QByteArray &file);
+    void commitSent(const QString &peer);
+    void dropSent(const QString &peer);
+    void decode(const QString &peer, const QByteArray &data);
+    /* A key frame or plain picture from the peer becomes the reference */
+    void keepReceived(const QString &peer, const QByteArray &file);
+
+public slots:
+    /* A peer starts over with key frames, e.g. on a new call */
+    void reset(const QString &peer);
+    /* Erase: every peer's references, next pictures go as key frames */
+    void clear();
+
+signals:
+    void encoded(const QString &peer, const QByteArray &data, bool keyframe);
+    void decoded(const QString &peer, const QByteArray &file);
+    void decodeFailed(const QString &peer, const QString &error);
+
+private:
+    friend class DeltaTask;
+
+    struct Reference
+    {
+        QByteArray id;
+        QImage image;
+    };
+
+    /* A reset gives the peer a new generation, older results are dropped */
+    struct Peer
+    {
+        Peer() : generation(0) {}
+
+        quint64 generation;
+        Reference sent;
+        Reference pending;
+        Reference received;
+    };
+
+    void start(int mode, const QString &peer, const QByteArray &data);
+    bool isCurrent(const QString &peer, quint64 generation) const;
+    Reference sentReference(const QString &peer);
+    Reference receivedReference(const QString &peer);
+    void setPending(const QString &peer, quint64 generation, const Reference &reference);
+    void setReceived(const QString &peer, quint64 generation, const Reference &reference);
+    void finishEncode(const QString &peer, quint64 generation, const QByteArray &data, bool keyframe);
+    void finishDecode(const QString &peer, quint64 generation, const QByteArray &file, const QString &error);
+
+    QThreadPool m_pool;
+    mutable QMutex m_lock;
+    quint64 m_generation;
+    QHash<QString, Peer> m_peers;
+};
+
+#endif // IMAGEDELTA_H
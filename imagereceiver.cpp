@@ -0,0 +1,172 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "imagereceiver.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/inotify.h>
+
+ImageReceiver::ImageReceiver(const QString &fileName, QObject *parent)
+    : QObject(parent)
+    , m_fileName(fileName)
+    , m_dir(QFileInfo(fileName).absolutePath())
+    , m_name(QFileInfo(fileName).fileName())
+    , m_notify(nullptr)
+    , m_receiving(false)
+    , m_previewSize(0)
+{
+    connect(&m_progressTimer, SIGNAL(timeout()), this, SLOT(updateProgress()));
+
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        qErrnoWarning(errno, "inotify_init1 failed, incoming images not followed");
+        return;
+    }
+    m_notify = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+    connect(m_notify, SIGNAL(activated(int)), this, SLOT(readInotify()));
+    addWatch();
+}
+
+ImageReceiver::~ImageReceiver()
+{
+    if (m_inotifyFd >= 0)
+        close(m_inotifyFd);
+}
+
+/* The FTP server may create the directory after we start */
+void ImageReceiver::addWatch()
+{
+    QByteArray path = QFile::encodeName(m_dir);
+    int wd = inotify_add_watch(m_inotifyFd, path.constData(),
+                               IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+        qErrnoWarning(errno, "inotify watch failed: %s", path.constData());
+        QTimer::singleShot(IMAGE_WATCH_RETRY, this, SLOT(addWatch()));
+    }
+}
+
+void ImageReceiver::readInotify()
+{
+    /* Aligned as required for struct inotify_event */
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t len = read(m_inotifyFd, buf, sizeof(buf));
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+        for (char *ptr = buf; ptr < buf + len; ) {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0 || QFile::decodeName(event->name) != m_name)
+                continue;
+            if (event->mask & IN_MOVED_TO)
+                complete(true);
+            else if (event->mask & IN_CLOSE_WRITE)
+                complete(false);
+            else if (!m_receiving)
+                begin();
+        }
+    }
+}
+
+void ImageReceiver::begin()
+{
+    m_receiving = true;
+    m_data.clear();
+    m_previewSize = 0;
+    m_file.close();
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        qDebug() << "Incoming image open error:" << m_fileName << m_file.errorString();
+    m_clock.start();
+    m_lastPreview.start();
+    m_progressTimer.start(IMAGE_PROGRESS_INTERVAL);
+    emit started();
+}
+
+/* Appends what the writer has added since the last read. A file
+   truncated and rewritten starts over. */
+void ImageReceiver::readMore()
+{
+    if (!m_file.isOpen())
+        return;
+    if (m_file.size() < m_data.size()) {
+        m_data.clear();
+        m_file.seek(0);
+    }
+    m_data.append(m_file.readAll());
+}
+
+void ImageReceiver::updateProgress()
+{
+    readMore();
+    qint64 elapsed = qMax<qint64>(1, m_clock.elapsed());
+    emit progress(m_data.size(), m_data.size() * 1000 / elapsed);
+
+    qint64 next = qMax<qint64>(IMAGE_PREVIEW_MIN_SIZE,
+                               m_previewSize + m_previewSize * IMAGE_PREVIEW_GROWTH / 100);
+    if (m_data.size() >= next && m_lastPreview.elapsed() >= IMAGE_PREVIEW_INTERVAL) {
+        m_previewSize = m_data.size();
+        m_lastPreview.start();
+        emit preview(m_data);
+    }
+}
+
+void ImageReceiver::complete(bool replaced)
+{
+    /* A rename brings in a different inode, read it from the start */
+    if (replaced || !m_receiving) {
+        m_file.close();
+        m_file.setFileName(m_fileName);
+        m_data.clear();
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            qDebug() << "Incoming image open error:" << m_fileName << m_file.errorString();
+            /* The next write starts a new transfer */
+            m_progressTimer.stop();
+            m_receiving = false;
+            m_data.clear();
+            return;
+        }
+        if (!m_receiving) {
+            m_clock.start();
+            emit started();
+        }
+    }
+    readMore();
+    m_file.close();
+    m_progressTimer.stop();
+    m_receiving = false;
+    /* Opened for writing and closed without data */
+    if (m_data.isEmpty())
+        return;
+
+    qint64 elapsed = qMax<qint64>(1, m_clock.elapsed());
+    emit progress(m_data.size(), m_data.size() * 1000 / elapsed);
+    QByteArray data = m_data;
+    m_data.clear();
+    emit received(data);
+}
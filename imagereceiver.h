@@ -0,0 +1,94 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef IMAGERECEIVER_H
+#define IMAGERECEIVER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#define IMAGE_PROGRESS_INTERVAL     250
+#define IMAGE_PREVIEW_INTERVAL      500
+#define IMAGE_PREVIEW_GROWTH        50      /* percent since the last preview */
+#define IMAGE_PREVIEW_MIN_SIZE      4096
+#define IMAGE_WATCH_RETRY           5000
+
+/*
+ * Follows an image file written by the FTP server through inotify on
+ * its directory. Writes to the file start a transfer, reported with
+ * progress() and with preview() carrying the bytes so far. The
+ * transfer is complete when the writer closes the file
+ * (IN_CLOSE_WRITE) or a finished file is renamed over it (IN_MOVED_TO);
+ * only then is received() emitted with the whole file. Decoding is
+ * left to ImageDecoder.
+ *
+ * Qt's image handlers can't suspend on a short read, they pad the
+ * missing data and finish, so every preview decodes from the start.
+ * Previews are only sent once the data has grown by a fixed share,
+ * which keeps the total decode work linear in the file size.
+ */
+class ImageReceiver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImageReceiver(const QString &fileName, QObject *parent = nullptr);
+    ~ImageReceiver();
+
+    bool isReceiving() const { return m_receiving; }
+
+signals:
+    void started();
+    void progress(qint64 bytes, qint64 bytesPerSecond);
+    /* Partially received file, decodes with the lower part missing */
+    void preview(const QByteArray &data);
+    void received(const QByteArray &data);
+
+private slots:
+    void addWatch();
+    void readInotify();
+    void updateProgress();
+
+private:
+    void begin();
+    void complete(bool replaced);
+    void readMore();
+
+    QString m_fileName;
+    QString m_dir;
+    QString m_name;
+    int m_inotifyFd;
+    QSocketNotifier *m_notify;
+    QTimer m_progressTimer;
+    QFile m_file;
+    QByteArray m_data;
+    bool m_receiving;
+    QElapsedTimer m_clock;
+    QElapsedTimer m_lastPreview;
+    qint64 m_previewSize;
+};
+
+#endif // IMAGERECEIVER_H
@@ -0,0 +1,355 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#include "inputrecorder.h"
+#include "gpioreader.h"
+#include <QApplication>
+#include <QDebug>
+#include <QDir>
+#include <QMap>
+#include <QSet>
+#include <QMouseEvent>
+#include <QKeyEvent>
+#include <QWindow>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+#define UINPUT_PATH             "/dev/uinput"
+#define UINPUT_DEVICE_NAME      "sinm-replay"
+#define SYSFS_VIRTUAL_INPUT     "/sys/devices/virtual/input/"
+#define REPLAY_SETTLE_TIME      1000
+
+/* Recorder */
+
+InputRecorder::InputRecorder(const QString &fileName, QObject *parent)
+    : QObject(parent)
+    , m_file(fileName)
+    , m_window(nullptr)
+    , m_startUs(GpioReader::monotonicNowUs())
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qDebug() << "Input recorder open error:" << m_file.errorString();
+        return;
+    }
+    m_out.setDevice(&m_file);
+}
+
+InputRecorder::~InputRecorder()
+{
+    m_out.flush();
+    m_file.close();
+}
+
+void InputRecorder::attach(QWidget *window, GpioReader *gpioReader)
+{
+    m_window = window;
+    m_startUs = GpioReader::monotonicNowUs();
+    if (gpioReader)
+        connect(gpioReader, SIGNAL(keyHandled(int,int,qint64,qint64)),
+                this, SLOT(gpioKeyHandled(int,int,qint64,qint64)));
+    qApp->installEventFilter(this);
+}
+
+qint64 InputRecorder::elapsedMs() const
+{
+    return (GpioReader::monotonicNowUs() - m_startUs) / 1000;
+}
+
+void InputRecorder::gpioKeyHandled(int code, int value, qint64 timestampUs, qint64 latencyUs)
+{
+    Q_UNUSED(latencyUs);
+    /* Kernel timestamp, not the time we got to handle it */
+    m_out << (timestampUs - m_startUs) / 1000 << " gpio " << code << " " << value << Qt::endl;
+}
+
+/* Record only what is delivered to the top level window, child widget
+   deliveries are derived from those by Qt. */
+bool InputRecorder::eventFilter(QObject *watched, QEvent *event)
+{
+    if (!m_window || !m_file.isOpen() || watched != m_window->windowHandle())
+        return false;
+
+    switch (event->type()) {
+        case QEvent::MouseButtonPress:
+        case QEvent::MouseButtonRelease:
+        case QEvent::MouseMove:
+        {
+            QMouseEvent *me = static_cast<QMouseEvent *>(event);
+            QString kind = "move";
+            if (event->type() == QEvent::MouseButtonPress)
+                kind = "press";
+            if (event->type() == QEvent::MouseButtonRelease)
+                kind = "release";
+            m_out << elapsedMs() << " mouse " << kind << " "
+                  << me->pos().x() << " " << me->pos().y() << " "
+                  << (int)me->button() << " " << (int)me->buttons() << Qt::endl;
+            break;
+        }
+        case QEvent::KeyPress:
+        case QEvent::KeyRelease:
+        {
+            QKeyEvent *ke = static_cast<QKeyEvent *>(event);
+            QString kind = event->type() == QEvent::KeyPress ? "press" : "release";
+            QString text = ke->text().toUtf8().toHex();
+            if (text.isEmpty())
+                text = "-";
+            m_out << elapsedMs() << " key " << kind << " " << ke->key() << " "
+                  << (int)ke->modifiers() << " " << text << Qt::endl;
+            break;
+        }
+        default:
+            break;
+    }
+    return false;
+}
+
+/* Replayer */
+
+InputReplayer::InputReplayer(const QString &fileName, QObject *parent)
+    : QObject(parent)
+    , m_fileName(fileName)
+    , m_next(0)
+    , m_uinputFd(-1)
+    , m_window(nullptr)
+    , m_startUs(0)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(playNext()));
+    load();
+}
+
+InputReplayer::~InputReplayer()
+{
+    if (m_uinputFd >= 0) {
+        ioctl(m_uinputFd, UI_DEV_DESTROY);
+        close(m_uinputFd);
+    }
+}
+
+bool InputReplayer::load()
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "Input replay open error:" << file.errorString();
+        return false;
+    }
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QStringList fields = in.readLine().split(' ', Qt::SkipEmptyParts);
+        if (fields.size() < 3)
+            continue;
+        ReplayEvent event;
+        event.timeMs = fields.takeFirst().toLongLong();
+        event.fields = fields;
+        m_events.append(event);
+    }
+    file.close();
+    qDebug() << "Input replay:" << m_events.size() << "events from" << m_fileName;
+    return true;
+}
+
+/* Recorded GPIO keys are replayed through a uinput device, so the kernel
+   evdev path and GpioReader are exercised exactly as with real keys. */
+bool InputReplayer::createVirtualDevice()
+{
+    QSet<int> codes;
+    for (const ReplayEvent &event : m_events) {
+        if (event.fields.at(0) == "gpio")
+            codes.insert(event.fields.value(1).toInt());
+    }
+    if (codes.isEmpty())
+        return true;
+
+    m_uinputFd = open(UINPUT_PATH, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (m_uinputFd < 0) {
+        qErrnoWarning(errno, "Cannot open %s, GPIO events will not be replayed", UINPUT_PATH);
+        return false;
+    }
+    ioctl(m_uinputFd, UI_SET_EVBIT, EV_KEY);
+    for (int code : codes)
+        ioctl(m_uinputFd, UI_SET_KEYBIT, code);
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    strncpy(setup.name, UINPUT_DEVICE_NAME, UINPUT_MAX_NAME_SIZE - 1);
+    if (ioctl(m_uinputFd, UI_DEV_SETUP, &setup) < 0 || ioctl(m_uinputFd, UI_DEV_CREATE) < 0) {
+        qErrnoWarning(errno, "uinput device setup failed");
+        close(m_uinputFd);
+        m_uinputFd = -1;
+        return false;
+    }
+
+    /* Resolve /dev/input/eventN of the new device */
+    char sysName[64] = { 0 };
+    if (ioctl(m_uinputFd, UI_GET_SYSNAME(sizeof(sysName)), sysName) < 0) {
+        qErrnoWarning(errno, "UI_GET_SYSNAME failed");
+        return false;
+    }
+    QDir sysDir(QString(SYSFS_VIRTUAL_INPUT) + sysName);
+    QStringList eventNodes = sysDir.entryList({"event*"}, QDir::Dirs);
+    if (eventNodes.isEmpty()) {
+        qDebug() << "Input replay: no event node under" << sysDir.path();
+        return false;
+    }
+    QString devicePath = "/dev/input/" + eventNodes.first();
+    /* devtmpfs creates the node asynchronously */
+    for (int retry = 0; retry < 50 && !QFile::exists(devicePath); retry++)
+        usleep(20000);
+    qputenv("SINM_GPIO_INPUT", devicePath.toLocal8Bit());
+    qDebug() << "Input replay: GPIO keys via" << devicePath;
+    return true;
+}
+
+void InputReplayer::start(QWidget *window, GpioReader *gpioReader)
+{
+    m_window = window;
+    if (gpioReader)
+        connect(gpioReader, SIGNAL(keyHandled(int,int,qint64,qint64)),
+                this, SLOT(gpioKeyHandled(int,int,qint64,qint64)));
+    m_startUs = GpioReader::monotonicNowUs();
+    m_next = 0;
+    m_timer.start(0);
+}
+
+void InputReplayer::playNext()
+{
+    qint64 nowMs = (GpioReader::monotonicNowUs() - m_startUs) / 1000;
+    while (m_next < m_events.size() && m_events.at(m_next).timeMs <= nowMs) {
+        const QStringList &fields = m_events.at(m_next).fields;
+        if (fields.at(0) == "gpio")
+            injectGpio(fields.value(1).toInt(), fields.value(2).toInt());
+        if (fields.at(0) == "mouse")
+            injectMouse(fields);
+        if (fields.at(0) == "key")
+            injectKey(fields);
+        m_next++;
+    }
+    if (m_next < m_events.size()) {
+        m_timer.start(m_events.at(m_next).timeMs - nowMs);
+    } else {
+        /* Let last GPIO events pass through the kernel and reader */
+        QTimer::singleShot(REPLAY_SETTLE_TIME, this, SLOT(finish()));
+    }
+}
+
+void InputReplayer::injectGpio(int code, int value)
+{
+    if (m_uinputFd < 0)
+        return;
+    struct input_event events[2];
+    memset(events, 0, sizeof(events));
+    events[0].type = EV_KEY;
+    events[0].code = code;
+    events[0].value = value;
+    events[1].type = EV_SYN;
+    events[1].code = SYN_REPORT;
+    if (write(m_uinputFd, events, sizeof(events)) != sizeof(events))
+        qErrnoWarning(errno, "uinput write failed");
+}
+
+/* Latency of the whole GUI side: sendEvent() returns after the widget
+   and any slot connected to it has run. */
+void InputReplayer::injectMouse(const QStringList &fields)
+{
+    QWindow *window = m_window->windowHandle();
+    if (!window || fields.size() < 6)
+        return;
+    QEvent::Type type = QEvent::MouseMove;
+    if (fields.at(1) == "press")
+        type = QEvent::MouseButtonPress;
+    if (fields.at(1) == "release")
+        type = QEvent::MouseButtonRelease;
+    QPointF pos(fields.at(2).toInt(), fields.at(3).toInt());
+    QMouseEvent event(type, pos, pos, window->mapToGlobal(pos.toPoint()),
+                      (Qt::MouseButton)fields.at(4).toInt(),
+                      (Qt::MouseButtons)fields.at(5).toInt(), Qt::NoModifier);
+    qint64 startUs = GpioReader::monotonicNowUs();
+    QCoreApplication::sendEvent(window, &event);
+    m_samples.append({ "mouse " + fields.at(1), GpioReader::monotonicNowUs() - startUs });
+}
+
+void InputReplayer::injectKey(const QStringList &fields)
+{
+    QWindow *window = m_window->windowHandle();
+    if (!window || fields.size() < 5)
+        return;
+    QEvent::Type type = fields.at(1) == "press" ? QEvent::KeyPress : QEvent::KeyRelease;
+    QString text;
+    if (fields.at(4) != "-")
+        text = QString::fromUtf8(QByteArray::fromHex(fields.at(4).toLatin1()));
+    QKeyEvent event(type, fields.at(2).toInt(), (Qt::KeyboardModifiers)fields.at(3).toInt(), text);
+    qint64 startUs = GpioReader::monotonicNowUs();
+    QCoreApplication::sendEvent(window, &event);
+    m_samples.append({ "key " + fields.at(1), GpioReader::monotonicNowUs() - startUs });
+}
+
+void InputReplayer::gpioKeyHandled(int code, int value, qint64 timestampUs, qint64 latencyUs)
+{
+    Q_UNUSED(timestampUs);
+    m_samples.append({ "gpio " + QString::number(code) + " " + QString::number(value), latencyUs });
+}
+
+void InputReplayer::finish()
+{
+    report();
+    QCoreApplication::quit();
+}
+
+/* Per-event latencies followed by summary per event kind */
+void InputReplayer::report()
+{
+    QFile reportFile(m_fileName + ".report");
+    if (!reportFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qDebug() << "Input replay report error:" << reportFile.errorString();
+        return;
+    }
+    QTextStream out(&reportFile);
+    QMap<QString, QVector<qint64>> kinds;
+    for (const LatencySample &sample : m_samples) {
+        out << sample.what << " " << sample.latencyUs << " us" << Qt::endl;
+        kinds[sample.what.section(' ', 0, 0)].append(sample.latencyUs);
+    }
+    out << Qt::endl;
+    for (auto it = kinds.begin(); it != kinds.end(); ++it) {
+        QVector<qint64> values = it.value();
+        std::sort(values.begin(), values.end());
+        qint64 total = 0;
+        for (qint64 value : values)
+            total += value;
+        QString line = QString("%1: count %2 mean %3 us p50 %4 us p95 %5 us max %6 us")
+                .arg(it.key())
+                .arg(values.size())
+                .arg(total / values.size())
+                .arg(values.at(values.size() / 2))
+                .arg(values.at((values.size() * 95) / 100))
+                .arg(values.last());
+        out << line << Qt::endl;
+        qDebug().noquote() << "Input replay" << line;
+    }
+    reportFile.close();
+}
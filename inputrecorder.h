@@ -0,0 +1,115 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef INPUTRECORDER_H
+#define INPUTRECORDER_H
+
+#include <QObject>
+#include <QFile>
+#include <QTextStream>
+#include <QVector>
+#include <QTimer>
+#include <QWidget>
+
+class GpioReader;
+
+/*
+ * Session recording format, one event per line:
+ *
+ *   <ms> gpio <code> <value>
+ *   <ms> mouse <press|release|move> <x> <y> <button> <buttons>
+ *   <ms> key <press|release> <key> <modifiers> <text-hex>
+ *
+ * <ms> is time since the start of recording. Mouse positions are
+ * window-local. Touch input is recorded through the mouse events Qt
+ * synthesizes from it.
+ */
+
+class InputRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    InputRecorder(const QString &fileName, QObject *parent = nullptr);
+    ~InputRecorder();
+    void attach(QWidget *window, GpioReader *gpioReader);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void gpioKeyHandled(int code, int value, qint64 timestampUs, qint64 latencyUs);
+
+private:
+    qint64 elapsedMs() const;
+
+    QFile m_file;
+    QTextStream m_out;
+    QWidget *m_window;
+    qint64 m_startUs;
+};
+
+class InputReplayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    InputReplayer(const QString &fileName, QObject *parent = nullptr);
+    ~InputReplayer();
+    /* Create uinput device for recorded GPIO keys. Must be called before
+       MainWindow is constructed, sets SINM_GPIO_INPUT for it. */
+    bool createVirtualDevice();
+    void start(QWidget *window, GpioReader *gpioReader);
+
+private slots:
+    void playNext();
+    void gpioKeyHandled(int code, int value, qint64 timestampUs, qint64 latencyUs);
+    void finish();
+
+private:
+    struct ReplayEvent
+    {
+        qint64 timeMs;
+        QStringList fields;
+    };
+    struct LatencySample
+    {
+        QString what;
+        qint64 latencyUs;
+    };
+    bool load();
+    void injectGpio(int code, int value);
+    void injectMouse(const QStringList &fields);
+    void injectKey(const QStringList &fields);
+    void report();
+
+    QString m_fileName;
+    QVector<ReplayEvent> m_events;
+    QVector<LatencySample> m_samples;
+    int m_next;
+    int m_uinputFd;
+    QWidget *m_window;
+    qint64 m_startUs;
+    QTimer m_timer;
+};
+
+#endif // INPUTRECORDER_H
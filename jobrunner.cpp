@@ -0,0 +1,211 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "jobrunner.h"
+#include <QDebug>
+#include <QFileInfo>
+
+/* Job */
+
+Job::Job(const QString &program, const QStringList &arguments, int timeoutMs, JobRunner *runner)
+    : QObject(runner)
+    , m_runner(runner)
+    , m_program(program)
+    , m_arguments(arguments)
+    , m_timeoutMs(timeoutMs)
+    , m_status(Queued)
+    , m_exitCode(-1)
+    , m_durationMs(0)
+    , m_completed(false)
+    , m_process(nullptr)
+{
+    m_timeoutTimer.setSingleShot(true);
+    connect(&m_timeoutTimer, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+bool Job::succeeded() const
+{
+    return m_status == Finished && m_exitCode == 0;
+}
+
+void Job::run()
+{
+    m_status = Running;
+    m_clock.start();
+    m_process = new SpawnedProcess(this);
+    m_process->setProgram(m_program);
+    m_process->setArguments(m_arguments);
+    m_process->setStandardErrorFile(QProcess::nullDevice());
+    connect(m_process, SIGNAL(readyReadStandardOutput()), this, SLOT(readOutput()));
+    connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)),
+            this, SLOT(processFinished(int,QProcess::ExitStatus)));
+    connect(m_process, SIGNAL(errorOccurred(QProcess::ProcessError)),
+            this, SLOT(processError(QProcess::ProcessError)));
+    if (m_timeoutMs > 0)
+        m_timeoutTimer.start(m_timeoutMs);
+    m_process->start();
+}
+
+void Job::readOutput()
+{
+    QByteArray data = m_process->readAllStandardOutput();
+    if (data.isEmpty())
+        return;
+    m_output.append(data);
+    emit output(data);
+}
+
+void Job::processFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    readOutput();
+    m_exitCode = exitCode;
+    /* A timed out or cancelled job is being stopped, keep that status */
+    if (m_status != Running)
+        complete(m_status);
+    else
+        complete(exitStatus == QProcess::NormalExit ? Finished : Failed);
+}
+
+void Job::processError(QProcess::ProcessError error)
+{
+    /* Crashes and kills are reported by finished() as well */
+    if (error == QProcess::FailedToStart) {
+        qDebug() << "Job failed to start:" << m_program << m_process->errorString();
+        complete(Failed);
+    }
+}
+
+void Job::timeout()
+{
+    qDebug() << "Job timed out after" << m_timeoutMs << "ms:" << m_program << m_arguments;
+    stop(TimedOut);
+}
+
+void Job::cancel()
+{
+    if (m_status == Queued)
+        complete(Cancelled);
+    else if (m_status == Running)
+        stop(Cancelled);
+}
+
+/* SIGTERM first, SIGKILL if still running after JOB_KILL_GRACE */
+void Job::stop(Status status)
+{
+    m_status = status;
+    m_timeoutTimer.stop();
+    m_process->terminate();
+    QTimer::singleShot(JOB_KILL_GRACE, this, SLOT(kill()));
+}
+
+void Job::kill()
+{
+    if (m_process->state() != QProcess::NotRunning)
+        m_process->kill();
+}
+
+void Job::complete(Status status)
+{
+    if (m_completed)
+        return;
+    m_completed = true;
+    m_status = status;
+    m_timeoutTimer.stop();
+    m_durationMs = m_process ? m_clock.elapsed() : 0;
+    if (m_process)
+        m_process->disconnect(this);
+    m_runner->jobFinished(this);
+    emit finished(this);
+    deleteLater();
+}
+
+/* JobRunner */
+
+JobRunner::JobRunner(int maxConcurrent, QObject *parent)
+    : QObject(parent)
+    , m_maxConcurrent(maxConcurrent)
+    , m_running(0)
+{
+}
+
+/* Jobs are children and deleted with the runner, without finishing */
+JobRunner::~JobRunner()
+{
+    for (Job *job : qAsConst(m_jobs)) {
+        if (job->m_process) {
+            job->m_process->disconnect(job);
+            job->m_process->kill();
+        }
+    }
+}
+
+Job *JobRunner::start(const QString &program, const QStringList &arguments, int timeoutMs)
+{
+    Job *job = new Job(program, arguments, timeoutMs, this);
+    m_jobs.append(job);
+    m_queue.enqueue(job);
+    /* Let the caller connect before anything can finish */
+    QTimer::singleShot(0, this, [this]() { startQueued(); });
+    return job;
+}
+
+void JobRunner::startQueued()
+{
+    while (m_running < m_maxConcurrent && !m_queue.isEmpty()) {
+        Job *job = m_queue.dequeue();
+        m_running++;
+        job->run();
+    }
+}
+
+void JobRunner::cancelAll()
+{
+    const QList<Job *> jobs = m_jobs;
+    for (Job *job : jobs)
+        job->cancel();
+}
+
+void JobRunner::jobFinished(Job *job)
+{
+    m_jobs.removeOne(job);
+    if (m_queue.removeOne(job)) {
+        return;
+    }
+    m_running--;
+
+    QString name = QFileInfo(job->program()).fileName();
+    Stats &stats = m_stats[name];
+    stats.count++;
+    stats.lastMs = job->durationMs();
+    stats.maxMs = qMax(stats.maxMs, job->durationMs());
+    stats.totalMs += job->durationMs();
+    if (job->durationMs() > JOB_SLOW_THRESHOLD)
+        qDebug() << "Slow job:" << name << job->durationMs() << "ms" << job->status();
+
+    QTimer::singleShot(0, this, [this]() { startQueued(); });
+}
+
+JobRunner::Stats JobRunner::stats(const QString &program) const
+{
+    return m_stats.value(QFileInfo(program).fileName());
+}
@@ -0,0 +1,142 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef JOBRUNNER_H
+#define JOBRUNNER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QQueue>
+#include <QHash>
+#include "spawner.h"
+
+#define JOB_DEFAULT_TIMEOUT     10000
+#define JOB_MAX_CONCURRENT      2
+#define JOB_KILL_GRACE          1000
+#define JOB_SLOW_THRESHOLD      2000
+
+class JobRunner;
+
+/*
+ * One external command run by JobRunner. Emits output() as stdout
+ * arrives and finished() exactly once; the job is deleted after
+ * finished() returns, keep a QPointer to hold on to it.
+ */
+class Job : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Status { Queued, Running, Finished, Failed, TimedOut, Cancelled };
+    Q_ENUM(Status)
+
+    QString program() const { return m_program; }
+    QStringList arguments() const { return m_arguments; }
+    Status status() const { return m_status; }
+    /* True when the command ran to completion with exit code 0 */
+    bool succeeded() const;
+    int exitCode() const { return m_exitCode; }
+    QByteArray output() const { return m_output; }
+    qint64 durationMs() const { return m_durationMs; }
+
+public slots:
+    void cancel();
+
+signals:
+    void output(const QByteArray &data);
+    void finished(Job *job);
+
+private slots:
+    void readOutput();
+    void processFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void processError(QProcess::ProcessError error);
+    void timeout();
+    void kill();
+
+private:
+    friend class JobRunner;
+    Job(const QString &program, const QStringList &arguments, int timeoutMs, JobRunner *runner);
+
+    void run();
+    void stop(Status status);
+    void complete(Status status);
+
+    JobRunner *m_runner;
+    QString m_program;
+    QStringList m_arguments;
+    int m_timeoutMs;
+    Status m_status;
+    int m_exitCode;
+    QByteArray m_output;
+    qint64 m_durationMs;
+    bool m_completed;
+    SpawnedProcess *m_process;
+    QElapsedTimer m_clock;
+    QTimer m_timeoutTimer;
+};
+
+/*
+ * Runs external commands asynchronously: at most maxConcurrent at a
+ * time, the rest queued in start order. Each job has a timeout after
+ * which it is terminated (and killed if it won't exit). Durations are
+ * kept per program, slow jobs are logged.
+ */
+class JobRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        quint64 count = 0;
+        qint64 lastMs = 0;
+        qint64 maxMs = 0;
+        qint64 totalMs = 0;
+    };
+
+    explicit JobRunner(int maxConcurrent = JOB_MAX_CONCURRENT, QObject *parent = nullptr);
+    ~JobRunner();
+
+    Job *start(const QString &program, const QStringList &arguments = QStringList(),
+               int timeoutMs = JOB_DEFAULT_TIMEOUT);
+    Stats stats(const QString &program) const;
+    QHash<QString, Stats> allStats() const { return m_stats; }
+
+public slots:
+    void cancelAll();
+
+private:
+    friend class Job;
+    void jobFinished(Job *job);
+    void startQueued();
+
+    int m_maxConcurrent;
+    int m_running;
+    QQueue<Job *> m_queue;
+    QList<Job *> m_jobs;
+    QHash<QString, Stats> m_stats;
+};
+
+#endif // JOBRUNNER_H
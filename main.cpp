@@ -21,11 +21,16 @@
  */
 
 #include "mainwindow.h"
+#include "inputrecorder.h"
+#include "spawner.h"
+#include "startuptrace.h"
 #include <QApplication>
 #include <QDebug>
+#include <QFile>
 
 int main(int argc, char *argv[])
 {
+    StartupTrace::begin();
     qputenv("QT_QPA_FONTDIR", "/usr/share/fonts/dejavu/");
     qputenv("QT_QPA_EGLFS_ROTATION", "-90");
     qputenv("QT_ASSUME_STDERR_HAS_CONSOLE", "1");
@@ -34,24 +39,44 @@ int main(int argc, char *argv[])
     a.setOrganizationDomain("rd");
     a.setApplicationName("sinm");
     a.setOverrideCursor(Qt::BlankCursor);
+    StartupTrace::mark("QApplication");
 
+    /* Helper spawn latency, QProcess vs posix_spawn, then exit */
+    int spawnIterations = qEnvironmentVariableIntValue("SINM_SPAWN_BENCHMARK");
+    if ( spawnIterations > 0 ) {
+        QString report = SpawnedProcess::benchmark(SPAWN_BENCHMARK_PROGRAM, spawnIterations);
+        for (const QString &line : report.split('\n'))
+            qDebug().noquote() << line;
+        QFile file(SPAWN_BENCHMARK_FILE);
+        if ( file.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+            file.write(report.toUtf8() + "\n");
+        return 0;
+    }
+
+    int startMode = UI_MODE;
     QStringList args = a.arguments();
-    if (args.count() == 2)
-    {
-        if ( args.at(1).contains("vault") )
-        {
-            MainWindow w(VAULT_MODE);
-            w.show();
-            return a.exec();
-        } else {
-            MainWindow w(UI_MODE);
-            w.show();
-            return a.exec();
-        }
-    } else {
-        MainWindow w(UI_MODE);
-        w.show();
-        return a.exec();
+    if (args.count() == 2 && args.at(1).contains("vault"))
+        startMode = VAULT_MODE;
+
+    /* Input session record & replay (benchmarking). Replay is typically
+       run with QT_QPA_PLATFORM=offscreen. */
+    QString recordFile = qEnvironmentVariable("SINM_RECORD_INPUT");
+    QString replayFile = qEnvironmentVariable("SINM_REPLAY_INPUT");
+    InputReplayer *replayer = nullptr;
+    if ( !replayFile.isEmpty() ) {
+        replayer = new InputReplayer(replayFile, &a);
+        replayer->createVirtualDevice();
+    }
+
+    MainWindow w(startMode);
+    w.show();
+    StartupTrace::mark("show");
+
+    if ( replayer ) {
+        replayer->start(&w, w.gpioReader());
+    } else if ( !recordFile.isEmpty() ) {
+        InputRecorder *recorder = new InputRecorder(recordFile, &a);
+        recorder->attach(&w, w.gpioReader());
     }
     return a.exec();
 }
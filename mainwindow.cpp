@@ -30,11 +30,17 @@
 #include <QThread>
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "ui_settingsframe.h"
+#include "ui_imageframe.h"
+#include "startuptrace.h"
+#include "camera.h"
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include <linux/input.h>
 #include <QLocale>
 #include <QMessageBox>
+#include <QAbstractItemView>
 
 #define NODECOUNT               6
 #define CONNPOINTCOUNT          3
@@ -49,8 +55,13 @@
 #define WG_CONFIGURATION_FILE   "/etc/systemd/network/wg0.netdev"
 #define WG_CONFIGURATION_FILE_S "/opt/tunnel/network-configurations/wg0.netdev"
 #define IMAGE_TRANSFERRED_FILE  "/tmp/ftp/incoming/image.png"
-#define CAMERA_PIC_FILE         "/tmp/image.png"
+/* Encoded picture on its way to the peer */
+#define PICTURE_SEND_FILE       "/dev/shm/sinm-send.bin"
+/* sendpicture.sh, for peers without the transfer service */
+#define SEND_PICTURE_TIMEOUT    120000
 #define BLACK_OUT_TIME          300000
+#define BACKLIGHT_FADE_IN_TIME  250
+#define BACKLIGHT_FADE_OUT_TIME 600
 #define MESSAGE_RECEIVE_FIFO    "/tmp/message_fifo_out"
 #define INDICATE_ONLY           0
 #define LOG_ONLY                1
@@ -58,8 +69,7 @@
 #define TX_KEY_PRESENTAGE       "/tmp/tx-key-presentage"
 #define RX_KEY_PRESENTAGE       "/tmp/rx-key-presentage"
 #define SUBSTITUTE_CHAR_CODE    24
-#define FIFO_TIMEOUT            1
-#define FIFO_REPLY_RECEIVED     0
+#define GPIO_KEY_POWER          142
 
 /* Global fifoIn file handle */
 QFile fifoIn(TELEMETRY_FIFO_OUT);
@@ -70,9 +80,15 @@ QFile rxKeyFifoIn(RX_KEY_PRESENTAGE);
 MainWindow::MainWindow(int argumentValue, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , m_firstFrameShown(false)
+    , m_startupPending(0)
+    , m_settingsUi(nullptr)
+    , m_settingsFrame(nullptr)
+    , m_imageUi(nullptr)
+    , m_imageFrame(nullptr)
+    , m_gpioReader(nullptr)
 {
     ui->setupUi(this);
-    ui->settingsFrame->setVisible(0);
     ui->inComingFrame->setVisible(0);
     ui->route1Selected->setVisible(0);
     ui->route2Selected->setVisible(0);
@@ -84,7 +100,6 @@ MainWindow::MainWindow(int argumentValue, QWidget *parent)
     ui->contact5Selected->setVisible(0);
     ui->contact6Selected->setVisible(0);
     ui->countLabel->setVisible(0);
-    ui->imageFrame->setVisible(0);
     ui->pinButton_pwr->setVisible(false);
     ui->pwrButton->setVisible(false);
 
@@ -96,6 +111,84 @@ MainWindow::MainWindow(int argumentValue, QWidget *parent)
 
     /* Set version string */
     ui->versionLabel->setText("v0.21");
+    StartupTrace::mark("setupUi");
+
+    /* Backlight */
+    m_backlight = new Backlight(BACKLIGHT_PATH, this);
+
+    /* Buzzer */
+    m_buzzer = new Buzzer(BUZZER_PATH, this);
+
+    /* Configuration snapshot, reloaded when files change */
+    m_configLoader = new ConfigLoader(SETTINGS_INI_FILE, USER_PREF_INI_FILE,
+                                      UI_ELEMENTS_INI_FILE, WG_CONFIGURATION_FILE, this);
+    connect(m_configLoader, SIGNAL(changed(ConfigSnapshotPtr,QStringList)),
+            this, SLOT(configChanged(ConfigSnapshotPtr,QStringList)));
+
+    /* User editable preferences, written behind by the loader's stores */
+    m_userPrefStore = m_configLoader->userPreferences();
+    m_uiPrefStore = m_configLoader->uiPreferences();
+
+    /* Audio mixer */
+    m_mixer = new Mixer(Mixer::createBackend(), this);
+
+    /* External scripts */
+    m_jobs = new JobRunner(JOB_MAX_CONCURRENT, this);
+
+    /* Pictures */
+    m_imageDecoder = new ImageDecoder(this);
+    m_camera = new Camera(Camera::createSource(m_jobs, this), m_imageDecoder, this);
+    connect(m_camera, SIGNAL(busyChanged(bool)), this, SLOT(cameraBusyChanged(bool)));
+    connect(m_camera, SIGNAL(preview(QImage)), this, SLOT(cameraPreview(QImage)));
+    connect(m_camera, SIGNAL(captured(QImage)), this, SLOT(cameraCaptured(QImage)));
+    connect(m_camera, SIGNAL(failed(QString)), this, SLOT(cameraFailed(QString)));
+    m_transferSender = new TransferSender(this);
+    connect(m_transferSender, SIGNAL(progress(qint64,qint64,qint64)), this, SLOT(pictureSendProgress(qint64,qint64,qint64)));
+    connect(m_transferSender, SIGNAL(finished()), this, SLOT(pictureSent()));
+    connect(m_transferSender, SIGNAL(failed(QString)), this, SLOT(pictureSendFailed(QString)));
+    m_imageDelta = new ImageDelta(this);
+    m_pictureSending = false;
+    connect(m_imageDelta, SIGNAL(encoded(QString,QByteArray,bool)), this, SLOT(pictureEncoded(QString,QByteArray,bool)));
+    connect(m_imageDelta, SIGNAL(decoded(QString,QByteArray)), this, SLOT(incomingDeltaDecoded(QString,QByteArray)));
+    connect(m_imageDelta, SIGNAL(decodeFailed(QString,QString)), this, SLOT(incomingDeltaFailed(QString,QString)));
+    m_imageDecodeId = 0;
+    m_imagePreviewId = 0;
+    connect(m_imageDecoder, SIGNAL(decoded(int,QImage)), this, SLOT(imageDecoded(int,QImage)));
+    connect(m_imageDecoder, SIGNAL(failed(int,QString)), this, SLOT(imageDecodeFailed(int,QString)));
+    m_gallery = new Gallery(m_imageDecoder, this);
+    m_galleryShownId = 0;
+    connect(m_gallery, SIGNAL(changed()), this, SLOT(galleryChanged()));
+    connect(m_gallery, SIGNAL(thumbnailReady(int,QImage)), this, SLOT(galleryThumbnailReady(int,QImage)));
+    connect(m_gallery, SIGNAL(viewReady(int,QImage)), this, SLOT(galleryViewReady(int,QImage)));
+    connect(m_gallery, SIGNAL(viewFailed(int,QString)), this, SLOT(galleryViewFailed(int,QString)));
+
+    /* Voice messages */
+    m_voiceRecorder = new VoiceRecorder(this);
+    m_voicePlayer = new VoicePlayer(this);
+    m_voice = new VoiceMessenger(this);
+    connect(m_voiceRecorder, SIGNAL(recorded(QByteArray,int)), this, SLOT(voiceRecorded(QByteArray,int)));
+    connect(m_voiceRecorder, SIGNAL(failed(QString)), this, SLOT(voiceFailed(QString)));
+    connect(m_voice, SIGNAL(message(QString,QString)), this, SLOT(voiceMessageOut(QString,QString)));
+    connect(m_voice, SIGNAL(received(QString,int,int)), this, SLOT(voiceReceived(QString,int,int)));
+    connect(m_voice, SIGNAL(failed(QString,QString)), this, SLOT(voiceReceiveFailed(QString,QString)));
+
+    /* connect-with services */
+    m_serviceControl = ServiceControl::create(this);
+    m_telemetry = new TelemetryQueue(this);
+    connect(m_telemetry, SIGNAL(command(QString)), this, SLOT(fifoWrite(QString)));
+    m_call = freeSession();
+    m_prewarm = new CallPrewarm(m_serviceControl, this);
+    connect(m_prewarm, SIGNAL(command(QString)), this, SLOT(fifoWrite(QString)));
+
+    /* Wi-Fi */
+    m_wifi = WifiControl::create(this);
+    m_wifiScanner = new WifiScanner(m_wifi, this);
+    connect(m_wifiScanner, SIGNAL(updated()), this, SLOT(wifiNetworksUpdated()));
+    connect(m_wifi, SIGNAL(stateChanged(QString,QString)), this, SLOT(wifiStateChanged(QString,QString)));
+    connect(m_wifi, SIGNAL(connected(QString)), this, SLOT(wifiConnected(QString)));
+    connect(m_wifi, SIGNAL(connectFailed(QString,QString)), this, SLOT(wifiConnectFailed(QString,QString)));
+    connect(m_wifi, SIGNAL(networkForgotten(QString)), this, SLOT(wifiNetworkForgotten(QString)));
+    StartupTrace::mark("configuration");
 
     if ( argumentValue == VAULT_MODE ) {
         m_startMode = VAULT_MODE;
@@ -106,9 +199,10 @@ MainWindow::MainWindow(int argumentValue, QWidget *parent)
         backLightOn = true;
         ui->codeFrame->setVisible(true);
         ui->logoLabel->setVisible(true);
-        ui->settingsFrame->setVisible(false);
         ui->codeValue->setText("");
         ui->pinEntryTitle->setText(uiElement.pinEntryTitleVault);
+        m_startupPending = 1;
+        StartupTrace::mark("preferences");
         // After PIN -> program should exit
     } else {
 
@@ -119,28 +213,10 @@ MainWindow::MainWindow(int argumentValue, QWidget *parent)
         loadUserPreferences();
         loadUserInterfacePreferences();
 
-        /* Watcher */
-        QFileSystemWatcher *watcher = new QFileSystemWatcher();
-        watcher->addPath(TELEMETRY_FIFO_OUT);
-        QObject::connect(watcher, SIGNAL(fileChanged(QString)), this, SLOT(fifoChanged(QString)));
-
+        /* FIFOs are opened non-blocking, the daemon may not be up yet */
         fifoWrite("127.0.0.1,daemon_ping");
-
-        /* Incoming telemetry FIFO */
-        if(!fifoIn.open(QIODevice::ReadOnly | QIODevice::Unbuffered | QIODevice::Text)) {
-            qDebug() << "TELEMETRY FIFO ERROR:" << fifoIn.errorString();
-        }
-
-        /* Message fifo & watcher*/
         fifoWrite(nodes.myNodeIp + ",message,init");
-        QFileSystemWatcher *msgWatcher = new QFileSystemWatcher();
-        msgWatcher->addPath(MESSAGE_RECEIVE_FIFO);
-        QObject::connect(msgWatcher, SIGNAL(fileChanged(QString)), this, SLOT(msgFifoChanged(QString)));
-
-        /* Incoming message FIFO */
-        if(!msgFifoIn.open(QIODevice::ReadOnly | QIODevice::Unbuffered | QIODevice::Text)) {
-            qDebug() << "MSG FIFO ERROR:" << msgFifoIn.errorString();
-        }
+        openFifos();
 
         /* Initial volume */
         ui->volumeSlider->setValue(uPref.volumeValue.toInt());
@@ -149,16 +225,18 @@ MainWindow::MainWindow(int argumentValue, QWidget *parent)
             ui->volumeSlider->setValue(uPref.volumeValue.toInt());
             saveUserPreferences();
         }
-
-        /* GPIO Buttons, TODO: m_fd close */
-        QByteArray device = QByteArrayLiteral(GPIO_INPUT_PATH);
-        m_fd = open(device.constData(), O_RDONLY);
-        if (m_fd >= 0) {
-            m_notify = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
-            connect(m_notify, SIGNAL(activated(int)), this, SLOT(readGpioButtons()));
-        } else {
-            qErrnoWarning(errno, "Cannot open input device %s", device.constData());
-        }
+        StartupTrace::mark("preferences");
+
+        /* GPIO Buttons */
+        m_gpioKeyActions.insert(KEY_A, &MainWindow::gpioKeyOtpStatus);
+        m_gpioKeyActions.insert(KEY_S, &MainWindow::gpioKeyBeepMute);
+        m_gpioKeyActions.insert(KEY_D, &MainWindow::gpioKeyErase);
+        m_gpioKeyActions.insert(KEY_F, &MainWindow::gpioKeyScreenLock);
+        m_gpioKeyActions.insert(GPIO_KEY_POWER, &MainWindow::gpioKeyPower);
+        /* SINM_GPIO_INPUT overrides the device, e.g. for input replay */
+        m_gpioReader = new GpioReader(qEnvironmentVariable("SINM_GPIO_INPUT", GPIO_INPUT_PATH), this);
+        connect(m_gpioReader, SIGNAL(keyEvent(int,int)), this, SLOT(gpioKeyEvent(int,int)));
+        StartupTrace::mark("gpio");
 
         /* Countdown timer */
         countdownTimer = new QTimer(this);
@@ -175,42 +253,6 @@ MainWindow::MainWindow(int argumentValue, QWidget *parent)
         ui->route2Button->setEnabled(true);
         ui->route3Button->setEnabled(false);
 
-        /* Set connection state */
-        g_connectState=false;
-
-        /* Key presentage watchers TODO: improve this */
-        QFileSystemWatcher *txKeyWatcher = new QFileSystemWatcher();
-        txKeyWatcher->addPath(TX_KEY_PRESENTAGE);
-        QObject::connect(txKeyWatcher, SIGNAL(fileChanged(QString)), this, SLOT(txKeyPresentageChanged()));
-
-        /* TODO: improve this */
-        QFile file(TX_KEY_PRESENTAGE);
-        if (file.open(QIODevice::ReadWrite)) {
-            QTextStream stream(&file);
-            stream << "wait" << Qt::endl;
-        }
-
-        /* Incoming txKey FIFO */
-        if(!txKeyFifoIn.open(QIODevice::ReadOnly | QIODevice::Unbuffered | QIODevice::Text)) {
-            qDebug() << "txKey FIFO error:" << txKeyFifoIn.errorString();
-        }
-
-        QFileSystemWatcher *rxKeyWatcher = new QFileSystemWatcher();
-        rxKeyWatcher->addPath(RX_KEY_PRESENTAGE);
-        QObject::connect(rxKeyWatcher, SIGNAL(fileChanged(QString)), this, SLOT(rxKeyPresentageChanged()));
-
-        /* TODO: Improve this */
-        QFile fileRx(RX_KEY_PRESENTAGE);
-        if (fileRx.open(QIODevice::ReadWrite)) {
-            QTextStream stream(&fileRx);
-            stream << "wait" << Qt::endl;
-        }
-
-        /* Incoming rxKey FIFO */
-        if(!rxKeyFifoIn.open(QIODevice::ReadOnly | QIODevice::Unbuffered | QIODevice::Text)) {
-            qDebug() << "rxKey FIFO error:" << rxKeyFifoIn.errorString();
-        }
-
         /* Network latency timer */
         envTimer = new QTimer();
         connect(envTimer, SIGNAL(timeout()), this, SLOT(networkLatency()) );
@@ -219,14 +261,174 @@ MainWindow::MainWindow(int argumentValue, QWidget *parent)
         /* Disable "Go Secure" */
         ui->greenButton->setEnabled(false);
 
-        /* Set filesystem watcher for Camera (experimental) */
-        QFileSystemWatcher *imageWatcher = new QFileSystemWatcher();
-        imageWatcher->addPath("/tmp/ftp/incoming/image.png");
-        QObject::connect(imageWatcher, SIGNAL(fileChanged(QString)), this, SLOT(incomingImageChangeDetected()));
+        /* FIFOs and first frame */
+        m_startupPending = 2;
+    }
+}
+
+/* First frame is flushed when the paint event returns, startup work
+   that can wait is queued behind it. */
+void MainWindow::paintEvent(QPaintEvent *event)
+{
+    QMainWindow::paintEvent(event);
+    if ( !m_firstFrameShown ) {
+        m_firstFrameShown = true;
+        QTimer::singleShot(0, this, SLOT(firstFrameShown()));
+    }
+}
+
+void MainWindow::firstFrameShown()
+{
+    StartupTrace::mark("first frame");
+    if ( m_startMode == UI_MODE ) {
+        /* Incoming pictures (experimental) */
+        m_imageReceiver = new ImageReceiver(IMAGE_TRANSFERRED_FILE, this);
+        connect(m_imageReceiver, SIGNAL(started()), this, SLOT(incomingImageStarted()));
+        connect(m_imageReceiver, SIGNAL(progress(qint64,qint64)), this, SLOT(incomingImageProgress(qint64,qint64)));
+        connect(m_imageReceiver, SIGNAL(preview(QByteArray)), this, SLOT(incomingImagePreview(QByteArray)));
+        connect(m_imageReceiver, SIGNAL(received(QByteArray)), this, SLOT(incomingImageReceived(QByteArray)));
+        /* Chunked transfers land on the same file, the rename completes them */
+        m_transferReceiver = new TransferReceiver(IMAGE_TRANSFERRED_FILE, this);
+        connect(m_transferReceiver, SIGNAL(started()), this, SLOT(incomingImageStarted()));
+        connect(m_transferReceiver, SIGNAL(received(QString,QString)), this, SLOT(incomingTransferReceived(QString,QString)));
+        connect(m_transferReceiver, SIGNAL(progress(qint64,qint64,qint64)), this, SLOT(incomingTransferProgress(qint64,qint64,qint64)));
+        connect(m_transferReceiver, SIGNAL(failed(QString)), this, SLOT(incomingTransferFailed(QString)));
+        StartupTrace::mark("image watcher");
+        /* Wi-Fi list is kept warm for the settings page */
+        m_wifiScanner->start();
+    }
+    startupStepDone();
+}
+
+void MainWindow::startupStepDone()
+{
+    if ( --m_startupPending == 0 )
+        StartupTrace::report();
+}
+
+/* Does not wait for a writer: reads see EOF until the daemon opens
+   its end, the watchers report when it writes */
+static int openReadFifo(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if ( fd < 0 )
+        qErrnoWarning(errno, "FIFO open error: %s", path);
+    return fd;
+}
+
+/* Key presentage files get an initial "wait" line. TODO: improve this */
+static void writeKeyPresentageWait(const char *path)
+{
+    QFile file(path);
+    if (file.open(QIODevice::ReadWrite)) {
+        QTextStream stream(&file);
+        stream << "wait" << Qt::endl;
+    }
+}
 
+static void adoptFifo(QFile &file, int fd)
+{
+    if ( fd < 0 )
+        return;
+    if ( !file.open(fd, QIODevice::ReadOnly | QIODevice::Unbuffered | QIODevice::Text,
+                    QFileDevice::AutoCloseHandle) ) {
+        qDebug() << "FIFO error:" << file.fileName() << file.errorString();
+        close(fd);
     }
 }
 
+void MainWindow::openFifos()
+{
+    adoptFifo(fifoIn, openReadFifo(TELEMETRY_FIFO_OUT));
+    adoptFifo(msgFifoIn, openReadFifo(MESSAGE_RECEIVE_FIFO));
+    writeKeyPresentageWait(TX_KEY_PRESENTAGE);
+    adoptFifo(txKeyFifoIn, openReadFifo(TX_KEY_PRESENTAGE));
+    writeKeyPresentageWait(RX_KEY_PRESENTAGE);
+    adoptFifo(rxKeyFifoIn, openReadFifo(RX_KEY_PRESENTAGE));
+    StartupTrace::mark("fifos");
+    fifosOpened();
+}
+
+/* Watchers are added once the FIFOs can be read */
+void MainWindow::fifosOpened()
+{
+    /* Watcher */
+    QFileSystemWatcher *watcher = new QFileSystemWatcher(this);
+    watcher->addPath(TELEMETRY_FIFO_OUT);
+    QObject::connect(watcher, SIGNAL(fileChanged(QString)), this, SLOT(fifoChanged(QString)));
+
+    /* Message fifo & watcher*/
+    QFileSystemWatcher *msgWatcher = new QFileSystemWatcher(this);
+    msgWatcher->addPath(MESSAGE_RECEIVE_FIFO);
+    QObject::connect(msgWatcher, SIGNAL(fileChanged(QString)), this, SLOT(msgFifoChanged(QString)));
+
+    /* Key presentage watchers TODO: improve this */
+    QFileSystemWatcher *txKeyWatcher = new QFileSystemWatcher(this);
+    txKeyWatcher->addPath(TX_KEY_PRESENTAGE);
+    QObject::connect(txKeyWatcher, SIGNAL(fileChanged(QString)), this, SLOT(txKeyPresentageChanged()));
+
+    QFileSystemWatcher *rxKeyWatcher = new QFileSystemWatcher(this);
+    rxKeyWatcher->addPath(RX_KEY_PRESENTAGE);
+    QObject::connect(rxKeyWatcher, SIGNAL(fileChanged(QString)), this, SLOT(rxKeyPresentageChanged()));
+
+    startupStepDone();
+}
+
+/* Settings page (with Wi-Fi), built on first use. Its widgets are
+   connected here, not by name: they don't exist at setupUi() time. */
+Ui::SettingsFrame *MainWindow::settingsUi()
+{
+    if ( m_settingsUi )
+        return m_settingsUi;
+
+    m_settingsFrame = new QFrame(ui->codeFrame);
+    m_settingsUi = new Ui::SettingsFrame;
+    m_settingsUi->setupUi(m_settingsFrame);
+    m_settingsFrame->stackUnder(ui->logoLabel);
+    m_settingsFrame->setVisible(false);
+
+    m_settingsUi->autoeraseCheckbox->setChecked(uPref.m_autoerase == "true");
+    m_settingsUi->audioDeviceInput->setText(uiElement.audioMixerOutputDevice);
+    m_settingsUi->diagnosticsFrame->setVisible(false);
+
+    connect(m_settingsUi->exitButton, &QPushButton::clicked, this, &MainWindow::on_exitButton_clicked);
+    connect(m_settingsUi->scanWifiButton, &QPushButton::clicked, this, &MainWindow::on_scanWifiButton_clicked);
+    connect(m_settingsUi->saveWifiButton, &QPushButton::clicked, this, &MainWindow::on_saveWifiButton_clicked);
+    connect(m_settingsUi->networksComboBox, (void (QComboBox::*)(int))&QComboBox::activated,
+            this, &MainWindow::on_networksComboBox_activated);
+    connect(m_settingsUi->deleteWifiButton, &QPushButton::clicked, this, &MainWindow::on_deleteWifiButton_clicked);
+    connect(m_settingsUi->wifiPasswordText, &QLineEdit::textChanged, this, &MainWindow::on_wifiPasswordText_textChanged);
+    connect(m_settingsUi->saveGatewayButton, &QPushButton::clicked, this, &MainWindow::on_saveGatewayButton_clicked);
+    connect(m_settingsUi->gatewayIpPortInput, &QLineEdit::textChanged, this, &MainWindow::on_gatewayIpPortInput_textChanged);
+    connect(m_settingsUi->autoeraseCheckbox, &QCheckBox::stateChanged, this, &MainWindow::on_autoeraseCheckbox_stateChanged);
+    connect(m_settingsUi->audioDeviceInput, &QLineEdit::textChanged, this, &MainWindow::on_audioDeviceInput_textChanged);
+    connect(m_settingsUi->diagnosticsButton, &QPushButton::clicked, this, &MainWindow::on_diagnosticsButton_clicked);
+    connect(m_settingsUi->exportDiagnosticsButton, &QPushButton::clicked,
+            this, &MainWindow::on_exportDiagnosticsButton_clicked);
+    return m_settingsUi;
+}
+
+/* Camera / incoming image overlay, built on first use */
+Ui::ImageFrame *MainWindow::imageUi()
+{
+    if ( m_imageUi )
+        return m_imageUi;
+
+    m_imageFrame = new QFrame(ui->centralwidget);
+    m_imageUi = new Ui::ImageFrame;
+    m_imageUi->setupUi(m_imageFrame);
+    m_imageFrame->move(10, 10);
+    m_imageFrame->raise();
+    m_imageFrame->setVisible(false);
+
+    connect(m_imageUi->imageFrameCloseButton, &QPushButton::clicked, this, &MainWindow::on_imageFrameCloseButton_clicked);
+    connect(m_imageUi->imageFrameTakePictureButton, &QPushButton::clicked, this, &MainWindow::on_imageFrameTakePictureButton_clicked);
+    connect(m_imageUi->imageFrameSendPicture, &QPushButton::clicked, this, &MainWindow::on_imageFrameSendPicture_clicked);
+    connect(m_imageUi->imageFrameGalleryList, &QListWidget::itemClicked, this, &MainWindow::galleryItemClicked);
+    renderGallery();
+    return m_imageUi;
+}
+
 void MainWindow::txKeyPresentageChanged()
 {
     QString line = txKeyFifoIn.readLine();
@@ -235,7 +437,7 @@ void MainWindow::txKeyPresentageChanged()
     txKeyRemaining = 100 - line.toDouble();
     txKeyRemainingString = QString::number( txKeyRemaining ,'f', 2);
     if ( txKeyRemainingString != "100.00" )
-        ui->keyPrecentage->setText( txKeyRemainingString + " % " + rxKeyRemainingString + " %");
+        updateKeyText();
 }
 
 void MainWindow::rxKeyPresentageChanged()
@@ -246,161 +448,176 @@ void MainWindow::rxKeyPresentageChanged()
     rxKeyRemaining = 100 - line.toDouble();
     rxKeyRemainingString = QString::number( rxKeyRemaining, 'f', 2 );
     if ( rxKeyRemainingString != "100.00" )
-        ui->keyPrecentage->setText( txKeyRemainingString + " % " + rxKeyRemainingString + " %" );
+        updateKeyText();
+}
+
+/* Key FIFOs carry no peer: usage goes to the session with audio,
+   otherwise to the one shown */
+void MainWindow::updateKeyText()
+{
+    CallSession *session = audioSession();
+    if ( !session )
+        session = m_call;
+    QString text = txKeyRemainingString + " % " + rxKeyRemainingString + " %";
+    if ( session != m_call && session->state() != CallSession::Idle )
+        m_sessionViews[session->peerId()].keyText = text;
+    if ( session == m_call )
+        ui->keyPrecentage->setText( text );
+}
+
+/* GPIO key dispatch. Called once per key of each EV_SYN frame. */
+void MainWindow::gpioKeyEvent(int code, int value)
+{
+    GpioKeyAction action = m_gpioKeyActions.value(code, nullptr);
+    if ( action )
+        (this->*action)(value);
+}
+
+/* F1 key: OTP status display while held */
+void MainWindow::gpioKeyOtpStatus(int value)
+{
+    if ( value == 1 ) {
+        ui->lineEdit->clearFocus();
+        reloadKeyUsage();
+        ui->contact1Button->setText( m_keyStatusString[0] );
+        ui->contact2Button->setText( m_keyStatusString[1] );
+        ui->contact3Button->setText( m_keyStatusString[2] );
+        ui->contact4Button->setText( m_keyStatusString[3] );
+        ui->contact5Button->setText( m_keyStatusString[4] );
+        ui->contact6Button->setText( m_keyStatusString[5] );
+        ui->contact1Button->setStyleSheet(m_otpStatusHighlightStyle);
+        ui->contact2Button->setStyleSheet(m_otpStatusHighlightStyle);
+        ui->contact3Button->setStyleSheet(m_otpStatusHighlightStyle);
+        ui->contact4Button->setStyleSheet(m_otpStatusHighlightStyle);
+        ui->contact5Button->setStyleSheet(m_otpStatusHighlightStyle);
+        ui->contact6Button->setStyleSheet(m_otpStatusHighlightStyle);
+    }
+    if ( value == 0 ) {
+        ui->lineEdit->setFocus();
+        ui->contact1Button->setText( nodes.node_name[0] );
+        ui->contact2Button->setText( nodes.node_name[1] );
+        ui->contact3Button->setText( nodes.node_name[2] );
+        ui->contact4Button->setText( nodes.node_name[3] );
+        ui->contact5Button->setText( nodes.node_name[4] );
+        ui->contact6Button->setText( nodes.node_name[5] );
+        ui->contact1Button->setStyleSheet(m_otpStausNormalStyle);
+        ui->contact2Button->setStyleSheet(m_otpStausNormalStyle);
+        ui->contact3Button->setStyleSheet(m_otpStausNormalStyle);
+        ui->contact4Button->setStyleSheet(m_otpStausNormalStyle);
+        ui->contact5Button->setStyleSheet(m_otpStausNormalStyle);
+        ui->contact6Button->setStyleSheet(m_otpStausNormalStyle);
+    }
+}
+
+/* F2 key: beep mute */
+void MainWindow::gpioKeyBeepMute(int value)
+{
+    if ( value == 1 ) {
+        ui->lineEdit->clearFocus();
+        if ( nodes.beepActive == "1") {
+            updateCallStatusIndicator("Beep muted", "green", "transparent",INDICATE_ONLY );
+            saveUserPreferencesBeep("0");
+        } else {
+            updateCallStatusIndicator("Beep unmuted", "green", "transparent",INDICATE_ONLY );
+            saveUserPreferencesBeep("1");
+            beepBuzzer(Buzzer::Notify);
+        }
+    }
+    if ( value == 0 ) {
+        ui->lineEdit->setFocus();
+    }
 }
 
-void MainWindow::readGpioButtons()
+/* F3 key: 'nuke.sh' countdown while held */
+void MainWindow::gpioKeyErase(int value)
 {
-    struct input_event in_ev = { 0 };
-    /*  Loop read data  */
-    if (sizeof(struct input_event) != read(m_fd, &in_ev, sizeof(struct input_event))) {
-        perror("read error");
-        exit(-1);
+    if ( value == 1 ) {
+        ui->lineEdit->clearFocus();
+        on_eraseButton_clicked();
+        /* Override beep */
+        nodes.beepActive = "1";
+        ui->countLabel->setVisible(true);
+        m_finalCountdownValue = 10;
+        ui->countLabel->setText(QString::number(m_finalCountdownValue));
+        countdownTimer->start(500);
+    }
+    if ( value == 0 ) {
+        ui->lineEdit->setFocus();
+        /* Restore beep preference */
+        nodes.beepActive = m_userPrefStore->string("beep");
+        m_finalCountdownValue = 10;
+        countdownTimer->stop();
+        ui->countLabel->setVisible(false);
+        beepBuzzerOff();
     }
+}
 
-    switch (in_ev.type) {
-        case EV_KEY:
-        {
-            /* F1 key: OTP status display */
-            if (KEY_A == in_ev.code && in_ev.value == 1 ) {
-                ui->lineEdit->clearFocus();
-                reloadKeyUsage();
-                ui->contact1Button->setText( m_keyStatusString[0] );
-                ui->contact2Button->setText( m_keyStatusString[1] );
-                ui->contact3Button->setText( m_keyStatusString[2] );
-                ui->contact4Button->setText( m_keyStatusString[3] );
-                ui->contact5Button->setText( m_keyStatusString[4] );
-                ui->contact6Button->setText( m_keyStatusString[5] );
-                ui->contact1Button->setStyleSheet(m_otpStatusHighlightStyle);
-                ui->contact2Button->setStyleSheet(m_otpStatusHighlightStyle);
-                ui->contact3Button->setStyleSheet(m_otpStatusHighlightStyle);
-                ui->contact4Button->setStyleSheet(m_otpStatusHighlightStyle);
-                ui->contact5Button->setStyleSheet(m_otpStatusHighlightStyle);
-                ui->contact6Button->setStyleSheet(m_otpStatusHighlightStyle);
-                break;
-            }
-            if (KEY_A == in_ev.code && in_ev.value == 0 ) {
-                ui->lineEdit->setFocus();
-                ui->contact1Button->setText( nodes.node_name[0] );
-                ui->contact2Button->setText( nodes.node_name[1] );
-                ui->contact3Button->setText( nodes.node_name[2] );
-                ui->contact4Button->setText( nodes.node_name[3] );
-                ui->contact5Button->setText( nodes.node_name[4] );
-                ui->contact6Button->setText( nodes.node_name[5] );
-                ui->contact1Button->setStyleSheet(m_otpStausNormalStyle);
-                ui->contact2Button->setStyleSheet(m_otpStausNormalStyle);
-                ui->contact3Button->setStyleSheet(m_otpStausNormalStyle);
-                ui->contact4Button->setStyleSheet(m_otpStausNormalStyle);
-                ui->contact5Button->setStyleSheet(m_otpStausNormalStyle);
-                ui->contact6Button->setStyleSheet(m_otpStausNormalStyle);
-                break;
-            }
-            /* F2 key: beep mute */
-            if ( KEY_S == in_ev.code && in_ev.value == 1 ) {
-                ui->lineEdit->clearFocus();
-                if ( nodes.beepActive == "1") {
-                    updateCallStatusIndicator("Beep muted", "green", "transparent",INDICATE_ONLY );
-                    saveUserPreferencesBeep("0");
-                } else {
-                    updateCallStatusIndicator("Beep unmuted", "green", "transparent",INDICATE_ONLY );
-                    saveUserPreferencesBeep("1");
-                    beepBuzzer(10);
-                }
-                if( KEY_S == in_ev.code && in_ev.value == 0 ) {
-                    ui->lineEdit->setFocus();
-                }
-            }
-            /* F3 key: 'nuke.sh' */
-            if (KEY_D == in_ev.code && in_ev.value == 1 ) {
-                ui->lineEdit->clearFocus();
-                on_eraseButton_clicked();
-                /* Override beep */
-                nodes.beepActive = "1";
-                ui->countLabel->setVisible(true);
-                m_finalCountdownValue = 10;
-                ui->countLabel->setText(QString::number(m_finalCountdownValue));
-                countdownTimer->start(500);
-            }
-            if (KEY_D == in_ev.code && in_ev.value == 0 ) {
-                ui->lineEdit->setFocus();
-                /* Read beep preference */
-                QSettings settings(USER_PREF_INI_FILE,QSettings::IniFormat);
-                nodes.beepActive = settings.value("beep").toString();
-                m_finalCountdownValue = 10;
-                countdownTimer->stop();
-                ui->countLabel->setVisible(false);
-                beepBuzzerOff();
-            }
-            /* Green button: screen lock/unlock  */
-            if (KEY_F == in_ev.code && in_ev.value == 1 && backLightOn == false ) {
-                ui->lineEdit->clearFocus();
-                screenBlanktimer->start(BLACK_OUT_TIME);
-                rampUp();
-                ui->lineEdit->setFocus();
-                break;
-            }
-            if (KEY_F == in_ev.code && in_ev.value == 1 && backLightOn == true ) {
-                ui->lineEdit->clearFocus();
-                rampDown();
-                screenBlanktimer->stop();
-                break;
-            }
+/* Green button: screen lock/unlock  */
+void MainWindow::gpioKeyScreenLock(int value)
+{
+    if ( value != 1 )
+        return;
+    ui->lineEdit->clearFocus();
+    if ( backLightOn == false ) {
+        screenBlanktimer->start(BLACK_OUT_TIME);
+        rampUp();
+        ui->lineEdit->setFocus();
+    } else {
+        rampDown();
+        screenBlanktimer->stop();
+    }
+}
 
-            /* Power button dialog */
-            if (142 == in_ev.code && in_ev.value == 1 ) {
-                if ( backLightOn == false ) {
-                    rampUp();
-                }
-                QMessageBox msgBox;
-                msgBox.setWindowTitle("Power button");
-                msgBox.setText("Do you want to power off?");
-                msgBox.setStandardButtons(QMessageBox::Yes);
-                msgBox.addButton(QMessageBox::No);
-                msgBox.setDefaultButton(QMessageBox::No);
-                msgBox.setStyleSheet( m_powerButtonDialogStyle );
-                if(msgBox.exec() == QMessageBox::Yes){
-                  on_pwrButton_clicked();
-                } else {
-                }
-                break;
-            }
-        }
+/* Power button dialog. Opened window-modal without a nested event
+   loop, so key handling keeps running while the dialog is shown. */
+void MainWindow::gpioKeyPower(int value)
+{
+    if ( value != 1 )
+        return;
+    if ( backLightOn == false ) {
+        rampUp();
     }
+    if ( m_powerDialog && m_powerDialog->isVisible() )
+        return;
+    QMessageBox *msgBox = new QMessageBox(this);
+    m_powerDialog = msgBox;
+    msgBox->setAttribute(Qt::WA_DeleteOnClose);
+    msgBox->setWindowTitle("Power button");
+    msgBox->setText("Do you want to power off?");
+    msgBox->setStandardButtons(QMessageBox::Yes);
+    msgBox->addButton(QMessageBox::No);
+    msgBox->setDefaultButton(QMessageBox::No);
+    msgBox->setStyleSheet( m_powerButtonDialogStyle );
+    connect(msgBox, SIGNAL(finished(int)), this, SLOT(powerDialogFinished(int)));
+    msgBox->open();
 }
 
-void MainWindow::beepBuzzerOff()
+void MainWindow::powerDialogFinished(int result)
 {
-    if ( nodes.beepActive == "1" ) {
-        QFile file(BUZZER_PATH);
-        if (file.open(QIODevice::ReadWrite)) {
-            QTextStream stream(&file);
-            stream << 0 << Qt::endl;
-        }
-        file.close();
+    if ( result == QMessageBox::Yes ) {
+        on_pwrButton_clicked();
     }
 }
 
-void MainWindow::beepBuzzer(int lenght)
+void MainWindow::beepBuzzerOff()
 {
-   if ( nodes.beepActive == "1" ) {
-        QFile file(BUZZER_PATH);
-        if (file.open(QIODevice::ReadWrite)) {
-            QTextStream stream(&file);
-            stream << 1 << Qt::endl;
-        }
-        file.close();
-        QTimer::singleShot(lenght, this, SLOT(beepBuzzerOff()));
+    m_buzzer->stop();
+}
+
+void MainWindow::beepBuzzer(Buzzer::Pattern pattern)
+{
+    if ( nodes.beepActive == "1" ) {
+        m_buzzer->play(pattern);
     }
 }
 
+/* Screen wake. Fade runs on the backlight frame timer, returns at once. */
 void MainWindow::rampUp()
 {
     backLightOn=true;
-    for (int x=0; x<255; x++) {
-        writeBackLight(QString::number(x));
-        /* TODO: Improve this */
-        QCoreApplication::processEvents();
-    }
+    m_wifiScanner->setPaused(false);
+    m_prewarm->wake();
+    m_backlight->fadeTo(BACKLIGHT_MAX_LEVEL, BACKLIGHT_FADE_IN_TIME);
     if ( !screenBlanktimer->isActive()) {
         screenBlanktimer->start(BLACK_OUT_TIME);
     }
@@ -409,37 +626,33 @@ void MainWindow::rampDown()
 {
     screenBlanktimer->stop();
     backLightOn=false;
-    for (int x=255; x>0; x--) {
-        writeBackLight(QString::number(x));
-        QCoreApplication::processEvents();
-    }
-    writeBackLight("0");
-    screenBlanktimer->stop();
+    m_backlight->fadeTo(0, BACKLIGHT_FADE_OUT_TIME);
     ui->pinEntryTitle->setText(uiElement.pinEntryTitleAccessPin);
     ui->codeFrame->setVisible(true);
     ui->logoLabel->setVisible(true);
-    ui->settingsFrame->setVisible(false);
+    if ( m_settingsFrame )
+        m_settingsFrame->setVisible(false);
+    m_wifiScanner->setActive(false);
+    m_wifiScanner->setPaused(true);
     ui->codeValue->setText("");
-    ui->imageFramePictureLabel->clear();
-    ui->imageFrame->setVisible(0);
+    if ( m_imageUi ) {
+        m_imageUi->imageFramePictureLabel->clear();
+        m_imageFrame->setVisible(0);
+    }
 }
 
 void MainWindow::writeBackLight(QString value)
 {
-    QFile file(BACKLIGHT_PATH);
-    if (file.open(QIODevice::ReadWrite)) {
-        QTextStream stream(&file);
-        stream << value << Qt::endl;
-    }
-    file.close();
+    m_backlight->setLevel(value.toInt());
 }
 
 void MainWindow::fifoWrite(QString message)
 {
-    /* Dummy read */
-    QTextStream in(&fifoIn);
-    QString line = in.readAll();
-    g_fifoReply = "";
+    /* Dummy read, FIFO is opened in the background at startup */
+    if ( fifoIn.isOpen() ) {
+        QTextStream in(&fifoIn);
+        QString line = in.readAll();
+    }
     QFile file(TELEMETRY_FIFO_IN);
     if(!file.open(QIODevice::ReadWrite | QIODevice::Text)) {
         qDebug() << "FIFO Write file open error" << file.errorString();
@@ -449,142 +662,110 @@ void MainWindow::fifoWrite(QString message)
     file.close();
 }
 
+/* Contact tap: switch to the peer's session when there is one.
+   Otherwise ask presence, or dial right away when pre-warm has a
+   fresh 'available' for the peer. */
+void MainWindow::contactTapped(QString nodeIp)
+{
+    int nodeNumber = nodeIndex(nodeIp);
+    CallSession *session = nodeNumber < 0 ? nullptr : sessionForPeer(nodes.node_id[nodeNumber]);
+    if ( session ) {
+        setCurrentSession(session);
+        return;
+    }
+    if ( m_prewarm->isAvailable(nodeIp) ) {
+        m_dialIp = "";
+        dialNode(nodeIp);
+        return;
+    }
+    m_dialIp = nodeIp;
+    QString scanCmd = nodeIp + ",status";
+    fifoWrite(scanCmd);
+}
+
+void MainWindow::dialNode(QString nodeIp)
+{
+    int nodeNumber = nodeIndex(nodeIp);
+    if ( nodeNumber < 0 )
+        return;
+    connectAsClient(nodes.node_ip[nodeNumber], nodes.node_id[nodeNumber]);
+}
+
+int MainWindow::nodeIndex(const QString &nodeIp)
+{
+    for (int x=0; x<NODECOUNT; x++) {
+        if ( !nodeIp.isEmpty() && nodeIp.compare(nodes.node_ip[x]) == 0 )
+            return x;
+    }
+    return -1;
+}
+
+QLabel *MainWindow::contactSelected(int nodeNumber)
+{
+    QLabel *selected[NODECOUNT] = { ui->contact1Selected, ui->contact2Selected, ui->contact3Selected,
+                                    ui->contact4Selected, ui->contact5Selected, ui->contact6Selected };
+    return selected[nodeNumber];
+}
+
 /* Telemetry FIFO */
 void MainWindow::fifoChanged(const QString & path)
 {
-  int nodeNumber;
   QTextStream in(&fifoIn);
   QString line = in.readAll();
 
   if(line.compare("telemetryclient_is_alive") == 0) {
-      g_fifoReply ="client_alive";
+      /* Keepalive, names no peer and answers no request */
   } else {
 
     /*  Main logic for telemetry fifo handling
      *  IP:     token[0]
      *  Status: token[1] */
     QStringList token = line.split(',');
-    g_fifoReply = token[1];
-
-      if( token[1].compare("available") == 0 )
+    m_telemetry->reply(token[0], token[1]);
+    /* Lines name the peer, which picks the session */
+    CallSession *session = sessionForIp(token[0]);
+
+      /* Status replies: act on the one for the contact tapped, the rest
+         are pre-warm presence */
+      m_prewarm->presence(token[0], token[1]);
+      bool dialed = token[0] == m_dialIp;
+      if ( dialed && (token[1] == "available" || token[1] == "busy" || token[1] == "offline") )
+          m_dialIp = "";
+
+      if( token[1].compare("available") == 0 && dialed )
       {
-          for (int x=0; x<NODECOUNT; x++) {
-            if(token[0].compare(nodes.node_ip[x]) == 0) {
-                nodeNumber=x;
-            }
-          }
-          if( nodeNumber == 0 ) {
-                ui->contact1Selected->setStyleSheet("background-color: lightgreen;");
-                connectAsClient(nodes.node_ip[nodeNumber], nodes.node_id[nodeNumber]);
-                ui->contact1Selected->setVisible(1);
-          }
-          if( nodeNumber == 1 ) {
-                ui->contact2Selected->setStyleSheet("background-color: lightgreen;");
-                connectAsClient(nodes.node_ip[nodeNumber], nodes.node_id[nodeNumber]);
-                ui->contact2Selected->setVisible(1);
-          }
-          if( nodeNumber == 2 ) {
-                ui->contact3Selected->setStyleSheet("background-color: lightgreen;");
-                connectAsClient(nodes.node_ip[nodeNumber], nodes.node_id[nodeNumber]);
-                ui->contact3Selected->setVisible(1);
-          }
-          if( nodeNumber == 3 ) {
-                ui->contact4Selected->setStyleSheet("background-color: lightgreen;");
-                connectAsClient(nodes.node_ip[nodeNumber], nodes.node_id[nodeNumber]);
-                ui->contact4Selected->setVisible(1);
-          }
-          if( nodeNumber == 4 ) {
-                ui->contact5Selected->setStyleSheet("background-color: lightgreen;");
-                connectAsClient(nodes.node_ip[nodeNumber], nodes.node_id[nodeNumber]);
-                ui->contact5Selected->setVisible(1);
-          }
-          if( nodeNumber == 5 ) {
-                ui->contact6Selected->setStyleSheet("background-color: lightgreen;");
-                connectAsClient(nodes.node_ip[nodeNumber], nodes.node_id[nodeNumber]);
-                ui->contact6Selected->setVisible(1);
-          }
+          dialNode(token[0]);
       }
-      if( token[1].compare("offline") == 0 )
+      if( token[1].compare("offline") == 0 && dialed )
       {
-          for (int x=0; x<NODECOUNT; x++) {
-            if(token[0].compare(nodes.node_ip[x]) == 0) {
-                nodeNumber=x;
-            }
-          }
-          if( nodeNumber == 0 ) {
-            ui->contact1Selected->setVisible(1);
-            ui->contact1Selected->setStyleSheet("background-color: red;");
-          }
-          if( nodeNumber == 1 ) {
-            ui->contact2Selected->setVisible(1);
-            ui->contact2Selected->setStyleSheet("background-color: red;");
-          }
-          if( nodeNumber == 2 ) {
-            ui->contact3Selected->setVisible(1);
-            ui->contact3Selected->setStyleSheet("background-color: red;");
-          }
-          if( nodeNumber == 3 ) {
-            ui->contact4Selected->setVisible(1);
-            ui->contact4Selected->setStyleSheet("background-color: red;");
-          }
-          if( nodeNumber == 4 ) {
-            ui->contact5Selected->setVisible(1);
-            ui->contact5Selected->setStyleSheet("background-color: red;");
-          }
-          if( nodeNumber == 5 ) {
-            ui->contact6Selected->setVisible(1);
-            ui->contact6Selected->setStyleSheet("background-color: red;");
+          int nodeNumber = nodeIndex(token[0]);
+          if( nodeNumber >= 0 ) {
+            contactSelected(nodeNumber)->setVisible(1);
+            contactSelected(nodeNumber)->setStyleSheet("background-color: red;");
           }
       }
 
-      if( token[1].compare("terminate_ready") == 0 )
+      /* UI is reset when the session reaches Idle */
+      if( token[1].compare("terminate_ready") == 0 && session )
       {
-          updateCallStatusIndicator("remote terminated", "green", "transparent",INDICATE_ONLY );
-          ui->contact1Selected->setVisible(0);
-          ui->contact2Selected->setVisible(0);
-          ui->contact3Selected->setVisible(0);
-          ui->contact4Selected->setVisible(0);
-          ui->contact5Selected->setVisible(0);
-          ui->contact6Selected->setVisible(0);
-          setContactButtons(true);
-          ui->answerButton->setEnabled(true);
-          ui->answerButton->setVisible(true);
-          ui->keyPrecentage->setText("");
-          ui->redButton->setStyleSheet(s_terminateButtonStyle_normal);
-          ui->greenButton->setStyleSheet(s_goSecureButtonStyle_normal);
-          ui->greenButton->setEnabled(false);
-          on_eraseButton_clicked();
+          if ( session == m_call )
+              updateCallStatusIndicator("remote terminated", "green", "transparent",INDICATE_ONLY );
+          session->terminateReady(token[0]);
       }
 
-      if( token[1].compare("busy") == 0 )
+      if( token[1].compare("busy") == 0 && (dialed || session) )
       {
           updateCallStatusIndicator("Remote busy", "green", "transparent",LOG_ONLY );
       }
-      if( token[1].compare("offline") == 0 )
-      {          
+      if( token[1].compare("offline") == 0 && (dialed || session) )
+      {
           updateCallStatusIndicator("Remote offline", "green", "transparent",LOG_ONLY );
 
           /* Disabled */
-          if ( 0 && g_connectState ) {
+          if ( 0 && session && session->isConnected() ) {
               /* Tear connection down without remote involvement. */
               updateCallStatusIndicator("Auto disconnect", "green", "transparent",LOG_ONLY );
-              ui->contact1Selected->setVisible(0);
-              ui->contact2Selected->setVisible(0);
-              ui->contact3Selected->setVisible(0);
-              ui->contact4Selected->setVisible(0);
-              ui->contact5Selected->setVisible(0);
-              ui->contact6Selected->setVisible(0);
-              QTimer::singleShot(3 * 1000, this, SLOT(tearDownLocal()));
-              removeLocalFile("/tmp/CLIENT_CALL_ACTIVE");
-              ui->keyPrecentage->setText("");
-              ui->redButton->setStyleSheet(s_terminateButtonStyle_normal);
-              ui->greenButton->setStyleSheet(s_goSecureButtonStyle_normal);
-              ui->greenButton->setEnabled(false);
-              ui->inComingFrame->setVisible(false);
-              g_connectState = false;
-              g_connectedNodeId = "";
-              g_connectedNodeIp = "";
-              g_remoteOtpPeerIp = "";
+              session->abort();
           }
 
       }
@@ -601,22 +782,47 @@ void MainWindow::fifoChanged(const QString & path)
  * IP:          token[0]
  * msg payload: token[1]
  */
+/* One read may carry several messages, one per line */
 int MainWindow::msgFifoChanged(const QString & path)
 {
     QTextStream in(&msgFifoIn);
-    QString line = in.readAll();
+    const QStringList lines = in.readAll().split('\n', Qt::SkipEmptyParts);
+    for (const QString &line : lines)
+        peerMessage(line);
+    return 0;
+}
+
+void MainWindow::peerMessage(const QString &line)
+{
     QStringList token = line.split(',');
+    if ( token.size() < 2 )
+        return;
+    /* Sender picks the session, unknown senders go to the one shown */
+    CallSession *session = sessionForIp(token[0]);
+    if ( !session )
+        session = m_call;
+    if ( VoiceMessenger::isVoicePayload(token[1]) ) {
+        m_voice->handlePayload(session->otpPeerIp(), token[1]);
+        return;
+    }
     /* Logic for UI ring indication. Note that ring tone ('sound') is played by telemetry logic */
     if ( token[1] == "ring" )
     {
-        if (  backLightOn == false ) {
-            rampUp();
+        /* Voice is single session: the ring times out at the caller */
+        CallSession *audio = audioSession();
+        if ( audio && audio != session ) {
+            appendMessage(session, "[SYSTEM]: Ring refused, voice busy");
+        } else if ( session->ringReceived() ) {
+            setCurrentSession(session);
+            if (  backLightOn == false ) {
+                rampUp();
+            }
+            beepBuzzer(Buzzer::Ring);
+            ui->inComingFrame->setVisible(true);
+            ui->incomingTitleFrame->setText("Incoming audio");
+            ui->answerButton->setText("Accept");
+            ui->denyButton->setText("Deny");
         }
-        beepBuzzer(500);
-        ui->inComingFrame->setVisible(true);
-        ui->incomingTitleFrame->setText("Incoming audio");
-        ui->answerButton->setText("Accept");
-        ui->denyButton->setText("Deny");
         token[1]="";
     }
 
@@ -629,67 +835,78 @@ int MainWindow::msgFifoChanged(const QString & path)
     }
 
     if ( token[1] == "remote_hangup") {
-        ui->inComingFrame->setVisible(false);
-        ui->messagesView->append("[SYSTEM]: Remote hangup (" + token[0] + ")");
-        updateCallStatusIndicator("Remote hangup", "green", "transparent",LOG_AND_INDICATE);
+        if ( session == m_call ) {
+            ui->inComingFrame->setVisible(false);
+            ui->messagesView->append("[SYSTEM]: Remote hangup (" + token[0] + ")");
+            updateCallStatusIndicator("Remote hangup", "green", "transparent",LOG_AND_INDICATE);
+        }
+        token[1]="";
+        /* Server side reaches Idle, and may show another session, at once */
+        if ( session == m_call )
+            eraseSession(session);
+        else {
+            m_sessionViews.remove(session->peerId());
+            m_voice->clear(session->otpPeerIp());
+        }
+        session->remoteHangup();
+    }
+    /* Peer could not rebuild our last picture delta */
+    if ( token[1] == "picture_keyframe") {
+        resendPictureKeyframe(session->otpPeerIp());
         token[1]="";
-        ui->redButton->click();
-        on_eraseButton_clicked();
     }
     if ( token[1] == "answer_success") {
-        updateCallStatusIndicator("Audio active", "lightgreen", "transparent",INDICATE_ONLY);
+        session->remoteAnswered();
         token[1]="";
     }
     /* Remote (who connected us) presses 'terminate', we should do the same.
-       TODO: This has some logic errors.
-     */
+       Rejected by the session unless we are the server of the call. */
     if ( token[1] == "initiator_disconnect") {
         qDebug() << "initiator_disconnect()";
-        ui->inComingFrame->setVisible(false);
-        // ui->redButton->click(); // WRONG!! We cannot 'disconnect' as Client if we are 'Server'
-        if ( g_connectState )
-            on_denyButton_clicked();
+        QString peerId = session->peerId();
+        if ( session->initiatorDisconnect() ) {
+            if ( session == m_call ) {
+                ui->inComingFrame->setVisible(false);
+                eraseSession(session);
+            } else {
+                m_sessionViews.remove(peerId);
+                m_voice->clear(session->otpPeerIp());
+            }
+        }
         token[1]="";
-        on_eraseButton_clicked();
     }
 
     /* client_connected,[client_id];[client_ip];[client_name] */
     if ( token[1].contains( "client_connected",Qt::CaseInsensitive ) ) {
         QStringList remoteParameters = token[1].split(';');
-        g_connectedNodeId = remoteParameters[1];
-        g_connectedNodeIp = remoteParameters[2];
-        g_connectState = true;
-        updateCallStatusIndicator(remoteParameters[3] + " connected" , "lightgreen","transparent",LOG_AND_INDICATE);
-        token[1]="";
-        setIndicatorForIncomingConnection(remoteParameters[2]);
-        if (  backLightOn == false ) {
-            rampUp();
+        if ( remoteParameters.size() > 3 ) {
+            /* One session per peer: the live one rejects a second connect */
+            CallSession *incoming = sessionForPeer(remoteParameters[1]);
+            if ( !incoming ) {
+                incoming = freeSession();
+                int nodeNumber = nodeIndex(remoteParameters[2]);
+                incoming->setOtpPeerIp(nodeNumber < 0 ? QString() : nodes.node_otp_ip[nodeNumber]);
+            }
+            incoming->clientConnected(remoteParameters[1], remoteParameters[2], remoteParameters[3]);
         }
-        /* Inbound OTP */
-        g_remoteOtpPeerIp = "10.10.0.2";
-        /* Inbound connection: highlight terminate and disable Go Secure */
-        ui->redButton->setStyleSheet(s_terminateButtonStyle_highlight);
-        ui->greenButton->setStyleSheet(s_goSecureButtonStyle_normal);
-        ui->greenButton->setEnabled(false);
-        beepBuzzer(10);
+        token[1]="";
     }
 
     /* Commcheck TODO: Make alive ping out of this */
     if ( token[1] == "Ping") {
-        if ( g_connectState ) {
-            QString fifo_command = g_remoteOtpPeerIp + ",message,Commcheck from: " + nodes.myNodeName;
+        if ( session->isConnected() ) {
+            QString fifo_command = session->otpPeerIp() + ",message,Commcheck from: " + nodes.myNodeName;
             fifoWrite(fifo_command);
-            return 0;
+            return;
         }
     }
     /* Normal message to be shown */
     if (token[1] != "" )
     {        
         token[1].replace( QChar(SUBSTITUTE_CHAR_CODE), "," );
-        ui->messagesView->append(token[1]);
-        beepBuzzer(10);
+        appendMessage(session, token[1]);
+        beepBuzzer(Buzzer::Notify);
     }
-    return 0;
 }
 
 /* Alter contact button state */
@@ -724,41 +941,141 @@ void MainWindow::setContactButtons(bool state)
     }
 }
 
-void MainWindow::setIndicatorForIncomingConnection(QString peerIp)
+/* Contact indicators: session shown, other sessions, unread messages */
+void MainWindow::renderContacts()
 {
-        ui->contact1Selected->setVisible(0);
-        ui->contact2Selected->setVisible(0);
-        ui->contact3Selected->setVisible(0);
-        ui->contact4Selected->setVisible(0);
-        ui->contact5Selected->setVisible(0);
-        ui->contact6Selected->setVisible(0);
-        /* Disable contact buttons when incoming connection is alive */
-        setContactButtons(false);
-        /* Light up 'green' for contact, who made connection */
-        int nodeNumber;
-        for (int x=0; x<NODECOUNT; x++) {
-          if(peerIp.compare(nodes.node_ip[x]) == 0) {
-              nodeNumber=x;
-          }
-        }
-        if( nodeNumber == 0 ) {
-            ui->contact1Selected->setVisible(1);
-        }
-        if( nodeNumber == 1 ) {
-            ui->contact2Selected->setVisible(1);
-        }
-        if( nodeNumber == 2 ) {
-            ui->contact3Selected->setVisible(1);
-        }
-        if( nodeNumber == 3 ) {
-            ui->contact4Selected->setVisible(1);
-        }
-        if( nodeNumber == 4 ) {
-            ui->contact5Selected->setVisible(1);
+    for (int x=0; x<NODECOUNT; x++) {
+        CallSession *session = sessionForPeer(nodes.node_id[x]);
+        if ( !session ) {
+            contactSelected(x)->setVisible(0);
+            continue;
         }
-        if( nodeNumber == 5 ) {
-            ui->contact6Selected->setVisible(1);
+        QString color = "green";
+        if ( session == m_call )
+            color = "lightgreen";
+        else if ( !m_sessionViews.value(session->peerId()).unread.isEmpty() )
+            color = "yellow";
+        contactSelected(x)->setStyleSheet("background-color: " + color + ";");
+        contactSelected(x)->setVisible(1);
+    }
+}
+
+CallSession *MainWindow::freeSession()
+{
+    for (CallSession *session : m_sessions) {
+        if ( session->state() == CallSession::Idle )
+            return session;
+    }
+    CallSession *session = new CallSession(m_serviceControl, m_telemetry, &m_callTrace, this);
+    session->setLocalNode(nodes.myNodeId, nodes.myNodeIp, nodes.myNodeName);
+    connect(session, SIGNAL(command(QString)), this, SLOT(fifoWrite(QString)));
+    connect(session, SIGNAL(stateChanged(CallSession::State,CallSession::State)),
+            this, SLOT(callStateChanged(CallSession::State,CallSession::State)));
+    connect(session, SIGNAL(failed(QString)), this, SLOT(callFailed(QString)));
+    m_sessions.append(session);
+    return session;
+}
+
+CallSession *MainWindow::sessionForPeer(const QString &nodeId)
+{
+    for (CallSession *session : m_sessions) {
+        if ( session->state() != CallSession::Idle && session->peerId() == nodeId )
+            return session;
+    }
+    return nullptr;
+}
+
+/* Telemetry lines carry the peer's node address, peer UI messages may
+   carry its tunnel address. Fixed tunnel addresses are shared by all
+   sessions of a role, the one shown wins. */
+CallSession *MainWindow::sessionForIp(const QString &ip)
+{
+    if ( ip.isEmpty() )
+        return nullptr;
+    if ( m_call->state() != CallSession::Idle && (m_call->peerIp() == ip || m_call->otpPeerIp() == ip) )
+        return m_call;
+    for (CallSession *session : m_sessions) {
+        if ( session->state() != CallSession::Idle && (session->peerIp() == ip || session->otpPeerIp() == ip) )
+            return session;
+    }
+    return nullptr;
+}
+
+CallSession *MainWindow::audioSession()
+{
+    for (CallSession *session : m_sessions) {
+        if ( session->hasAudio() )
+            return session;
+    }
+    return nullptr;
+}
+
+bool MainWindow::anySessionLive()
+{
+    for (CallSession *session : m_sessions) {
+        if ( session->state() != CallSession::Idle )
+            return true;
+    }
+    return false;
+}
+
+/* Show another session, the others keep running */
+void MainWindow::setCurrentSession(CallSession *session)
+{
+    m_call = session;
+    if ( session->peerId() != m_shownPeer ) {
+        if ( !m_shownPeer.isEmpty() ) {
+            SessionView &shown = m_sessionViews[m_shownPeer];
+            shown.history = ui->messagesView->toHtml();
+            shown.keyText = ui->keyPrecentage->text();
         }
+        SessionView view = m_sessionViews.take(session->peerId());
+        m_shownPeer = session->peerId();
+        ui->messagesView->setHtml(view.history);
+        for (const QString &line : view.unread)
+            ui->messagesView->append(line);
+        ui->keyPrecentage->setText(view.keyText);
+        ui->lineEdit->clear();
+    }
+    renderCallControls();
+    renderContacts();
+}
+
+/* Buttons and popup for the session shown */
+void MainWindow::renderCallControls()
+{
+    CallSession::State state = m_call->state();
+    bool client = m_call->role() == CallSession::Client;
+    ui->redButton->setStyleSheet(state == CallSession::Idle ? s_terminateButtonStyle_normal
+                                                            : s_terminateButtonStyle_highlight);
+    ui->greenButton->setStyleSheet(client ? s_goSecureButtonStyle_highlight : s_goSecureButtonStyle_normal);
+    ui->greenButton->setEnabled(client && state == CallSession::Connected);
+    bool voice = !client && (state == CallSession::Answering || state == CallSession::Active);
+    ui->inComingFrame->setVisible(voice);
+    ui->answerButton->setEnabled(!voice);
+    ui->answerButton->setVisible(!voice);
+    if ( voice ) {
+        ui->incomingTitleFrame->setText("Voice active!");
+        ui->denyButton->setText("Hangup");
+    }
+    if ( state == CallSession::Idle )
+        updateCallStatusIndicator(uiElement.secureVoiceInactiveNotify, "green", "transparent",INDICATE_ONLY);
+    else if ( state == CallSession::Active )
+        updateCallStatusIndicator("Audio active", "lightgreen", "transparent",INDICATE_ONLY);
+    else
+        updateCallStatusIndicator(m_call->peerName().isEmpty() ? m_call->peerId() : m_call->peerName(),
+                                  "lightgreen", "transparent",INDICATE_ONLY);
+}
+
+/* Messages of a session not shown wait for it */
+void MainWindow::appendMessage(CallSession *session, const QString &text)
+{
+    if ( session == m_call || session->state() == CallSession::Idle ) {
+        ui->messagesView->append(text);
+        return;
+    }
+    m_sessionViews[session->peerId()].unread.append(text);
+    renderContacts();
 }
 
 void MainWindow::scanPeers()
@@ -768,29 +1085,33 @@ void MainWindow::scanPeers()
 
 MainWindow::~MainWindow()
 {
-    /* TODO:
-     if (m_fd >= 0)
-      close(m_fd);*/
     fifoIn.close();
     msgFifoIn.close();
+    delete m_settingsUi;
+    delete m_imageUi;
     delete ui;
 }
 
 void MainWindow::loadSettings()
 {
     int myOwnNodeId;
-    QSettings settings(SETTINGS_INI_FILE,QSettings::IniFormat);
+    ConfigSnapshotPtr config = m_configLoader->snapshot();
     /* Get own node information */
-    nodes.myNodeId = settings.value("my_id").toString();
-    nodes.myNodeIp = settings.value("my_ip").toString();
-    nodes.myNodeName = settings.value("my_name").toString();
+    nodes.myNodeId = config->myNodeId;
+    nodes.myNodeIp = config->myNodeIp;
+    nodes.myNodeName = config->myNodeName;
+    for (CallSession *session : m_sessions)
+        session->setLocalNode(nodes.myNodeId, nodes.myNodeIp, nodes.myNodeName);
     ui->myNodeName->setText(nodes.myNodeName);
     /* Get nodes */
     for (int x=0; x < NODECOUNT; x++ ) {
-        nodes.node_name[x] = settings.value("node_name_"+QString::number(x), "").toString();
-        nodes.node_ip[x] = settings.value("node_ip_"+QString::number(x), "").toString();
-        nodes.node_id[x] = settings.value("node_id_"+QString::number(x), "").toString();
+        nodes.node_name[x] = config->nodeName[x];
+        nodes.node_ip[x] = config->nodeIp[x];
+        nodes.node_id[x] = config->nodeId[x];
+        nodes.node_otp_ip[x] = config->nodeOtpIp[x];
     }
+    m_prewarm->setPeers(QStringList(nodes.node_id, nodes.node_id + NODECOUNT),
+                        QStringList(nodes.node_ip, nodes.node_ip + NODECOUNT));
     /* Change button titles */
     ui->contact1Button->setText( nodes.node_name[0] );
     ui->contact2Button->setText( nodes.node_name[1] );
@@ -820,28 +1141,27 @@ void MainWindow::loadSettings()
                  ui->contact6Button->setDisabled(true);
          }
     }
-    /* Get connection profile from INI file */
+    /* Get connection profile */
     loadConnectionProfile();
     /* Get connection points */
     for (int x=0; x < CONNPOINTCOUNT; x++ ) {
-        nodes.connectionPointName[x] = settings.value("conn_point_name_"+QString::number(x), "").toString();
-        ui->route1Button->setText(nodes.connectionPointName[0]);
-        ui->route2Button->setText(nodes.connectionPointName[1]);
-        ui->route3Button->setText(nodes.connectionPointName[2]);
+        nodes.connectionPointName[x] = config->connectionPointName[x];
     }
+    ui->route1Button->setText(nodes.connectionPointName[0]);
+    ui->route2Button->setText(nodes.connectionPointName[1]);
+    ui->route3Button->setText(nodes.connectionPointName[2]);
     /* Get connection gateway IP and PORT to settings page */
-    QSettings connectionSettings(WG_CONFIGURATION_FILE,QSettings::IniFormat);
-    QString connectionIp = connectionSettings.value("WireGuardPeer/Endpoint").toString();
-    ui->gatewayIpPortInput->setText(connectionIp);
-    ui->saveGatewayButton->setStyleSheet(m_buttonNormalStyle);
-    ui->saveGatewayButton->setEnabled(false);
+    if ( m_settingsUi ) {
+        m_settingsUi->gatewayIpPortInput->setText(config->gatewayEndpoint);
+        m_settingsUi->saveGatewayButton->setStyleSheet(m_buttonNormalStyle);
+        m_settingsUi->saveGatewayButton->setEnabled(false);
+    }
 }
 
 
 void MainWindow::loadConnectionProfile()
 {
-    QSettings settings(SETTINGS_INI_FILE,QSettings::IniFormat);
-    nodes.connectionProfile = settings.value("connection_profile","wan").toString();
+    nodes.connectionProfile = m_configLoader->snapshot()->connectionProfile;
     if ( nodes.connectionProfile == "wan" )
     {
         ui->route1Selected->setVisible(1);
@@ -856,6 +1176,29 @@ void MainWindow::loadConnectionProfile()
     }
 }
 
+/* Configuration file changed on disk. Preferences with unsaved local
+   changes are not overwritten, they'll be written back shortly. */
+void MainWindow::configChanged(ConfigSnapshotPtr config, const QStringList &files)
+{
+    qDebug() << "Configuration reloaded (" << config->generation << "):" << files;
+    if ( files.contains(SETTINGS_INI_FILE) || files.contains(WG_CONFIGURATION_FILE) ) {
+        loadSettings();
+    }
+    /* Preference files are only reported for external edits, merged
+       under our unsaved values */
+    if ( files.contains(USER_PREF_INI_FILE) ) {
+        /* F3 countdown overrides beep until released */
+        bool countdownActive = m_startMode == UI_MODE && countdownTimer->isActive();
+        QString beepActive = nodes.beepActive;
+        loadUserPreferences();
+        if ( countdownActive )
+            nodes.beepActive = beepActive;
+    }
+    if ( files.contains(UI_ELEMENTS_INI_FILE) ) {
+        loadUserInterfacePreferences();
+    }
+}
+
 void MainWindow::saveAndActivateConnectionProfile(QString profile)
 {
     if ( profile == "wan" || profile == "lan")
@@ -867,7 +1210,7 @@ void MainWindow::saveAndActivateConnectionProfile(QString profile)
     if ( profile == "wan" )
     {
         qint64 pid;
-        QProcess process;
+        SpawnedProcess process;
         process.setProgram("/opt/tunnel/wan-config.sh");
         process.setArguments({""});
         process.setStandardOutputFile(QProcess::nullDevice());
@@ -877,7 +1220,7 @@ void MainWindow::saveAndActivateConnectionProfile(QString profile)
     if ( profile == "lan")
     {
         qint64 pid;
-        QProcess process;
+        SpawnedProcess process;
         process.setProgram("/opt/tunnel/lan-config.sh");
         process.setArguments({""});
         process.setStandardOutputFile(QProcess::nullDevice());
@@ -887,71 +1230,59 @@ void MainWindow::saveAndActivateConnectionProfile(QString profile)
 }
 
 /*
- * Set system volume with external process.
+ * Set system volume through the in-process mixer.
  * Only playback volume is adjusted.
  */
 void MainWindow::setSystemVolume(int volume)
 {
-    /* Playback volume:     amixer sset [DEVICENAME] 100%
-       Microphone volume:   amixer sset [DEVICENAME] Capture 5%+ */
-
-    QString volumePercentString = QString::number(volume) + "%";
-    qint64 pid;
-    QProcess process;
-    process.setProgram("/usr/bin/amixer");
-    process.setArguments({"sset","'"+uiElement.audioMixerOutputDevice+"'",volumePercentString});
-    process.setStandardOutputFile(QProcess::nullDevice());
-    process.setStandardErrorFile(QProcess::nullDevice());
-    process.startDetached(&pid);
+    m_mixer->setVolume(volume);
 }
 
 void MainWindow::loadUserPreferences()
 {
-    QSettings settings(USER_PREF_INI_FILE,QSettings::IniFormat);
-    uPref.volumeValue = settings.value("volume","70").toString();
-    setSystemVolume( uPref.volumeValue.toInt() );
-    nodes.beepActive = settings.value("beep").toString();
-    uPref.m_pinCode = settings.value("pincode","1234").toString();
-    uPref.m_settingsPinCode = settings.value("settings_pincode","4321").toString();
-    uPref.m_autoerase = settings.value("autoerase","true").toString();
-    if ( uPref.m_autoerase == "true") {
-        ui->autoeraseCheckbox->setChecked(true);
-    }
-    if ( uPref.m_autoerase == "false") {
-        ui->autoeraseCheckbox->setChecked(false);
+    ConfigSnapshotPtr config = m_configLoader->snapshot();
+    uPref.volumeValue = QString::number(config->volume);
+    setSystemVolume( config->volume );
+    nodes.beepActive = config->beepActive ? "1" : "0";
+    uPref.m_pinCode = config->pinCode;
+    uPref.m_settingsPinCode = config->settingsPinCode;
+    uPref.m_autoerase = config->autoerase ? "true" : "false";
+    m_prewarm->setBudget(config->prewarmPeers, config->prewarmIdle);
+    m_prewarm->setEnabled(config->prewarm);
+    if ( m_settingsUi ) {
+        m_settingsUi->autoeraseCheckbox->setChecked(uPref.m_autoerase == "true");
     }
 }
 void MainWindow::saveUserPreferences()
 {
-    QSettings settings(USER_PREF_INI_FILE,QSettings::IniFormat);
-    settings.setValue("volume", uPref.volumeValue);
+    m_userPrefStore->setValue("volume", uPref.volumeValue);
     setSystemVolume( uPref.volumeValue.toInt() );
 }
 
 void MainWindow::saveUserPreferencesBeep(QString value)
 {
-    QSettings settings(USER_PREF_INI_FILE,QSettings::IniFormat);
-    settings.setValue("beep", value);
-    nodes.beepActive = settings.value("beep").toString();
+    m_userPrefStore->setValue("beep", value);
+    nodes.beepActive = value;
 }
 
 /* TODO: Add new elements to INI */
 void MainWindow::loadUserInterfacePreferences()
 {
-    QSettings settings(UI_ELEMENTS_INI_FILE,QSettings::IniFormat);
-    uiElement.messagingTitle = settings.value("message_title","Messaging:").toString();
-    uiElement.commCheckButton = settings.value("commcheck_button","COMM CHECK").toString();
-    uiElement.eraseButton = settings.value("erase_button","ERASE").toString();
-    uiElement.secureVoiceInactiveNotify = settings.value("voice_inactive_notify","SECURE VOICE INACTIVE").toString();
-    uiElement.secureVoiceActiveNotify = settings.value("voice_active_notify","SECURE VOICE ACTIVE").toString();
-    uiElement.goSecureButton = settings.value("go_secure_button","Go Secure").toString();
-    uiElement.terminateSecureButton = settings.value("terminate_secure_button","Terminate").toString();
-    uiElement.systemName = settings.value("system_name","CommUnit").toString();
-    uiElement.pinEntryTitleVault = settings.value("pintitle_vault","Enter vault PIN").toString();
-    uiElement.pinEntryTitleVaultChecking = settings.value("pintitle_vault_check","Checking...").toString();
-    uiElement.pinEntryTitleAccessPin = settings.value("pintitle_access","Set calibration data:").toString();
-    uiElement.cameraButtonVisible = settings.value("cam_enabled",false).toBool();
-    uiElement.audioMixerOutputDevice = settings.value("audio_device","PCM").toString();
+    ConfigSnapshotPtr config = m_configLoader->snapshot();
+    uiElement.messagingTitle = config->messagingTitle;
+    uiElement.commCheckButton = config->commCheckButton;
+    uiElement.eraseButton = config->eraseButton;
+    uiElement.secureVoiceInactiveNotify = config->secureVoiceInactiveNotify;
+    uiElement.secureVoiceActiveNotify = config->secureVoiceActiveNotify;
+    uiElement.goSecureButton = config->goSecureButton;
+    uiElement.terminateSecureButton = config->terminateSecureButton;
+    uiElement.systemName = config->systemName;
+    uiElement.pinEntryTitleVault = config->pinEntryTitleVault;
+    uiElement.pinEntryTitleVaultChecking = config->pinEntryTitleVaultChecking;
+    uiElement.pinEntryTitleAccessPin = config->pinEntryTitleAccessPin;
+    uiElement.cameraButtonVisible = config->cameraButtonVisible;
+    uiElement.audioMixerOutputDevice = config->audioMixerOutputDevice;
+    m_mixer->setElement(uiElement.audioMixerOutputDevice);
     ui->systemNameLabel->setText(uiElement.systemName);
     ui->messagingTitle->setText(uiElement.messagingTitle);
     ui->commCheckButton->setText(uiElement.commCheckButton);
@@ -959,7 +1290,8 @@ void MainWindow::loadUserInterfacePreferences()
     ui->greenButton->setText(uiElement.goSecureButton);
     ui->redButton->setText(uiElement.terminateSecureButton);
     ui->pinEntryTitle->setText(uiElement.pinEntryTitleAccessPin);
-    ui->audioDeviceInput->setText(uiElement.audioMixerOutputDevice);
+    if ( m_settingsUi )
+        m_settingsUi->audioDeviceInput->setText(uiElement.audioMixerOutputDevice);
 
     if ( uiElement.cameraButtonVisible ) {
         ui->camButton->setVisible(1);
@@ -969,50 +1301,17 @@ void MainWindow::loadUserInterfacePreferences()
 }
 
 
-/* Timeout for FIFO replies */
-int MainWindow::waitForFifoReply() {
-    g_fifoCheckInProgress = true;
-    fifoReplyTimer = new QTimer(this);
-    fifoReplyTimer->start(10000); // 10 s
-    connect(fifoReplyTimer, SIGNAL(timeout()), this, SLOT(checkFifoReplyTimeout()) );
-
-        while ( g_fifoReply == "" && g_fifoCheckInProgress == true ) {
-            QCoreApplication::processEvents();
-            if ( g_fifoReply != "" ) {
-                fifoReplyTimer->stop();
-                return FIFO_REPLY_RECEIVED;
-            }
-        }
-
-    if ( g_fifoReply == "" && g_fifoCheckInProgress == false )
-        return FIFO_TIMEOUT;
-}
-
-int MainWindow::checkFifoReplyTimeout() {
-    g_fifoCheckInProgress = false;
-    fifoReplyTimer->stop();
-    return 0;
-}
-
-
 /* 'Go Secure' button */
 void MainWindow::on_greenButton_clicked()
 {
     screenBlanktimer->start(BLACK_OUT_TIME);
-    updateCallStatusIndicator("Waiting remote", "lightgreen","transparent",INDICATE_ONLY);
-    /* Send telemetry 'ring' -> ring_ready */
-    QString callString = g_connectedNodeIp + ",ring";
-    fifoWrite( callString );
-
-    // Wait FIFO with timeout
-    if ( waitForFifoReply() == FIFO_TIMEOUT ) {
-        updateCallStatusIndicator("Timeout. Aborting.", "green", "transparent",LOG_ONLY );
+    /* Telemetry 'ring' -> ring_ready, then 'ring' to the peer UI */
+    CallSession *audio = audioSession();
+    if ( audio && audio != m_call ) {
+        updateCallStatusIndicator("Voice busy (" + audio->peerId() + ")", "green", "transparent",LOG_ONLY );
         return;
     }
-
-    /* Send 'ring' to UI */
-    callString = g_connectedNodeIp + ",message,ring";
-    fifoWrite( callString );
+    m_call->goSecure();
 }
 
 /* 'Terminate' button */
@@ -1020,29 +1319,26 @@ void MainWindow::on_redButton_clicked()
 {
     screenBlanktimer->start(BLACK_OUT_TIME);
     updateCallStatusIndicator("Terminating...", "lightgreen", "transparent",INDICATE_ONLY );
-    ui->contact1Selected->setVisible(0);
-    ui->contact2Selected->setVisible(0);
-    ui->contact3Selected->setVisible(0);
-    ui->contact4Selected->setVisible(0);
-    ui->contact5Selected->setVisible(0);
-    ui->contact6Selected->setVisible(0);
-    // setContactButtons(true);
-
-    if ( g_connectState )
-        disconnectAsClient(g_connectedNodeIp, g_connectedNodeId);
-
-    /* Local FIFO commands don't have ACK */
-    QTimer::singleShot(6 * 1000, this, SLOT(tearDownLocal()));
 
-    updateCallStatusIndicator("Please wait...", "lightgreen", "transparent",LOG_AND_INDICATE);
+    /* Ends the session shown only. Local teardown follows in
+       callStateChanged() to Idle, as soon as the tunnel is really down */
+    if ( m_call->state() == CallSession::Idle ) {
+        tearDownLocal();
+    } else {
+        updateCallStatusIndicator("Please wait...", "lightgreen", "transparent",LOG_AND_INDICATE);
+        if ( m_call->role() == CallSession::Server )
+            m_call->hangup();
+        else
+            m_call->terminate();
+    }
     ui->keyPrecentage->setText("");
     ui->redButton->setStyleSheet(s_terminateButtonStyle_normal);
     ui->greenButton->setStyleSheet(s_goSecureButtonStyle_normal);
     ui->greenButton->setEnabled(false);
     if ( uPref.m_autoerase == "true") {
-        on_eraseButton_clicked();
+        eraseSession(m_call);
     }
-    beepBuzzer(10);
+    beepBuzzer(Buzzer::Notify);
 }
 
 void MainWindow::tearDownLocal()
@@ -1079,38 +1375,32 @@ void MainWindow::on_route3Button_clicked()
 
 void MainWindow::on_contact1Button_clicked()
 {
-    QString scanCmd = nodes.node_ip[0] + ",status";
-    fifoWrite(scanCmd);
+    contactTapped(nodes.node_ip[0]);
 }
 
 void MainWindow::on_contact2Button_clicked()
 {
-    QString scanCmd = nodes.node_ip[1] + ",status";
-    fifoWrite(scanCmd);
+    contactTapped(nodes.node_ip[1]);
 }
 
 void MainWindow::on_contact3Button_clicked()
 {
-    QString scanCmd = nodes.node_ip[2] + ",status";
-    fifoWrite(scanCmd);
+    contactTapped(nodes.node_ip[2]);
 }
 
 void MainWindow::on_contact4Button_clicked()
 {
-    QString scanCmd = nodes.node_ip[3] + ",status";
-    fifoWrite(scanCmd);
+    contactTapped(nodes.node_ip[3]);
 }
 
 void MainWindow::on_contact5Button_clicked()
 {
-    QString scanCmd = nodes.node_ip[4] + ",status";
-    fifoWrite(scanCmd);
+    contactTapped(nodes.node_ip[4]);
 }
 
 void MainWindow::on_contact6Button_clicked()
 {
-    QString scanCmd = nodes.node_ip[5] + ",status";
-    fifoWrite(scanCmd);
+    contactTapped(nodes.node_ip[5]);
 }
 
 void MainWindow::on_volumeSlider_valueChanged(int value)
@@ -1119,106 +1409,217 @@ void MainWindow::on_volumeSlider_valueChanged(int value)
     saveUserPreferences();
 }
 
-void MainWindow::on_pwrButton_clicked()
+void MainWindow::on_pwrButton_clicked()
+{
+    /* Pending preference writes before power off */
+    m_userPrefStore->flush();
+    m_uiPrefStore->flush();
+    qint64 pid;
+    SpawnedProcess process;
+    process.setProgram("/sbin/poweroff");
+    process.setArguments({"-f"});
+    process.startDetached(&pid);
+}
+
+void MainWindow::on_commCheckButton_clicked()
+{
+    screenBlanktimer->start(BLACK_OUT_TIME);
+    if ( m_call->isConnected() ) {
+        QString fifo_command = m_call->otpPeerIp() + ",message,Ping";
+        fifoWrite(fifo_command);
+    }
+}
+
+/* Erase button and F3: everything kept in RAM, the stored messages of
+   sessions not shown included, and the files left behind */
+void MainWindow::on_eraseButton_clicked()
+{
+    ui->messagesView->clear();
+    ui->lineEdit->clear();
+    m_sessionViews.clear();
+    renderContacts();
+    eraseShared();
+}
+
+/* The session shown has ended: its messages and voice clips go. What
+   all peers share goes once no other session is live. */
+void MainWindow::eraseSession(CallSession *session)
+{
+    ui->messagesView->clear();
+    ui->lineEdit->clear();
+    m_voice->clear(session->otpPeerIp());
+    if ( m_pictureLastPeer == session->otpPeerIp() )
+        m_pictureLastSent.clear();
+    for (CallSession *other : m_sessions) {
+        if ( other != session && other->state() != CallSession::Idle )
+            return;
+    }
+    eraseShared();
+}
+
+void MainWindow::eraseShared()
+{
+    m_gallery->clear();
+    m_galleryShownId = 0;
+    /* Picture files outside the gallery */
+    QFile::remove(IMAGE_TRANSFERRED_FILE);
+    QFile::remove(CAMERA_SHM_FILE);
+    QFile::remove(CAMERA_PIC_FILE);
+    QFile::remove(PICTURE_SEND_FILE);
+    m_pictureLastSent.clear();
+    m_imageDelta->clear();
+    m_prewarm->clearHistory();
+    /* Phase latencies name the peers called */
+    m_callTrace.clear();
+    QFile::remove(CALL_TRACE_FILE);
+    renderCallTrace();
+    m_voice->clear();
+    if ( m_imageUi )
+        m_imageUi->imageFramePictureLabel->clear();
+}
+
+/* Send Message over OTP Channel */
+void MainWindow::on_lineEdit_returnPressed()
+{
+    screenBlanktimer->start(BLACK_OUT_TIME);
+    if ( m_call->isConnected() ) {
+        QString msg_line = ui->lineEdit->text();
+        /* TODO: Check lenght */
+        ui->messagesView->append("<font color='white'>" + msg_line + "</font>");
+        msg_line.replace( ",", QChar(SUBSTITUTE_CHAR_CODE) );
+        QString fifo_command = m_call->otpPeerIp() + ",message," + msg_line;
+        qDebug() << "on_lineEdit_returnPressed(): " << fifo_command;
+        fifoWrite(fifo_command);
+        ui->lineEdit->clear();
+    }
+}
+
+/* Voice message: record while the button is held. Like text, only
+   to a connected peer, the clip is bound to it. */
+void MainWindow::on_voiceButton_pressed()
+{
+    screenBlanktimer->start(BLACK_OUT_TIME);
+    if ( !m_call->isConnected() )
+        return;
+    ui->voiceButton->setText("REC");
+    m_voicePeer = m_call->otpPeerIp();
+    m_voiceRecorder->record();
+}
+
+void MainWindow::on_voiceButton_released()
+{
+    ui->voiceButton->setText("Voice");
+    m_voiceRecorder->stop();
+}
+
+static QString voiceLink(int id, int durationMs, const QString &color)
+{
+    return QString("<a href='voice:%1' style='color:%2'>&#9654; Voice %3 s</a>")
+            .arg(id).arg(color).arg((durationMs + 500) / 1000);
+}
+
+/* For the peer shown when recording started. Disconnected since:
+   kept in the outbox until that peer connects again. */
+void MainWindow::voiceRecorded(const QByteArray &clip, int durationMs)
+{
+    if ( clip.isEmpty() || m_voicePeer.isEmpty() )
+        return;
+    CallSession *session = sessionForIp(m_voicePeer);
+    if ( !session )
+        session = m_call;
+    int id = m_voice->send(m_voicePeer, clip, durationMs);
+    appendMessage(session, voiceLink(id, durationMs, "white") + (session->isConnected() ? "" : " (queued)"));
+}
+
+void MainWindow::voiceMessageOut(const QString &peer, const QString &payload)
+{
+    fifoWrite(peer + ",message," + payload);
+}
+
+void MainWindow::voiceReceived(const QString &peer, int id, int durationMs)
 {
-    qint64 pid;
-    QProcess process;
-    process.setProgram("/sbin/poweroff");
-    process.setArguments({"-f"});
-    process.startDetached(&pid);
+    CallSession *session = sessionForIp(peer);
+    appendMessage(session ? session : m_call, voiceLink(id, durationMs, "lightgreen"));
+    beepBuzzer(Buzzer::Notify);
 }
 
-void MainWindow::on_commCheckButton_clicked()
+void MainWindow::voiceReceiveFailed(const QString &peer, const QString &error)
 {
-    screenBlanktimer->start(BLACK_OUT_TIME);
-    if ( g_connectState ) {
-        QString fifo_command = g_remoteOtpPeerIp + ",message,Ping";
-        fifoWrite(fifo_command);
-    }
+    CallSession *session = sessionForIp(peer);
+    appendMessage(session ? session : m_call, "[SYSTEM]: Voice " + error);
 }
 
-void MainWindow::on_eraseButton_clicked()
+void MainWindow::voiceFailed(const QString &error)
 {
-    ui->messagesView->clear();
-    ui->lineEdit->clear();
+    ui->messagesView->append("[SYSTEM]: Voice " + error);
 }
 
-/* Send Message over OTP Channel */
-void MainWindow::on_lineEdit_returnPressed()
+void MainWindow::on_messagesView_anchorClicked(const QUrl &url)
 {
-    screenBlanktimer->start(BLACK_OUT_TIME);
-    if ( g_connectState ) {
-        QString msg_line = ui->lineEdit->text();
-        /* TODO: Check lenght */
-        ui->messagesView->append("<font color='white'>" + msg_line + "</font>");
-        msg_line.replace( ",", QChar(SUBSTITUTE_CHAR_CODE) );
-        QString fifo_command = g_remoteOtpPeerIp + ",message," + msg_line;
-        qDebug() << "on_lineEdit_returnPressed(): " << fifo_command;
-        fifoWrite(fifo_command);
-        ui->lineEdit->clear();
-    }
+    if ( url.scheme() == "voice" )
+        m_voicePlayer->play(m_voice->clip(url.path().toInt()));
 }
 
 /* PIN Entry buttons */
 void MainWindow::on_pinButton_clear_clicked()
 {
    ui->codeValue->setText("");
-   beepBuzzer(20);
+   beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_1_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"1");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_2_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"2");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_3_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"3");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_4_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"4");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_5_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"5");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_6_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"6");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_7_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"7");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_8_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"8");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_9_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"9");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_a_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"A");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_b_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"B");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 
 int MainWindow::on_pinButton_c_clicked()
@@ -1226,34 +1627,33 @@ int MainWindow::on_pinButton_c_clicked()
     if ( m_startMode == UI_MODE ) {
         if ( ui->codeValue->text() == uPref.m_settingsPinCode ) {
             /* Get connection gateway IP and PORT to settings page */
-            QSettings connectionSettings(WG_CONFIGURATION_FILE,QSettings::IniFormat);
-            QString connectionIp = connectionSettings.value("WireGuardPeer/Endpoint").toString();
-            ui->gatewayIpPortInput->setText(connectionIp);
-            ui->saveGatewayButton->setStyleSheet(m_buttonNormalStyle);
-            ui->saveGatewayButton->setEnabled(false);
-            ui->settingsFrame->setVisible(true);
+            Ui::SettingsFrame *settings = settingsUi();
+            settings->gatewayIpPortInput->setText(m_configLoader->snapshot()->gatewayEndpoint);
+            settings->saveGatewayButton->setStyleSheet(m_buttonNormalStyle);
+            settings->saveGatewayButton->setEnabled(false);
+            renderWifiNetworks();
+            m_wifiScanner->setActive(true);
+            m_settingsFrame->setVisible(true);
             ui->logoLabel->setVisible(false);
             return 0;
         }
         if ( ui->codeValue->text() == uPref.m_pinCode ) {
              ui->codeFrame->setVisible(false);
-             beepBuzzer(20);
+             beepBuzzer(Buzzer::KeyClick);
              return 0;
         } else {
             ui->codeValue->setText("");
-            beepBuzzer(20);
+            beepBuzzer(Buzzer::Error);
             return 0;
         }
     } else {
         /* VAULT mode */
         QString vaultPinCode = ui->codeValue->text();
         if ( vaultPinCode.length() > 3 ) {
-            vaultOpenProcess.connect(&vaultOpenProcess,
-                    &QProcess::readyReadStandardOutput,
-                    this, &MainWindow::onVaultProcessReadyReadStdOutput);
-            vaultOpenProcess.connect(&vaultOpenProcess,
-                    (void (QProcess::*)(int,QProcess::ExitStatus))&QProcess::finished,
-                    this, &MainWindow::onVaultProcessFinished);
+            connect(&vaultOpenProcess, &SpawnedProcess::readyReadStandardOutput,
+                    this, &MainWindow::onVaultProcessReadyReadStdOutput, Qt::UniqueConnection);
+            connect(&vaultOpenProcess, &SpawnedProcess::finished,
+                    this, &MainWindow::onVaultProcessFinished, Qt::UniqueConnection);
 
             ui->pinEntryTitle->setText(uiElement.pinEntryTitleVaultChecking);
             ui->codeValue->setText("");
@@ -1271,10 +1671,10 @@ int MainWindow::on_pinButton_c_clicked()
 
 void MainWindow::onVaultProcessReadyReadStdOutput()
 {
-    vaultOpenProcess.setReadChannel(QProcess::StandardOutput);
-    QTextStream stream(&vaultOpenProcess);
-    while (!stream.atEnd()) {
-       QString line = stream.readLine();
+    const QList<QByteArray> lines = vaultOpenProcess.readAllStandardOutput().split('\n');
+    for (const QByteArray &line : lines) {
+       if (line.isEmpty())
+           continue;
        ui->countLabel->setText(QString("<span style=\"font-size:68pt; color:#00dd00;\">★ OK ★</span>"));
        QTimer::singleShot(2 * 1000, this, SLOT(exitVaultOpenProcess()));
     }
@@ -1305,12 +1705,12 @@ void MainWindow::onVaultProcessFinished()
 void MainWindow::on_pinButton_0_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"0");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 void MainWindow::on_pinButton_hash_clicked()
 {
     ui->codeValue->setText(ui->codeValue->text()+"#");
-    beepBuzzer(20);
+    beepBuzzer(Buzzer::KeyClick);
 }
 
 void MainWindow::updateCallStatusIndicator(QString text, QString fontColor, QString backgroundColor, int logMethod )
@@ -1334,125 +1734,138 @@ void MainWindow::updateCallStatusIndicator(QString text, QString fontColor, QStr
     }
 }
 
-/* Outbound connection */
+/* Outbound connection, 'available' reply to a contact tap */
 void MainWindow::connectAsClient(QString nodeIp, QString nodeId)
 {
     screenBlanktimer->start(BLACK_OUT_TIME);
-    /* 1. Send 'prepare' to recipient via FIFO */
-    QString prepareFifoCmd = nodeIp + ",prepare";
-    fifoWrite(prepareFifoCmd);
-
-        // Wait FIFO with timeout
-        if ( waitForFifoReply() == FIFO_TIMEOUT ) {
-            updateCallStatusIndicator("Timeout. Aborting.", "green", "transparent",LOG_ONLY );
-            return;
-        }
-
-    /* 2. Start local service for targeted node as client */
-    QString serviceNameAsClient = "connect-with-"+nodeId+"-c.service";
-    qDebug() << "Starting service: " << serviceNameAsClient;
-    qint64 pid;
-    QProcess process;
-    process.setProgram("systemctl");
-    process.setArguments({"start",serviceNameAsClient});
-    process.startDetached(&pid);
-
-    /* 3. Touch local file */
-    touchLocalFile("/tmp/CLIENT_CALL_ACTIVE");
-
-    /* Now we should have OTP connectivity ready */
-    g_connectState = true;
-    g_connectedNodeId = nodeId;
-    g_connectedNodeIp = nodeIp;
-
-    /* 4. Indicate yellow state on status */
-    updateCallStatusIndicator("OTP connected", "lightgreen", "transparent",INDICATE_ONLY);
-
-    /* We should highlight Go Secure and Terminate at initiator end (TODO) */
-    ui->redButton->setStyleSheet(s_terminateButtonStyle_highlight);
-    ui->greenButton->setStyleSheet(s_goSecureButtonStyle_highlight);
-    ui->greenButton->setEnabled(true);
-
-    /* We should disable Peer keys when connected */
-    setContactButtons(false);
-
-    /* 5. Set fixed remote IP based on client role of connection */
-    g_remoteOtpPeerIp = "10.10.0.1";
-
-    /* 6. Indicate remote peer UI that we're connected WORK IN PROGRESS!! */
-    QString informRemoteUi = nodeIp + ",message,client_connected;"+nodes.myNodeId+";"+nodes.myNodeIp+";"+nodes.myNodeName;
-    fifoWrite(informRemoteUi);
-
-    // Wait FIFO with timeout
-    if ( waitForFifoReply() == FIFO_TIMEOUT ) {
-        updateCallStatusIndicator("Timeout. Aborting.", "green", "transparent",LOG_ONLY );
-        return;
-    }
-
-    // 7. Audio gets established by remote end sending 'answer'
-    // 8. After termination => terminate_ready
+    CallSession *session = freeSession();
+    int nodeNumber = nodeIndex(nodeIp);
+    session->setOtpPeerIp(nodeNumber < 0 ? QString() : nodes.node_otp_ip[nodeNumber]);
+    if ( session->connectTo(nodeIp, nodeId) )
+        m_prewarm->called(nodeId);
 }
 
-void MainWindow::disconnectAsClient(QString nodeIp, QString nodeId)
+/* UI follows the session shown, others only update their contact */
+void MainWindow::callStateChanged(CallSession::State state, CallSession::State previous)
 {
-    screenBlanktimer->start(BLACK_OUT_TIME);
-    /* 1. Terminate to FIFO */
-    QString terminateFifoCmd = nodeIp + ",terminate";
-    fifoWrite(terminateFifoCmd);
-
-    // Wait FIFO with timeout
-    if ( waitForFifoReply() == FIFO_TIMEOUT ) {
-        updateCallStatusIndicator("Timeout. Aborting.", "green", "transparent",LOG_ONLY );
+    CallSession *session = qobject_cast<CallSession *>(sender());
+    if ( !session )
         return;
-    }
-
-    /* 2. Terminate to UI (so remote can tear down indications) */
-    terminateFifoCmd = nodeIp + ",message,initiator_disconnect";
-    fifoWrite(terminateFifoCmd);
-
-    // Wait FIFO with timeout
-    if ( waitForFifoReply() == FIFO_TIMEOUT ) {
-        updateCallStatusIndicator("Timeout. Aborting.", "green", "transparent",LOG_ONLY );
+    /* Nothing to pre-warm during a call */
+    if ( previous == CallSession::Idle )
+        m_prewarm->cool();
+    /* Both ends start the next call with key frames */
+    if ( state == CallSession::Idle )
+        m_imageDelta->reset(session->otpPeerIp());
+    /* Voice clips flow per peer, whichever session is shown */
+    m_voice->setConnected(session->otpPeerIp(), session->isConnected());
+
+    /* Dialed sessions are shown at once, incoming ones when nothing is */
+    if ( previous == CallSession::Idle
+            && (session == m_call || session->role() == CallSession::Client
+                || m_call->state() == CallSession::Idle) )
+        setCurrentSession(session);
+
+    if ( session != m_call ) {
+        if ( state == CallSession::Incoming && previous == CallSession::Idle ) {
+            appendMessage(session, "[SYSTEM]: " + session->peerName() + " connected");
+            beepBuzzer(Buzzer::Notify);
+        }
+        if ( state == CallSession::Idle ) {
+            if ( uPref.m_autoerase == "true" )
+                m_sessionViews.remove(session->peerId());
+            sessionClosed();
+        }
+        renderContacts();
         return;
     }
 
-    /* 2. Stop local service for targeted node (as client) */
-    QString serviceNameAsClient = "connect-with-"+nodeId+"-c.service";
-    qint64 pid;
-    QProcess process;
-    process.setProgram("systemctl");
-    process.setArguments({"stop",serviceNameAsClient});
-    process.startDetached(&pid);
-
-    /* 3. Remove local status file */
-    removeLocalFile("/tmp/CLIENT_CALL_ACTIVE");
-
-    /*  4. Terminate Audio
-        'telemetryclient' knows how to terminate audio, based on how it's established (client or server)
-    */
-    QString terminateAudioFifoCmd = "127.0.0.1,disconnect_audio";
-    fifoWrite(terminateAudioFifoCmd);
-    g_connectState = false;
-    g_connectedNodeId = "";
-    g_connectedNodeIp = "";
-    g_remoteOtpPeerIp = "";
-
-    /* Erase msg history */
-    if ( uPref.m_autoerase == "true") {
-        on_eraseButton_clicked();
+    switch (state) {
+    case CallSession::Preparing:
+        updateCallStatusIndicator("Starting tunnel...", "lightgreen", "transparent",INDICATE_ONLY);
+        break;
+    case CallSession::Connected:
+        if ( previous != CallSession::Preparing )
+            break;
+        updateCallStatusIndicator("OTP connected", "lightgreen", "transparent",INDICATE_ONLY);
+        /* Highlight Go Secure and Terminate at initiator end */
+        ui->redButton->setStyleSheet(s_terminateButtonStyle_highlight);
+        ui->greenButton->setStyleSheet(s_goSecureButtonStyle_highlight);
+        ui->greenButton->setEnabled(true);
+        break;
+    case CallSession::Ringing:
+        updateCallStatusIndicator("Waiting remote", "lightgreen","transparent",INDICATE_ONLY);
+        break;
+    case CallSession::Incoming:
+        if ( previous != CallSession::Idle )
+            break;
+        updateCallStatusIndicator(m_call->peerName() + " connected" , "lightgreen","transparent",LOG_AND_INDICATE);
+        if (  backLightOn == false ) {
+            rampUp();
+        }
+        /* Inbound connection: highlight terminate and disable Go Secure */
+        ui->redButton->setStyleSheet(s_terminateButtonStyle_highlight);
+        ui->greenButton->setStyleSheet(s_goSecureButtonStyle_normal);
+        ui->greenButton->setEnabled(false);
+        beepBuzzer(Buzzer::Notify);
+        break;
+    case CallSession::Active:
+        if ( m_call->role() == CallSession::Client ) {
+            updateCallStatusIndicator("Audio active", "lightgreen", "transparent",INDICATE_ONLY);
+            break;
+        }
+        updateCallStatusIndicator("Audio connected", "green","transparent",INDICATE_ONLY);
+        ui->incomingTitleFrame->setText("Voice active!");
+        ui->answerButton->setEnabled(false);
+        ui->answerButton->setVisible(false);
+        ui->denyButton->setText("Hangup");
+        break;
+    case CallSession::Idle:
+        ui->inComingFrame->setVisible(false);
+        ui->answerButton->setEnabled(true);
+        ui->answerButton->setVisible(true);
+        ui->keyPrecentage->setText("");
+        ui->redButton->setStyleSheet(s_terminateButtonStyle_normal);
+        ui->greenButton->setStyleSheet(s_goSecureButtonStyle_normal);
+        ui->greenButton->setEnabled(false);
+        /* Erase msg history */
+        if ( uPref.m_autoerase == "true") {
+            eraseSession(m_call);
+        }
+        if ( m_call->role() == CallSession::Server )
+            updateCallStatusIndicator("Incoming Terminated", "green","transparent",LOG_ONLY);
+        else if ( anySessionLive() )
+            updateCallStatusIndicator("Terminated", "green","transparent",LOG_ONLY);
+        sessionClosed();
+        /* Show a session still running */
+        for (CallSession *other : m_sessions) {
+            if ( other->state() != CallSession::Idle ) {
+                setCurrentSession(other);
+                break;
+            }
+        }
+        break;
+    default:
+        break;
     }
+    renderContacts();
 }
 
-void MainWindow::touchLocalFile(QString filename)
+/* Session reached Idle. Local teardown waits for the last session,
+   the others share the local side. */
+void MainWindow::sessionClosed()
 {
-    QFile touchFile(filename);
-    touchFile.open( QIODevice::WriteOnly);
-    touchFile.close();
+    /* Written to CALL_TRACE_FILE only from the diagnostics page */
+    renderCallTrace();
+    if ( anySessionLive() )
+        return;
+    m_prewarm->wake();
+    tearDownLocal();
 }
-void MainWindow::removeLocalFile(QString filename)
+
+void MainWindow::callFailed(const QString &reason)
 {
-    QFile file (filename);
-    file.remove();
+    updateCallStatusIndicator(reason, "green", "transparent",LOG_ONLY );
 }
 
 /* Accept incoming call on "call in" popup */
@@ -1460,87 +1873,20 @@ void MainWindow::on_answerButton_clicked()
 {
     screenBlanktimer->start(BLACK_OUT_TIME);
     updateCallStatusIndicator("Accepted", "green","transparent",LOG_AND_INDICATE);
-
-    /* Send indication that we answered succesfully */
-    QString answerString = g_connectedNodeIp + ",message,answer_success";
-    fifoWrite( answerString );
-
-    // Wait FIFO with timeout
-    if ( waitForFifoReply() == FIFO_TIMEOUT ) {
-        updateCallStatusIndicator("Timeout. Aborting.", "green", "transparent",LOG_ONLY );
-        return;
-    }
-
-    /* Send answer to telemetry server */
-    answerString = g_connectedNodeIp + ",answer";
-    fifoWrite( answerString );
-
-    // Wait FIFO with timeout
-    if ( waitForFifoReply() == FIFO_TIMEOUT ) {
-        updateCallStatusIndicator("Timeout. Aborting.", "green", "transparent",LOG_ONLY );
+    /* answer_success to peer UI, answer to telemetry, then audio as server */
+    CallSession *audio = audioSession();
+    if ( audio && audio != m_call ) {
+        updateCallStatusIndicator("Voice busy (" + audio->peerId() + ")", "green", "transparent",LOG_ONLY );
         return;
     }
-
-    /* Connect audio as Server */
-    answerString = "127.0.0.1,connect_audio_as_server";
-    fifoWrite( answerString );
-
-    updateCallStatusIndicator("Audio connected", "green","transparent",INDICATE_ONLY);
-    ui->incomingTitleFrame->setText("Voice active!");
-    ui->answerButton->setEnabled(false);
-    ui->answerButton->setVisible(false);
-    ui->denyButton->setText("Hangup");
+    m_call->answer();
 }
 
 /* Deny button ('Hangup') on popup ( 'Client' terminates ) */
 void MainWindow::on_denyButton_clicked()
 {
     screenBlanktimer->start(BLACK_OUT_TIME);
-    /* Hangup to FIFO */
-    QString hangupCommandString = g_connectedNodeIp + ",hangup";
-    fifoWrite( hangupCommandString );
-
-    // Wait FIFO with timeout
-    if ( waitForFifoReply() == FIFO_TIMEOUT ) {
-        updateCallStatusIndicator("Timeout. Aborting.", "green", "transparent",LOG_ONLY );
-        return;
-    }
-
-    /* Turn off local audio */
-    hangupCommandString = "127.0.0.1,disconnect_audio";
-    fifoWrite( hangupCommandString );
-    updateCallStatusIndicator("Incoming Terminated", "green","transparent",LOG_AND_INDICATE);
-    ui->inComingFrame->setVisible(false);
-
-    /* Erase green status */
-    ui->contact1Selected->setVisible(0);
-    ui->contact2Selected->setVisible(0);
-    ui->contact3Selected->setVisible(0);
-    ui->contact4Selected->setVisible(0);
-    ui->contact5Selected->setVisible(0);
-    ui->contact6Selected->setVisible(0);
-
-    /* Activate 'contacts' again */
-    setContactButtons(true);
-    ui->answerButton->setEnabled(true);
-    ui->answerButton->setVisible(true);
-    ui->keyPrecentage->setText("");
-    ui->redButton->setStyleSheet(s_terminateButtonStyle_normal);
-    ui->greenButton->setStyleSheet(s_goSecureButtonStyle_normal);
-    ui->greenButton->setEnabled(false);
-    if ( uPref.m_autoerase == "true") {
-        on_eraseButton_clicked();
-    }
-
-    g_connectState = false;
-    g_connectedNodeId = "";
-    g_connectedNodeIp = "";
-    g_remoteOtpPeerIp = "";
-
-    /* Erase msg history */
-    if ( uPref.m_autoerase == "true") {
-        on_eraseButton_clicked();
-    }
+    m_call->hangup();
 }
 
 /* Power button on PIN dialog */
@@ -1585,7 +1931,7 @@ void MainWindow::networkLatency()
     }
     peerLatency();
     /* Keep screen on while connected */
-    if ( g_connectState ) {
+    if ( anySessionLive() ) {
         screenBlanktimer->start(BLACK_OUT_TIME);
     }
 }
@@ -1773,144 +2119,151 @@ long int MainWindow::get_key_index(QString counterFilename)
 void MainWindow::on_exitButton_clicked()
 {
     ui->codeValue->setText("");
-    ui->settingsFrame->setVisible(false);
+    m_wifiScanner->setActive(false);
+    m_settingsFrame->setVisible(false);
+    m_settingsUi->diagnosticsFrame->setVisible(false);
+    m_settingsUi->diagnosticsButton->setText("Diag");
     ui->logoLabel->setVisible(true);
 }
 
-/* WIFI Network connect with iwd
-
-    1. Connect
-    iwctl --passphrase [password] station wlan0 connect [ssid]
-
-    2. Status
-    ./wifi_status.sh
-    connected [SSID] [IP]
+/* WIFI Network management with iwd over D-Bus, see WifiControl.
+   The list is drawn from WifiScanner's cache: visible networks first,
+   then known networks after a "Known networks:" separator. Items carry
+   the SSID as data, the text also has signal and security. */
 
-    3. Interface IP's
-    ./wifi_interfaceips.sh
-    wlan0,[IP],eth0,[IP]
+void MainWindow::renderWifiNetworks()
+{
+    QComboBox *comboBox = settingsUi()->networksComboBox;
+    /* Background refresh, don't pull the list from under the user */
+    if ( comboBox->view()->isVisible() )
+        return;
+    QString selected = comboBox->currentData().toString();
+    bool selectedKnown = comboBox->currentIndex() >= m_knownNetworkIndex;
 
-    4. Get known networks
-    ./wifi_getknownnetworks.sh
+    comboBox->clear();
+    const QList<WifiNetwork> networks = m_wifiScanner->networks();
+    for (const WifiNetwork &network : networks) {
+        QString text = QString("%1  (%2 dBm, %3)").arg(network.ssid).arg(network.signal).arg(network.security);
+        comboBox->addItem(text, network.ssid);
+    }
+    /* Add also known networks to combo box. Index is used
+       to change color of 'Forget' button when already known
+       network is selected from dropdown.*/
+    comboBox->addItem("Known networks:");
+    m_knownNetworkIndex = comboBox->count();
+    const QStringList known = m_wifiScanner->knownNetworks();
+    for (const QString &ssid : known)
+        comboBox->addItem(ssid, ssid);
+
+    if ( !selected.isEmpty() ) {
+        int from = selectedKnown ? m_knownNetworkIndex : 0;
+        for (int i = from; i < comboBox->count(); i++) {
+            if ( comboBox->itemData(i).toString() == selected ) {
+                comboBox->setCurrentIndex(i);
+                break;
+            }
+        }
+    }
 
-    5. Forget
-    iwctl known-networks [SSID] forget
-*/
+    if ( m_wifiScanner->isScanning() && m_wifiScanner->age() < 0 ) {
+        m_settingsUi->WifistatusLabel->setText("Scanning...");
+    } else if ( m_wifiScanner->age() >= 0 ) {
+        m_settingsUi->WifistatusLabel->setText(QString("%1 networks, scanned %2 s ago")
+                                               .arg(networks.count())
+                                               .arg(m_wifiScanner->age() / 1000));
+    }
+}
 
-void MainWindow::scanAvailableWifiNetworks(QString command, QStringList parameters)
+void MainWindow::wifiNetworksUpdated()
 {
-    qint64 pid;
-    QProcess process;
-    process.setProgram(command);
-    process.setArguments(parameters);
-    process.start();
-    process.waitForFinished();
-    QString result=process.readAllStandardOutput();
-    ui->WifistatusLabel->setText(result);
-    QString trimmedList = result.trimmed();
-    QStringList networks=trimmedList.split(" ");
-    ui->networksComboBox->addItems(networks);
+    if ( m_settingsFrame && m_settingsFrame->isVisible() )
+        renderWifiNetworks();
 }
 
 void MainWindow::on_scanWifiButton_clicked()
 {
-    ui->networksComboBox->clear();
-    ui->saveWifiButton->setStyleSheet(m_buttonNormalStyle);
-    ui->WifistatusLabel->setStyleSheet(m_wifiConnectStatusNormalStyle);
-    ui->saveWifiButton->setEnabled(false);
-    ui->wifiPasswordText->setText("");
-    scanAvailableWifiNetworks("/opt/tunnel/wifi_getnetworks.sh",{""});
-    getKnownWifiNetworks();
+    m_settingsUi->saveWifiButton->setStyleSheet(m_buttonNormalStyle);
+    m_settingsUi->WifistatusLabel->setStyleSheet(m_wifiConnectStatusNormalStyle);
+    m_settingsUi->WifistatusLabel->setText("Scanning...");
+    m_settingsUi->saveWifiButton->setEnabled(false);
+    m_settingsUi->wifiPasswordText->setText("");
+    m_wifiScanner->scanNow();
 }
 
 void MainWindow::on_saveWifiButton_clicked()
 {
-    QString networkSsid=ui->networksComboBox->currentText();
-    QString networkPassword=ui->wifiPasswordText->text();    
-    QStringList parameters={"--passphrase",networkPassword,"station","wlan0","connect",networkSsid};
-    connectWifiNetwork("iwctl", parameters);
-    QTimer::singleShot(10000, this, SLOT( getWifiStatus() ));
+    QString networkSsid=m_settingsUi->networksComboBox->currentData().toString();
+    QString networkPassword=m_settingsUi->wifiPasswordText->text();
+    m_settingsUi->WifistatusLabel->setText("Connect status: connecting " + networkSsid);
+    m_settingsUi->WifistatusLabel->setStyleSheet(m_wifiConnectStatusNormalStyle);
+    m_wifi->connectNetwork(networkSsid, networkPassword);
 }
 
-void MainWindow::connectWifiNetwork(QString command, QStringList parameters)
+/* Station state as iwd reports it, while the settings page is open */
+void MainWindow::wifiStateChanged(const QString &state, const QString &ssid)
 {
-    qint64 pid;
-    QProcess process;
-    process.setProgram(command);
-    process.setArguments(parameters);
-    process.startDetached(&pid);
+    if ( !m_settingsUi || !m_settingsFrame->isVisible() )
+        return;
+    m_settingsUi->WifistatusLabel->setText("Connect status: " + state + " " + ssid);
 }
 
-void MainWindow::getWifiStatus()
+void MainWindow::wifiConnected(const QString &ssid)
 {
-    qint64 pid;
-    QProcess process;
-    process.setProgram("/opt/tunnel/wifi_status.sh");
-    process.setArguments({""});
-    process.start();
-    process.waitForFinished();
-    QString result=process.readAllStandardOutput();
-    ui->WifistatusLabel->setText("Connect status: " + result);
-    ui->WifistatusLabel->setStyleSheet(m_wifiConnectStatusHighlightStyle);
-    ui->saveWifiButton->setStyleSheet(m_buttonNormalStyle);
-    ui->saveWifiButton->setEnabled(false);
-    ui->wifiPasswordText->setText("");
+    if ( !m_settingsUi )
+        return;
+    m_settingsUi->WifistatusLabel->setText("Connect status: connected " + ssid);
+    m_settingsUi->WifistatusLabel->setStyleSheet(m_wifiConnectStatusHighlightStyle);
+    m_settingsUi->saveWifiButton->setStyleSheet(m_buttonNormalStyle);
+    m_settingsUi->saveWifiButton->setEnabled(false);
+    m_settingsUi->wifiPasswordText->setText("");
 }
 
-void MainWindow::getKnownWifiNetworks()
+void MainWindow::wifiConnectFailed(const QString &ssid, const QString &error)
 {
-    qint64 pid;
-    QProcess process;
-    process.setProgram("/opt/tunnel/wifi_getknownnetworks.sh");
-    process.setArguments({""});
-    process.start();
-    process.waitForFinished();
-    QString result=process.readAllStandardOutput();
-    /* Add also known networks to combo box. Index is used
-       to change color of 'Forget' button when already known
-       network is selected from dropdown.*/
-    ui->networksComboBox->addItem("Known networks:");
-    m_knownNetworkIndex = ui->networksComboBox->count();
-    QString trimmedList = result.trimmed();
-    QStringList networks=trimmedList.split(" ");
-    ui->networksComboBox->addItems(networks);
+    if ( !m_settingsUi )
+        return;
+    m_settingsUi->WifistatusLabel->setText("Connect status: failed " + ssid + "\n" + error);
+    m_settingsUi->WifistatusLabel->setStyleSheet(m_wifiConnectStatusHighlightStyle);
+    m_settingsUi->saveWifiButton->setStyleSheet(m_buttonNormalStyle);
+    m_settingsUi->saveWifiButton->setEnabled(false);
+    m_settingsUi->wifiPasswordText->setText("");
 }
 
 void MainWindow::on_networksComboBox_activated(int index)
 {
     if ( index >= m_knownNetworkIndex ) {
-        ui->deleteWifiButton->setStyleSheet(m_buttonHighlightStyle);
-        ui->saveWifiButton->setStyleSheet(m_buttonNormalStyle);
-        ui->saveWifiButton->setEnabled(false);
-        ui->wifiPasswordText->setText("");
+        m_settingsUi->deleteWifiButton->setStyleSheet(m_buttonHighlightStyle);
+        m_settingsUi->saveWifiButton->setStyleSheet(m_buttonNormalStyle);
+        m_settingsUi->saveWifiButton->setEnabled(false);
+        m_settingsUi->wifiPasswordText->setText("");
     } else {
-        ui->deleteWifiButton->setStyleSheet(m_buttonNormalStyle);
+        m_settingsUi->deleteWifiButton->setStyleSheet(m_buttonNormalStyle);
     }
 }
 
 void MainWindow::on_deleteWifiButton_clicked()
 {
-    QString deleteNetworkName=ui->networksComboBox->currentText();
-    QStringList parameters={"known-networks",deleteNetworkName,"forget"};
-    QProcess process;
-    process.setProgram("iwctl");
-    process.setArguments(parameters);
-    process.start();
-    process.waitForFinished();
-    QString result=process.readAllStandardOutput();
-    ui->networksComboBox->clear();
-    ui->deleteWifiButton->setStyleSheet(m_buttonNormalStyle);
+    QString deleteNetworkName=m_settingsUi->networksComboBox->currentData().toString();
+    m_wifi->forgetNetwork(deleteNetworkName);
+}
+
+void MainWindow::wifiNetworkForgotten(const QString &ssid)
+{
+    Q_UNUSED(ssid)
+    if ( !m_settingsUi )
+        return;
+    m_settingsUi->deleteWifiButton->setStyleSheet(m_buttonNormalStyle);
 }
 
 void MainWindow::on_wifiPasswordText_textChanged(const QString &arg1)
 {
-    int passwordEntryLen=ui->wifiPasswordText->text().length();
+    int passwordEntryLen=m_settingsUi->wifiPasswordText->text().length();
     if ( passwordEntryLen >= 8 ) {
-        ui->saveWifiButton->setStyleSheet(m_buttonHighlightStyle);
-        ui->saveWifiButton->setEnabled(true);
+        m_settingsUi->saveWifiButton->setStyleSheet(m_buttonHighlightStyle);
+        m_settingsUi->saveWifiButton->setEnabled(true);
     } else {
-        ui->saveWifiButton->setStyleSheet(m_buttonNormalStyle);
-        ui->saveWifiButton->setEnabled(false);
+        m_settingsUi->saveWifiButton->setStyleSheet(m_buttonNormalStyle);
+        m_settingsUi->saveWifiButton->setEnabled(false);
     }
 }
 
@@ -1919,7 +2272,7 @@ void MainWindow::on_saveGatewayButton_clicked()
     int lineCount=0;
     QStringList iniFileLines;
     /* Take new IP and PORT */
-    QString connectionPointIpAndPort=ui->gatewayIpPortInput->text();
+    QString connectionPointIpAndPort=m_settingsUi->gatewayIpPortInput->text();
     /* Read tunnel configuration file and replace 'Endpoint' with given value*/
     QFile inputFile(WG_CONFIGURATION_FILE);
     if (inputFile.open(QIODevice::ReadOnly))
@@ -1961,8 +2314,8 @@ void MainWindow::on_saveGatewayButton_clicked()
     }
     persistedFile.close();
     /* Notify user */
-    ui->WifistatusLabel->setText("New connection point saved. \nReboot device to activate!");
-    ui->WifistatusLabel->setStyleSheet(m_wifiConnectStatusHighlightStyle);
+    m_settingsUi->WifistatusLabel->setText("New connection point saved. \nReboot device to activate!");
+    m_settingsUi->WifistatusLabel->setStyleSheet(m_wifiConnectStatusHighlightStyle);
 }
 
 /* Check IPv4 validity
@@ -2013,22 +2366,22 @@ int MainWindow::isValidIp4 (char *str) {
 /* Check validity as we type & enable Save button based on that */
 void MainWindow::on_gatewayIpPortInput_textChanged(const QString &arg1)
 {
-    QString connectionPointIpAndPort=ui->gatewayIpPortInput->text();
+    QString connectionPointIpAndPort=m_settingsUi->gatewayIpPortInput->text();
     QStringList gwParts=connectionPointIpAndPort.split(":");
     /* Check input validity */
     if ( gwParts.count() == 2 ) {
         std::string str = gwParts[0].toStdString();
         char*p = (char*)str.c_str();
         if ( isValidIp4(p) && gwParts[1].toUInt() > 1024 && gwParts[1].toUInt() <= 65535 ) {
-            ui->saveGatewayButton->setStyleSheet(m_buttonHighlightStyle);
-            ui->saveGatewayButton->setEnabled(true);
+            m_settingsUi->saveGatewayButton->setStyleSheet(m_buttonHighlightStyle);
+            m_settingsUi->saveGatewayButton->setEnabled(true);
         } else {
-            ui->saveGatewayButton->setStyleSheet(m_buttonNormalStyle);
-            ui->saveGatewayButton->setEnabled(false);
+            m_settingsUi->saveGatewayButton->setStyleSheet(m_buttonNormalStyle);
+            m_settingsUi->saveGatewayButton->setEnabled(false);
         }
     } else {
-        ui->saveGatewayButton->setStyleSheet(m_buttonNormalStyle);
-        ui->saveGatewayButton->setEnabled(false);
+        m_settingsUi->saveGatewayButton->setStyleSheet(m_buttonNormalStyle);
+        m_settingsUi->saveGatewayButton->setEnabled(false);
     }
 }
 
@@ -2040,8 +2393,7 @@ void MainWindow::on_autoeraseCheckbox_stateChanged(int arg1)
     if ( arg1 == 0 ) {
         uPref.m_autoerase = "false";
     }
-    QSettings settings(USER_PREF_INI_FILE,QSettings::IniFormat);
-    settings.setValue("autoerase", uPref.m_autoerase);
+    m_userPrefStore->setValue("autoerase", uPref.m_autoerase);
 }
 
 void MainWindow::finalCountdown()
@@ -2051,17 +2403,17 @@ void MainWindow::finalCountdown()
 
         if ( m_finalCountdownValue == 0 ) {
             qint64 pid;
-            QProcess process;
+            SpawnedProcess process;
             process.setProgram("/bin/nuke.sh");
             process.setArguments({""});
             process.setStandardOutputFile(QProcess::nullDevice());
             process.setStandardErrorFile(QProcess::nullDevice());
             process.startDetached(&pid);
             ui->countLabel->setText("☹");
-            beepBuzzer(500);
+            beepBuzzer(Buzzer::CountdownFinal);
         }
         else {
-            beepBuzzer(10);
+            beepBuzzer(Buzzer::CountdownTick);
         }
         m_finalCountdownValue--;
     }
@@ -2069,90 +2421,412 @@ void MainWindow::finalCountdown()
 
 void MainWindow::on_camButton_clicked()
 {
-    ui->imageFrame->setVisible(1);
-    ui->imageFrameSendPicture->setVisible(0);
-    ui->imageFramePictureLabel->clear();
-    ui->imageFrameTakePictureButton->setVisible(1);
+    imageUi();
+    m_imageFrame->setVisible(1);
+    m_imageUi->imageFrameSendPicture->setVisible(0);
+    m_imageUi->imageFramePictureLabel->clear();
+    m_imageUi->imageFrameStatusLabel->clear();
+    m_imageUi->imageFrameTakePictureButton->setVisible(1);
 }
 
 void MainWindow::on_imageFrameCloseButton_clicked()
 {
-    ui->imageFramePictureLabel->clear();
-    ui->imageFrame->setVisible(0);
+    m_camera->cancel();
+    m_transferSender->cancel();
+    if ( m_pictureJob )
+        m_pictureJob->cancel();
+    m_pictureSending = false;
+    m_pictureSendData.clear();
+    m_imageUi->imageFrameSendPicture->setEnabled(true);
+    m_imageUi->imageFramePictureLabel->clear();
+    m_imageUi->imageFrameStatusLabel->clear();
+    m_imageFrame->setVisible(0);
 }
 
 void MainWindow::on_imageFrameTakePictureButton_clicked()
 {
-    qint64 pid;
-    QProcess process;
-    process.setProgram("/bin/takepicture.sh");
-    process.setArguments({""});
-    process.start();
-    process.waitForFinished();
-    /* TODO: Timeout */
-    QString camPictureFile(CAMERA_PIC_FILE);
-    QFile fileCheck(camPictureFile);
-    if ( fileCheck.exists() ) {
-        ui->imageFramePictureLabel->setPixmap(QPixmap(camPictureFile));
-        if (g_connectState)
-            ui->imageFrameSendPicture->setVisible(1);
-    }
+    if ( m_camera->isBusy() || m_pictureSending )
+        return;
+    m_imageUi->imageFrameSendPicture->setVisible(0);
+    m_imageUi->imageFramePictureLabel->clear();
+    m_imageUi->imageFrameStatusLabel->clear();
+    m_galleryShownId = 0;
+    m_camera->setDisplaySize(m_imageUi->imageFramePictureLabel->size());
+    m_camera->capture();
+}
+
+void MainWindow::cameraBusyChanged(bool busy)
+{
+    imageUi();
+    m_imageUi->imageFrameTakePictureButton->setEnabled(!busy);
+    m_imageUi->imageFrameTakePictureButton->setText(busy ? "Capturing..." : "Take picture");
+}
+
+/* Low resolution frame, the label scales it up until the full one lands */
+void MainWindow::cameraPreview(const QImage &image)
+{
+    m_imageUi->imageFramePictureLabel->setPixmap(QPixmap::fromImage(image));
+}
+
+void MainWindow::cameraCaptured(const QImage &image)
+{
+    m_imageUi->imageFramePictureLabel->setPixmap(QPixmap::fromImage(image));
+    QFile picture(m_camera->fileName());
+    if ( picture.open(QIODevice::ReadOnly) )
+        m_galleryShownId = m_gallery->add(picture.readAll(), Gallery::Captured, image);
+    m_imageUi->imageFrameStatusLabel->setText(QString("%1 ms").arg(m_camera->lastFullMs()));
+    if (m_call->isConnected())
+        m_imageUi->imageFrameSendPicture->setVisible(1);
+}
 
+void MainWindow::cameraFailed(const QString &error)
+{
+    m_imageUi->imageFramePictureLabel->setText("Camera: " + error);
 }
 
 void MainWindow::on_imageFrameSendPicture_clicked()
 {
-    qint64 pid;
-    QProcess process;
-    process.setProgram("/bin/sendpicture.sh");
-    process.setArguments({g_remoteOtpPeerIp});
-    process.start();
-    process.waitForFinished();
-    /* TODO: Timeout */
+    if ( m_pictureSending )
+        return;
+    /* The picture on show, which may be an older one from the gallery */
+    QByteArray picture = m_gallery->data(m_galleryShownId);
+    if ( picture.isEmpty() ) {
+        m_imageUi->imageFrameStatusLabel->setText("Send failed");
+        return;
+    }
+    m_pictureSending = true;
+    m_pictureSendData = picture;
+    m_pictureSendPeer = m_call->otpPeerIp();
+    m_imageUi->imageFrameSendPicture->setEnabled(false);
+    m_imageUi->imageFrameStatusLabel->setText("Encoding...");
+    m_imageDelta->encode(m_pictureSendPeer, m_pictureSendData);
 }
 
-void MainWindow::incomingImageChangeDetected()
+/* Same picture and reference encode to the same bytes, so a resend
+   still resumes from the chunks the peer has. The picture goes to the
+   peer it was encoded for, whichever session is shown by now. */
+void MainWindow::pictureEncoded(const QString &peer, const QByteArray &data, bool keyframe)
 {
-    QFile myFile("/tmp/ftp/incoming/image.png");
-    if (myFile.open(QIODevice::ReadOnly)){
-        m_imageFileSize = myFile.size();
-        myFile.close();
+    if ( !m_pictureSending || peer != m_pictureSendPeer )
+        return;
+    QFile file(PICTURE_SEND_FILE);
+    if ( !file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size() ) {
+        pictureSendFailed(file.errorString());
+        return;
+    }
+    file.close();
+    if ( !m_transferSender->send(m_pictureSendPeer, PICTURE_SEND_FILE) ) {
+        pictureSendFailed("transfer busy");
+        return;
     }
-    if ( m_timerBlock == false )  {
-        ui->imageFrame->setVisible(1);
-        QTimer::singleShot(5000, this, SLOT(incomingImageVerifyChange()));
-        m_timerBlock = true;
+    qDebug() << "Picture encoded:" << (keyframe ? "key frame" : "delta") << data.size();
+}
+
+static QString transferStatus(qint64 bytes, qint64 total, qint64 bytesPerSecond)
+{
+    QLocale locale;
+    return locale.formattedDataSize(bytes) + " / " + locale.formattedDataSize(total) + "  "
+            + locale.formattedDataSize(bytesPerSecond) + "/s";
+}
+
+void MainWindow::pictureSendProgress(qint64 bytes, qint64 total, qint64 bytesPerSecond)
+{
+    m_imageUi->imageFrameStatusLabel->setText(transferStatus(bytes, total, bytesPerSecond));
+}
+
+void MainWindow::pictureSent()
+{
+    m_pictureSending = false;
+    m_pictureLastSent = m_pictureSendData;
+    m_pictureLastPeer = m_pictureSendPeer;
+    m_pictureSendData.clear();
+    m_imageDelta->commitSent(m_pictureSendPeer);
+    m_imageUi->imageFrameSendPicture->setEnabled(true);
+    m_imageUi->imageFrameSendPicture->setVisible(0);
+    m_imageUi->imageFrameStatusLabel->setText("Sent");
+}
+
+/* Pressing send again resumes from the chunks the peer already has.
+   A peer that never took the connection gets the plain picture the
+   old way. */
+void MainWindow::pictureSendFailed(const QString &error)
+{
+    if ( m_pictureSending && !m_transferSender->peerReached() && !m_pictureSendData.isEmpty() ) {
+        qDebug() << "Picture transfer unavailable, using sendpicture.sh:" << error;
+        sendPictureByScript();
+        return;
     }
-    ui->imageFramePictureLabel->setText("Received " + QString::number(m_imageFileSize) + " bytes");
+    m_pictureSending = false;
+    m_pictureSendData.clear();
+    m_imageUi->imageFrameSendPicture->setEnabled(true);
+    m_imageUi->imageFrameStatusLabel->setText("Send failed: " + error);
 }
 
-void MainWindow::incomingImageVerifyChange()
+/* The peer's reference is gone or differs from ours: the picture it
+   failed to rebuild goes again as a key frame. A send in progress was
+   encoded against the same reference, the peer asks again for that. */
+void MainWindow::resendPictureKeyframe(const QString &peer)
 {
-    m_timerBlock = false;
-    QFile myFile("/tmp/ftp/incoming/image.png");
-    int size=0;
-    if (myFile.open(QIODevice::ReadOnly)){
-        size = myFile.size();
-        myFile.close();
+    m_imageDelta->dropSent(peer);
+    if ( m_pictureSending || m_pictureLastSent.isEmpty() || m_pictureLastPeer != peer )
+        return;
+    imageUi();
+    m_pictureSending = true;
+    m_pictureSendData = m_pictureLastSent;
+    m_pictureSendPeer = peer;
+    m_imageUi->imageFrameSendPicture->setEnabled(false);
+    m_imageUi->imageFrameStatusLabel->setText("Resending full picture...");
+    m_imageDelta->encode(m_pictureSendPeer, m_pictureSendData);
+}
+
+/* sendpicture.sh sends CAMERA_PIC_FILE. The peer gets no delta, the
+   sent reference stays where it was. */
+void MainWindow::sendPictureByScript()
+{
+    QFile file(CAMERA_PIC_FILE);
+    if ( !file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+         || file.write(m_pictureSendData) != m_pictureSendData.size() ) {
+        m_pictureSendData.clear();
+        pictureSendFailed(file.errorString());
+        return;
+    }
+    file.close();
+    m_imageUi->imageFrameStatusLabel->setText("Sending...");
+    m_pictureJob = m_jobs->start("/bin/sendpicture.sh", { m_pictureSendPeer }, SEND_PICTURE_TIMEOUT);
+    connect(m_pictureJob, SIGNAL(finished(Job*)), this, SLOT(pictureScriptFinished(Job*)));
+}
+
+void MainWindow::pictureScriptFinished(Job *job)
+{
+    m_pictureJob = nullptr;
+    if ( job->status() == Job::Cancelled )
+        return;
+    m_pictureSendData.clear();
+    if ( !job->succeeded() ) {
+        pictureSendFailed(QString("sendpicture.sh %1").arg(job->status() == Job::TimedOut ? "timed out" : "failed"));
+        return;
+    }
+    m_pictureSending = false;
+    m_imageUi->imageFrameSendPicture->setEnabled(true);
+    m_imageUi->imageFrameSendPicture->setVisible(0);
+    m_imageUi->imageFrameStatusLabel->setText("Sent");
+}
+
+/* Incoming picture: progress and partial image while the transfer
+   runs, the final image once the FTP server has closed the file or a
+   chunked transfer has renamed its part file over it */
+void MainWindow::incomingImageStarted()
+{
+    imageUi();
+    m_galleryShownId = 0;
+    m_imageUi->imageFramePictureLabel->clear();
+    m_imageUi->imageFramePictureLabel->setText("Receiving...");
+    m_imageUi->imageFrameTakePictureButton->setVisible(0);
+    m_imageUi->imageFrameSendPicture->setVisible(0);
+    m_imageFrame->setVisible(1);
+}
+
+void MainWindow::incomingImageProgress(qint64 bytes, qint64 bytesPerSecond)
+{
+    imageUi();
+    QLocale locale;
+    m_imageUi->imageFrameStatusLabel->setText(locale.formattedDataSize(bytes) + "  "
+                                              + locale.formattedDataSize(bytesPerSecond) + "/s");
+}
+
+/* Partial decodes are skipped while one is still running */
+void MainWindow::incomingImagePreview(const QByteArray &data)
+{
+    if ( m_imagePreviewId )
+        return;
+    m_imageDecodeId = m_imageDecoder->decodeData(data, imageUi()->imageFramePictureLabel->size(),
+                                                 Qt::IgnoreAspectRatio);
+    m_imagePreviewId = m_imageDecodeId;
+}
+
+/* Chunked transfers know their sender, the file watcher sees the
+   rename after this */
+void MainWindow::incomingTransferReceived(const QString &fileName, const QString &peerIp)
+{
+    Q_UNUSED(fileName);
+    m_incomingPicturePeer = peerIp;
+}
+
+/* Previews still running are dropped, the gallery decodes the final
+   one. Deltas are rebuilt against the last picture from the same peer;
+   pictures over FTP don't say who sent them, the shown peer is assumed. */
+void MainWindow::incomingImageReceived(const QByteArray &data)
+{
+    m_imageDecodeId = 0;
+    QString peer = m_incomingPicturePeer.isEmpty() ? m_call->otpPeerIp() : m_incomingPicturePeer;
+    m_incomingPicturePeer.clear();
+    if ( ImageDelta::isDelta(data) ) {
+        m_imageDelta->decode(peer, data);
+        m_imageUi->imageFrameStatusLabel->setText("Rebuilding...");
+    } else {
+        m_imageDelta->keepReceived(peer, data);
+        showGalleryImage(m_gallery->add(data, Gallery::Received));
+    }
+    m_imageUi->imageFrameTakePictureButton->setVisible(0);
+    m_imageUi->imageFrameSendPicture->setVisible(0);
+    m_imageFrame->setVisible(1);
+}
+
+void MainWindow::incomingDeltaDecoded(const QString &peer, const QByteArray &file)
+{
+    Q_UNUSED(peer);
+    imageUi()->imageFrameStatusLabel->clear();
+    showGalleryImage(m_gallery->add(file, Gallery::Received));
+}
+
+/* Reference missing or different: the sender starts over with the
+   whole picture */
+void MainWindow::incomingDeltaFailed(const QString &peer, const QString &error)
+{
+    imageUi()->imageFramePictureLabel->setText("Image error: " + error);
+    CallSession *session = sessionForIp(peer);
+    if ( session && session->isConnected() ) {
+        m_imageUi->imageFrameStatusLabel->setText("Requesting full picture...");
+        fifoWrite(peer + ",message,picture_keyframe");
+    }
+}
+
+void MainWindow::incomingTransferProgress(qint64 bytes, qint64 total, qint64 bytesPerSecond)
+{
+    imageUi();
+    m_imageUi->imageFrameStatusLabel->setText(transferStatus(bytes, total, bytesPerSecond));
+}
+
+void MainWindow::incomingTransferFailed(const QString &error)
+{
+    imageUi();
+    m_imageUi->imageFrameStatusLabel->setText("Receive interrupted: " + error);
+}
+
+void MainWindow::imageDecoded(int id, const QImage &image)
+{
+    if ( id == m_imagePreviewId )
+        m_imagePreviewId = 0;
+    if ( id != m_imageDecodeId )
+        return;
+    m_imageUi->imageFramePictureLabel->setPixmap(QPixmap::fromImage(image));
+}
+
+/* Partial data often fails to decode, the next preview may not */
+void MainWindow::imageDecodeFailed(int id, const QString &error)
+{
+    Q_UNUSED(error);
+    if ( id == m_imagePreviewId )
+        m_imagePreviewId = 0;
+}
+
+void MainWindow::galleryChanged()
+{
+    if ( m_imageUi )
+        renderGallery();
+}
+
+/* Newest first, thumbnails fill in as they are decoded */
+void MainWindow::renderGallery()
+{
+    QListWidget *list = m_imageUi->imageFrameGalleryList;
+    list->clear();
+    const QList<int> ids = m_gallery->ids();
+    for (int id : ids) {
+        QListWidgetItem *item = new QListWidgetItem(list);
+        item->setData(Qt::UserRole, id);
+        item->setSizeHint(QSize(GALLERY_THUMB_WIDTH + 8, GALLERY_THUMB_HEIGHT + 8));
+        QImage thumbnail = m_gallery->thumbnail(id);
+        if ( !thumbnail.isNull() )
+            item->setIcon(QPixmap::fromImage(thumbnail));
+        if ( id == m_galleryShownId )
+            list->setCurrentItem(item);
     }
-    if ( size == m_imageFileSize ) {
-        ui->imageFramePictureLabel->setText("");
-        QString camPictureFile("/tmp/ftp/incoming/image.png");
-        QFile fileCheck(camPictureFile);
-        if ( fileCheck.exists() ) {
-            ui->imageFramePictureLabel->setPixmap(QPixmap(camPictureFile));
+}
+
+void MainWindow::galleryThumbnailReady(int id, const QImage &image)
+{
+    if ( !m_imageUi )
+        return;
+    QListWidget *list = m_imageUi->imageFrameGalleryList;
+    for (int row = 0; row < list->count(); row++) {
+        if ( list->item(row)->data(Qt::UserRole).toInt() == id ) {
+            list->item(row)->setIcon(QPixmap::fromImage(image));
+            break;
         }
-        ui->imageFrameTakePictureButton->setVisible(0);
-        ui->imageFrameSendPicture->setVisible(0);
-        ui->imageFrame->setVisible(1);
     }
+}
+
+/* Own pictures can be sent again, received ones are not sent back */
+void MainWindow::galleryItemClicked(QListWidgetItem *item)
+{
+    m_imageDecodeId = 0;
+    int id = item->data(Qt::UserRole).toInt();
+    showGalleryImage(id);
+    m_imageUi->imageFrameSendPicture->setVisible(m_call->isConnected()
+                                                 && m_gallery->source(id) == Gallery::Captured);
+}
+
+/* Cached pictures show at once, others when decoded */
+void MainWindow::showGalleryImage(int id)
+{
+    m_galleryShownId = id;
+    QImage image = m_gallery->view(id, imageUi()->imageFramePictureLabel->size());
+    if ( !image.isNull() )
+        m_imageUi->imageFramePictureLabel->setPixmap(QPixmap::fromImage(image));
+}
+
+void MainWindow::galleryViewReady(int id, const QImage &image)
+{
+    if ( id == m_galleryShownId && m_imageUi )
+        m_imageUi->imageFramePictureLabel->setPixmap(QPixmap::fromImage(image));
+}
 
+void MainWindow::galleryViewFailed(int id, const QString &error)
+{
+    if ( id == m_galleryShownId && m_imageUi )
+        m_imageUi->imageFramePictureLabel->setText("Image error: " + error);
 }
 
 void MainWindow::on_audioDeviceInput_textChanged(const QString &arg1)
 {
-    QSettings settings(UI_ELEMENTS_INI_FILE,QSettings::IniFormat);
-    settings.setValue("audio_device", arg1 );
+    m_uiPrefStore->setValue("audio_device", arg1 );
     uiElement.audioMixerOutputDevice = arg1;
+    m_mixer->setElement(arg1);
+}
+
+/* Diagnostics page over the settings: call phase latencies */
+void MainWindow::on_diagnosticsButton_clicked()
+{
+    bool show = !m_settingsUi->diagnosticsFrame->isVisible();
+    m_settingsUi->diagnosticsFrame->setVisible(show);
+    m_settingsUi->diagnosticsButton->setText(show ? "Back" : "Diag");
+    m_settingsUi->diagnosticsStatusLabel->setText("");
+    renderCallTrace();
+}
+
+void MainWindow::on_exportDiagnosticsButton_clicked()
+{
+    if ( m_callTrace.exportTo(CALL_TRACE_FILE) )
+        m_settingsUi->diagnosticsStatusLabel->setText("Exported to " CALL_TRACE_FILE);
+    else
+        m_settingsUi->diagnosticsStatusLabel->setText("Export failed");
+}
+
+void MainWindow::renderCallTrace()
+{
+    if ( !m_settingsUi || !m_settingsUi->diagnosticsFrame->isVisible() )
+        return;
+    QString report = m_callTrace.report();
+    /* Key press to handled, from the kernel event timestamp */
+    if ( m_gpioReader ) {
+        GpioReader::LatencyStats keys = m_gpioReader->latencyStats();
+        report += QString("\nGPIO keys: %1 events, last %2 ms, avg %3 ms, max %4 ms\n")
+                .arg(keys.count)
+                .arg(keys.lastUs / 1000.0, 0, 'f', 1)
+                .arg(keys.count ? keys.totalUs / 1000.0 / keys.count : 0.0, 0, 'f', 1)
+                .arg(keys.maxUs / 1000.0, 0, 'f', 1);
+    }
+    m_settingsUi->diagnosticsText->setPlainText(report);
 }
 
@@ -25,19 +25,46 @@
 
 #include <QMainWindow>
 #include <QFileSystemWatcher>
+#include <QFrame>
 #include <QFile>
 #include <QSocketNotifier>
 #include <QTimer>
 #include <QProcess>
+#include <QHash>
+#include <QPointer>
+#include <QUrl>
+#include <QLabel>
+#include <QListWidgetItem>
+#include <QMessageBox>
+#include "gpioreader.h"
+#include "callprewarm.h"
+#include "callsession.h"
+#include "camera.h"
+#include "gallery.h"
+#include "imagedecoder.h"
+#include "imagedelta.h"
+#include "imagereceiver.h"
+#include "backlight.h"
+#include "buzzer.h"
+#include "settingsstore.h"
+#include "mixer.h"
+#include "configloader.h"
+#include "nodes.h"
+#include "jobrunner.h"
+#include "servicecontrol.h"
+#include "spawner.h"
+#include "telemetryqueue.h"
+#include "transfer.h"
+#include "voicemessage.h"
+#include "wificontrol.h"
+#include "wifiscanner.h"
 
-#define NODECOUNT 6
-#define CONNPOINTCOUNT 3
 #define UI_MODE 0
 #define VAULT_MODE 1
 
 
 QT_BEGIN_NAMESPACE
-namespace Ui { class MainWindow; }
+namespace Ui { class MainWindow; class SettingsFrame; class ImageFrame; }
 QT_END_NAMESPACE
 
 class MainWindow : public QMainWindow
@@ -47,6 +74,10 @@ class MainWindow : public QMainWindow
 public:
     MainWindow(int a, QWidget *parent = nullptr);
     ~MainWindow();
+    GpioReader *gpioReader() const { return m_gpioReader; }
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
 
 private slots:
 
@@ -63,7 +94,8 @@ private slots:
     void on_contact6Button_clicked();
     void fifoChanged(const QString & path);
     void fifoWrite(QString message);
-    void readGpioButtons();
+    void gpioKeyEvent(int code, int value);
+    void powerDialogFinished(int result);
     void writeBackLight(QString value);
     void rampUp();
     void rampDown();
@@ -72,9 +104,18 @@ private slots:
     void scanPeers();
     void on_commCheckButton_clicked();
     int msgFifoChanged(const QString & path);
+    void peerMessage(const QString &line);
     void on_denyButton_clicked();
     void on_eraseButton_clicked();
     void on_lineEdit_returnPressed();
+    void on_voiceButton_pressed();
+    void on_voiceButton_released();
+    void on_messagesView_anchorClicked(const QUrl &url);
+    void voiceRecorded(const QByteArray &clip, int durationMs);
+    void voiceMessageOut(const QString &peer, const QString &payload);
+    void voiceReceived(const QString &peer, int id, int durationMs);
+    void voiceFailed(const QString &error);
+    void voiceReceiveFailed(const QString &peer, const QString &error);
     void on_pinButton_clear_clicked();
     void on_pinButton_1_clicked();
     void on_pinButton_2_clicked();
@@ -92,18 +133,17 @@ private slots:
     void on_pinButton_hash_clicked();
     void setSystemVolume(int volume);
     void connectAsClient(QString nodeIp, QString nodeId);
-    void touchLocalFile(QString filename);
-    void removeLocalFile(QString filename);
-    void disconnectAsClient(QString nodeIp, QString nodeId);
+    void callStateChanged(CallSession::State state, CallSession::State previous);
+    void callFailed(const QString &reason);
     void updateCallStatusIndicator(QString text, QString fontColor, QString backgroundColor,int logMethod);
     void on_answerButton_clicked();
-    void setIndicatorForIncomingConnection(QString peerIp);
     void setContactButtons(bool state);
     void txKeyPresentageChanged();
     void rxKeyPresentageChanged();
-    void beepBuzzer(int lenght);
+    void beepBuzzer(Buzzer::Pattern pattern);
     void beepBuzzerOff();
     void loadConnectionProfile();
+    void configChanged(ConfigSnapshotPtr config, const QStringList &files);
     void saveAndActivateConnectionProfile(QString profile);
     void on_pinButton_pwr_clicked();
     void networkLatency();
@@ -112,40 +152,168 @@ private slots:
     long int get_key_index(QString counterFilename);
     void peerLatency();
     void saveUserPreferencesBeep(QString value);
-    void on_exitButton_clicked();
-    void scanAvailableWifiNetworks(QString command, QStringList parameters);
-    void connectWifiNetwork(QString command, QStringList parameters);
-    void getWifiStatus();
-    void getKnownWifiNetworks();
-    void on_scanWifiButton_clicked();
-    void on_saveWifiButton_clicked();
-    void on_networksComboBox_activated(int index);
-    void on_deleteWifiButton_clicked();
-    void on_wifiPasswordText_textChanged(const QString &arg1);
-    void on_saveGatewayButton_clicked();
+    void wifiNetworksUpdated();
+    void wifiStateChanged(const QString &state, const QString &ssid);
+    void wifiConnected(const QString &ssid);
+    void wifiConnectFailed(const QString &ssid, const QString &error);
+    void wifiNetworkForgotten(const QString &ssid);
+    void cameraBusyChanged(bool busy);
+    void cameraPreview(const QImage &image);
+    void cameraCaptured(const QImage &image);
+    void cameraFailed(const QString &error);
+    void pictureEncoded(const QString &peer, const QByteArray &data, bool keyframe);
+    void pictureSendProgress(qint64 bytes, qint64 total, qint64 bytesPerSecond);
+    void pictureSent();
+    void pictureSendFailed(const QString &error);
+    void pictureScriptFinished(Job *job);
     int isValidIp4(char *str);
-    void on_gatewayIpPortInput_textChanged(const QString &arg1);
-    void on_autoeraseCheckbox_stateChanged(int arg1);
     void finalCountdown();
     void onVaultProcessReadyReadStdOutput();
     void onVaultProcessFinished();
     void exitVaultOpenProcess();
     void exitVaultOpenProcessWithFail();
     void on_camButton_clicked();
-    void on_imageFrameCloseButton_clicked();
-    void on_imageFrameTakePictureButton_clicked();
-    void on_imageFrameSendPicture_clicked();
-    void incomingImageChangeDetected();
-    void incomingImageVerifyChange();
+    void incomingImageStarted();
+    void incomingImageProgress(qint64 bytes, qint64 bytesPerSecond);
+    void incomingImagePreview(const QByteArray &data);
+    void incomingImageReceived(const QByteArray &data);
+    void incomingTransferProgress(qint64 bytes, qint64 total, qint64 bytesPerSecond);
+    void incomingTransferFailed(const QString &error);
+    void incomingTransferReceived(const QString &fileName, const QString &peerIp);
+    void incomingDeltaDecoded(const QString &peer, const QByteArray &file);
+    void incomingDeltaFailed(const QString &peer, const QString &error);
+    void imageDecoded(int id, const QImage &image);
+    void imageDecodeFailed(int id, const QString &error);
+    void galleryChanged();
+    void galleryThumbnailReady(int id, const QImage &image);
+    void galleryViewReady(int id, const QImage &image);
+    void galleryViewFailed(int id, const QString &error);
+    void galleryItemClicked(QListWidgetItem *item);
+    void showGalleryImage(int id);
     void tearDownLocal();
-    int waitForFifoReply();
-    int checkFifoReplyTimeout();
-
+    void firstFrameShown();
 
-    void on_audioDeviceInput_textChanged(const QString &arg1);
 
 private:
     Ui::MainWindow *ui;
+
+    /* Startup: FIFOs open without blocking, rest waits for the first frame */
+    bool m_firstFrameShown;
+    int m_startupPending;
+    void openFifos();
+    void fifosOpened();
+    void startupStepDone();
+
+    /* Secondary frames, built on first use and connected explicitly */
+    Ui::SettingsFrame *m_settingsUi;
+    QFrame *m_settingsFrame;
+    Ui::ImageFrame *m_imageUi;
+    QFrame *m_imageFrame;
+    Ui::SettingsFrame *settingsUi();
+    Ui::ImageFrame *imageUi();
+
+    /* External scripts */
+    JobRunner *m_jobs;
+
+    /* Pictures from the peer, followed as they arrive. Decoded off
+       the GUI thread, only the latest request is shown. */
+    ImageReceiver *m_imageReceiver;
+    ImageDecoder *m_imageDecoder;
+    int m_imageDecodeId;
+    int m_imagePreviewId;
+
+    /* Recent pictures both ways, RAM only */
+    Gallery *m_gallery;
+    int m_galleryShownId;
+    void renderGallery();
+
+    /* Own pictures */
+    Camera *m_camera;
+
+    /* Pictures to and from the peer in checked, resumable chunks */
+    TransferSender *m_transferSender;
+    TransferReceiver *m_transferReceiver;
+    /* Repeated shots go as deltas against what the peer already has */
+    ImageDelta *m_imageDelta;
+    bool m_pictureSending;
+    /* Picture being sent and its peer, kept for the sendpicture.sh
+       fallback */
+    QByteArray m_pictureSendData;
+    QString m_pictureSendPeer;
+    QPointer<Job> m_pictureJob;
+    void sendPictureByScript();
+    /* Last picture the peer got, resent whole when its delta fails */
+    QByteArray m_pictureLastSent;
+    QString m_pictureLastPeer;
+    void resendPictureKeyframe(const QString &peer);
+    /* Sender of the chunked transfer that just completed */
+    QString m_incomingPicturePeer;
+
+    /* Push to record voice messages, sent over the message path */
+    VoiceRecorder *m_voiceRecorder;
+    VoicePlayer *m_voicePlayer;
+    VoiceMessenger *m_voice;
+    /* Peer of the clip being recorded */
+    QString m_voicePeer;
+
+    /* Wi-Fi through iwd, scanned in the background */
+    WifiControl *m_wifi;
+    WifiScanner *m_wifiScanner;
+    void renderWifiNetworks();
+
+    /* Calls, one session per peer. Idle sessions are kept for reuse.
+       m_call is the session shown, never null. */
+    ServiceControl *m_serviceControl;
+    TelemetryQueue *m_telemetry;
+    CallTrace m_callTrace;
+    QList<CallSession *> m_sessions;
+    CallSession *m_call;
+    CallPrewarm *m_prewarm;
+    CallSession *freeSession();
+    CallSession *sessionForPeer(const QString &nodeId);
+    CallSession *sessionForIp(const QString &ip);
+    CallSession *audioSession();
+    bool anySessionLive();
+    void sessionClosed();
+    void setCurrentSession(CallSession *session);
+    void renderCallControls();
+    void renderContacts();
+    /* Messages and key usage of a peer while its session is not shown */
+    struct SessionView
+    {
+        QString history;
+        QStringList unread;
+        QString keyText;
+    };
+    QHash<QString, SessionView> m_sessionViews;
+    /* Peer id whose messages are in messagesView */
+    QString m_shownPeer;
+    void appendMessage(CallSession *session, const QString &text);
+    void eraseSession(CallSession *session);
+    void eraseShared();
+    void updateKeyText();
+    int nodeIndex(const QString &nodeIp);
+    QLabel *contactSelected(int nodeNumber);
+    /* Contact tapped, waiting for its status reply */
+    QString m_dialIp;
+    void contactTapped(QString nodeIp);
+    void dialNode(QString nodeIp);
+    void on_exitButton_clicked();
+    void on_scanWifiButton_clicked();
+    void on_saveWifiButton_clicked();
+    void on_networksComboBox_activated(int index);
+    void on_deleteWifiButton_clicked();
+    void on_wifiPasswordText_textChanged(const QString &arg1);
+    void on_saveGatewayButton_clicked();
+    void on_gatewayIpPortInput_textChanged(const QString &arg1);
+    void on_autoeraseCheckbox_stateChanged(int arg1);
+    void on_audioDeviceInput_textChanged(const QString &arg1);
+    void on_diagnosticsButton_clicked();
+    void on_exportDiagnosticsButton_clicked();
+    void renderCallTrace();
+    void on_imageFrameCloseButton_clicked();
+    void on_imageFrameTakePictureButton_clicked();
+    void on_imageFrameSendPicture_clicked();
     QFileSystemWatcher * watcher;
     QFileSystemWatcher * msgWatcher;
     QFileSystemWatcher * txKeyWatcher;
@@ -159,6 +327,7 @@ private:
         QString node_name[NODECOUNT];
         QString node_ip[NODECOUNT];
         QString node_id[NODECOUNT];
+        QString node_otp_ip[NODECOUNT];
         QString myNodeId;
         QString myNodeIp;
         QString myNodeName;
@@ -169,6 +338,7 @@ private:
 
     };
     SPreferences nodes;
+    ConfigLoader * m_configLoader;
     void loadSettings();
 
 
@@ -181,12 +351,27 @@ private:
         QString m_autoerase;
     };
     UserPreferences uPref;
+    SettingsStore * m_userPrefStore;
+    SettingsStore * m_uiPrefStore;
+    Mixer * m_mixer;
     void loadUserPreferences();
     void saveUserPreferences();
 
-    /* GPIO Notifier */
-    QSocketNotifier * m_notify;
-    int m_fd;
+    /* GPIO keys: reader and key-to-action table */
+    GpioReader * m_gpioReader;
+    typedef void (MainWindow::*GpioKeyAction)(int value);
+    QHash<int, GpioKeyAction> m_gpioKeyActions;
+    void gpioKeyOtpStatus(int value);
+    void gpioKeyBeepMute(int value);
+    void gpioKeyErase(int value);
+    void gpioKeyScreenLock(int value);
+    void gpioKeyPower(int value);
+    /* Open power dialog, one at a time */
+    QPointer<QMessageBox> m_powerDialog;
+
+    /* Backlight */
+    Backlight * m_backlight;
+    Buzzer * m_buzzer;
     bool backLightOn;
 
     struct uiStrings
@@ -209,13 +394,6 @@ private:
     void loadUserInterfacePreferences();
     QTimer *screenBlanktimer;
     QTimer *countdownTimer;
-    QTimer *fifoReplyTimer;
-    bool g_connectState;
-    QString g_connectedNodeId;
-    QString g_connectedNodeIp;
-    QString g_remoteOtpPeerIp;
-    QString g_fifoReply;
-    bool g_fifoCheckInProgress;
     double rxKeyRemaining;
     double txKeyRemaining;
     QString txKeyRemainingString;
@@ -343,9 +521,7 @@ private:
         min-width: 1em; \
         padding: 3px;";
     int m_finalCountdownValue=10;
-    QProcess vaultOpenProcess;
-    int m_imageFileSize;
-    bool m_timerBlock=false;
+    SpawnedProcess vaultOpenProcess;
     QString m_otpStausNormalStyle = " \
         QPushButton { \
             background-color: transparent; \
@@ -0,0 +1,198 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#include "mixer.h"
+#include <QDebug>
+#include <alsa/asoundlib.h>
+
+#define MIXER_CARD              "default"
+#define MIXER_NO_VOLUME         -1
+#define MIXER_RETRY_MIN         1000
+#define MIXER_RETRY_MAX         30000
+
+/* ALSA backend */
+
+AlsaMixerBackend::AlsaMixerBackend(const QString &card)
+    : m_card(card)
+    , m_handle(nullptr)
+    , m_element(nullptr)
+    , m_min(0)
+    , m_max(0)
+{
+}
+
+AlsaMixerBackend::~AlsaMixerBackend()
+{
+    close();
+}
+
+bool AlsaMixerBackend::open(const QString &element)
+{
+    close();
+    int err = snd_mixer_open(&m_handle, 0);
+    if (err < 0) {
+        qDebug() << "Mixer open error:" << snd_strerror(err);
+        m_handle = nullptr;
+        return false;
+    }
+    QByteArray card = m_card.toLocal8Bit();
+    if ((err = snd_mixer_attach(m_handle, card.constData())) < 0
+            || (err = snd_mixer_selem_register(m_handle, nullptr, nullptr)) < 0
+            || (err = snd_mixer_load(m_handle)) < 0) {
+        qDebug() << "Mixer setup error:" << m_card << snd_strerror(err);
+        close();
+        return false;
+    }
+    /* amixer style quoting is accepted in the INI value */
+    QString name = element;
+    name.remove('\'');
+    QByteArray elementName = name.toLocal8Bit();
+    snd_mixer_selem_id_t *sid;
+    snd_mixer_selem_id_alloca(&sid);
+    snd_mixer_selem_id_set_index(sid, 0);
+    snd_mixer_selem_id_set_name(sid, elementName.constData());
+    m_element = snd_mixer_find_selem(m_handle, sid);
+    if (!m_element) {
+        qDebug() << "Mixer element not found:" << name;
+        close();
+        return false;
+    }
+    snd_mixer_selem_get_playback_volume_range(m_element, &m_min, &m_max);
+    return true;
+}
+
+void AlsaMixerBackend::close()
+{
+    if (m_handle)
+        snd_mixer_close(m_handle);
+    m_handle = nullptr;
+    m_element = nullptr;
+}
+
+bool AlsaMixerBackend::isOpen() const
+{
+    return m_element != nullptr;
+}
+
+/* Same linear mapping of percent to raw range as 'amixer sset X N%' */
+bool AlsaMixerBackend::setPlaybackVolume(int percent)
+{
+    if (!m_element)
+        return false;
+    long value = m_min + ((m_max - m_min) * percent + 50) / 100;
+    int err = snd_mixer_selem_set_playback_volume_all(m_element, value);
+    if (err < 0) {
+        qDebug() << "Mixer set volume error:" << snd_strerror(err);
+        return false;
+    }
+    return true;
+}
+
+/* Fake backend */
+
+bool FakeMixerBackend::open(const QString &element)
+{
+    m_element = element;
+    m_open = true;
+    return true;
+}
+
+void FakeMixerBackend::close()
+{
+    m_open = false;
+}
+
+bool FakeMixerBackend::isOpen() const
+{
+    return m_open;
+}
+
+bool FakeMixerBackend::setPlaybackVolume(int percent)
+{
+    m_applied.append(percent);
+    return true;
+}
+
+/* Mixer */
+
+Mixer::Mixer(MixerBackend *backend, QObject *parent)
+    : QObject(parent)
+    , m_backend(backend)
+    , m_reopen(true)
+    , m_pendingVolume(MIXER_NO_VOLUME)
+    , m_volume(MIXER_NO_VOLUME)
+    , m_retryDelay(0)
+{
+    m_applyTimer.setSingleShot(true);
+    connect(&m_applyTimer, SIGNAL(timeout()), this, SLOT(apply()));
+}
+
+Mixer::~Mixer()
+{
+    delete m_backend;
+}
+
+MixerBackend *Mixer::createBackend()
+{
+    if (qEnvironmentVariable("SINM_MIXER") == "fake")
+        return new FakeMixerBackend();
+    return new AlsaMixerBackend(MIXER_CARD);
+}
+
+void Mixer::setElement(const QString &element)
+{
+    if (element == m_element)
+        return;
+    m_element = element;
+    m_reopen = true;
+    m_retryDelay = 0;
+    if ( m_volume != MIXER_NO_VOLUME ) {
+        m_pendingVolume = m_volume;
+        m_applyTimer.start(0);
+    }
+}
+
+void Mixer::setVolume(int percent)
+{
+    m_pendingVolume = qBound(0, percent, 100);
+    m_volume = m_pendingVolume;
+    /* Active while backing off: the retry picks the value up */
+    if (!m_applyTimer.isActive())
+        m_applyTimer.start(0);
+}
+
+void Mixer::apply()
+{
+    if (m_pendingVolume == MIXER_NO_VOLUME)
+        return;
+    if (m_reopen || !m_backend->isOpen()) {
+        m_reopen = false;
+        if (!m_backend->open(m_element)) {
+            m_retryDelay = qBound(MIXER_RETRY_MIN, m_retryDelay * 2, MIXER_RETRY_MAX);
+            m_applyTimer.start(m_retryDelay);
+            return;
+        }
+        m_retryDelay = 0;
+    }
+    m_backend->setPlaybackVolume(m_pendingVolume);
+    m_pendingVolume = MIXER_NO_VOLUME;
+}
@@ -0,0 +1,113 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+typedef struct _snd_mixer snd_mixer_t;
+typedef struct _snd_mixer_elem snd_mixer_elem_t;
+
+/* Mixer backend interface. Only playback volume is adjusted. */
+class MixerBackend
+{
+public:
+    virtual ~MixerBackend() {}
+    virtual bool open(const QString &element) = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+    virtual bool setPlaybackVolume(int percent) = 0;
+};
+
+/* ALSA simple mixer control, opened once and kept open */
+class AlsaMixerBackend : public MixerBackend
+{
+public:
+    explicit AlsaMixerBackend(const QString &card);
+    ~AlsaMixerBackend();
+    bool open(const QString &element) override;
+    void close() override;
+    bool isOpen() const override;
+    bool setPlaybackVolume(int percent) override;
+
+private:
+    QString m_card;
+    snd_mixer_t *m_handle;
+    snd_mixer_elem_t *m_element;
+    long m_min;
+    long m_max;
+};
+
+/* Records what would have been applied. For tests and for running
+   the UI on machines without the audio hat (SINM_MIXER=fake). */
+class FakeMixerBackend : public MixerBackend
+{
+public:
+    bool open(const QString &element) override;
+    void close() override;
+    bool isOpen() const override;
+    bool setPlaybackVolume(int percent) override;
+    QString element() const { return m_element; }
+    QVector<int> appliedVolumes() const { return m_applied; }
+
+private:
+    QString m_element;
+    bool m_open = false;
+    QVector<int> m_applied;
+};
+
+/*
+ * Volume front end. Keeps only the latest requested value and applies
+ * it from the event loop, so a burst of slider changes ends up as one
+ * mixer write. A control that fails to open is retried with backoff.
+ */
+class Mixer : public QObject
+{
+    Q_OBJECT
+
+public:
+    Mixer(MixerBackend *backend, QObject *parent = nullptr);
+    ~Mixer();
+    static MixerBackend *createBackend();
+
+public slots:
+    void setElement(const QString &element);
+    void setVolume(int percent);
+
+private slots:
+    void apply();
+
+private:
+    MixerBackend *m_backend;
+    QString m_element;
+    bool m_reopen;
+    int m_pendingVolume;
+    /* Last value asked for, applied again to a new element */
+    int m_volume;
+    int m_retryDelay;
+    QTimer m_applyTimer;
+};
+
+#endif // MIXER_H
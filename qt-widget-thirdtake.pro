@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui dbus network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -9,14 +9,67 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    backlight.cpp \
+    buzzer.cpp \
+    callprewarm.cpp \
+    callsession.cpp \
+    calltrace.cpp \
+    camera.cpp \
+    configloader.cpp \
+    gallery.cpp \
+    gpioreader.cpp \
+    imagedecoder.cpp \
+    imagedelta.cpp \
+    imagereceiver.cpp \
+    inputrecorder.cpp \
+    jobrunner.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    mixer.cpp \
+    servicecontrol.cpp \
+    settingsstore.cpp \
+    spawner.cpp \
+    startuptrace.cpp \
+    telemetryqueue.cpp \
+    transfer.cpp \
+    voicemessage.cpp \
+    wificontrol.cpp \
+    wifiscanner.cpp
 
 HEADERS += \
-    mainwindow.h
+    backlight.h \
+    buzzer.h \
+    callprewarm.h \
+    callsession.h \
+    calltrace.h \
+    camera.h \
+    configloader.h \
+    gallery.h \
+    gpioreader.h \
+    imagedecoder.h \
+    imagedelta.h \
+    imagereceiver.h \
+    inputrecorder.h \
+    jobrunner.h \
+    mainwindow.h \
+    mixer.h \
+    nodes.h \
+    servicecontrol.h \
+    settingsstore.h \
+    spawner.h \
+    startuptrace.h \
+    telemetryqueue.h \
+    transfer.h \
+    voicemessage.h \
+    wificontrol.h \
+    wifiscanner.h
+
+LIBS += -lasound -lcodec2
 
 FORMS += \
-    mainwindow.ui
+    imageframe.ui \
+    mainwindow.ui \
+    settingsframe.ui
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
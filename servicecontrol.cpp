@@ -0,0 +1,270 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "servicecontrol.h"
+#include <QDebug>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusArgument>
+#include <QDBusError>
+#include <QTimer>
+
+#define SYSTEMD_UNIT            "org.freedesktop.systemd1.Unit"
+#define DBUS_PROPERTIES         "org.freedesktop.DBus.Properties"
+#define SYSTEMD_MOCK_BUS        "sinm-systemd-mock"
+#define SYSTEMD_MOCK_DELAY      500
+
+/* ServiceControl */
+
+ServiceControl::ServiceControl(const QDBusConnection &bus, QObject *parent)
+    : QObject(parent)
+    , m_bus(bus)
+    , m_pendingReplies(0)
+{
+    if (!m_bus.isConnected()) {
+        qDebug() << "Service control: no D-Bus connection:" << m_bus.lastError().message();
+        return;
+    }
+    m_bus.connect(SYSTEMD_SERVICE, SYSTEMD_PATH, SYSTEMD_MANAGER, "JobRemoved",
+                  this, SLOT(jobRemoved(uint,QDBusObjectPath,QString,QString)));
+    /* systemd only emits manager signals to subscribed clients */
+    QDBusMessage subscribe = QDBusMessage::createMethodCall(SYSTEMD_SERVICE, SYSTEMD_PATH,
+                                                            SYSTEMD_MANAGER, "Subscribe");
+    m_bus.asyncCall(subscribe);
+}
+
+ServiceControl *ServiceControl::create(QObject *parent)
+{
+    if (qEnvironmentVariable("SINM_SYSTEMD") == "mock") {
+        MockSystemdManager *mock = new MockSystemdManager(parent);
+        if (mock->registerService())
+            return new ServiceControl(QDBusConnection::sessionBus(), parent);
+        delete mock;
+    }
+    return new ServiceControl(QDBusConnection::systemBus(), parent);
+}
+
+QString ServiceControl::activeState(const QString &unit) const
+{
+    return m_activeStates.value(unit);
+}
+
+void ServiceControl::startUnit(const QString &unit)
+{
+    queueJob("StartUnit", unit, Start);
+}
+
+void ServiceControl::stopUnit(const QString &unit)
+{
+    queueJob("StopUnit", unit, Stop);
+}
+
+void ServiceControl::loadUnit(const QString &unit)
+{
+    watchUnit(unit);
+}
+
+void ServiceControl::queueJob(const QString &method, const QString &unit, Operation operation)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall(SYSTEMD_SERVICE, SYSTEMD_PATH,
+                                                       SYSTEMD_MANAGER, method);
+    call << unit << QString("replace");
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(m_bus.asyncCall(call), this);
+    watcher->setProperty("unit", unit);
+    watcher->setProperty("operation", (int)operation);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(jobQueued(QDBusPendingCallWatcher*)));
+    m_pendingReplies++;
+    watchUnit(unit);
+}
+
+void ServiceControl::jobQueued(QDBusPendingCallWatcher *watcher)
+{
+    watcher->deleteLater();
+    PendingJob job = { watcher->property("unit").toString(),
+                       (Operation)watcher->property("operation").toInt() };
+    QDBusPendingReply<QDBusObjectPath> reply = *watcher;
+    QString path = reply.isError() ? QString() : reply.value().path();
+    QString early = m_earlyResults.take(path);
+    /* Nothing else can claim an early result now */
+    if (--m_pendingReplies == 0)
+        m_earlyResults.clear();
+    if (reply.isError()) {
+        qDebug() << "Service control:" << job.unit << reply.error().message();
+        emit unitFailed(job.unit, reply.error().name());
+        return;
+    }
+    if (!early.isEmpty()) {
+        jobDone(job, early);
+        return;
+    }
+    m_jobs.insert(path, job);
+}
+
+void ServiceControl::jobRemoved(uint id, const QDBusObjectPath &job, const QString &unit, const QString &result)
+{
+    Q_UNUSED(id)
+    QString path = job.path();
+    if (m_jobs.contains(path)) {
+        jobDone(m_jobs.take(path), result);
+        return;
+    }
+    /* Reply not seen yet: keep results for our units only */
+    if (m_pendingReplies > 0 && m_activeStates.contains(unit))
+        m_earlyResults.insert(path, result);
+}
+
+void ServiceControl::jobDone(const PendingJob &job, const QString &result)
+{
+    if (result != "done") {
+        qDebug() << "Service control:" << job.unit << "job" << result;
+        emit unitFailed(job.unit, result);
+    } else if (job.operation == Start) {
+        emit unitStarted(job.unit);
+    } else {
+        emit unitStopped(job.unit);
+    }
+}
+
+/* Follow ActiveState through the unit's PropertiesChanged */
+void ServiceControl::watchUnit(const QString &unit)
+{
+    if (m_activeStates.contains(unit))
+        return;
+    m_activeStates.insert(unit, QString());
+    QDBusMessage call = QDBusMessage::createMethodCall(SYSTEMD_SERVICE, SYSTEMD_PATH,
+                                                       SYSTEMD_MANAGER, "LoadUnit");
+    call << unit;
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(m_bus.asyncCall(call), this);
+    watcher->setProperty("unit", unit);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(unitLoaded(QDBusPendingCallWatcher*)));
+}
+
+void ServiceControl::unitLoaded(QDBusPendingCallWatcher *watcher)
+{
+    watcher->deleteLater();
+    QString unit = watcher->property("unit").toString();
+    QDBusPendingReply<QDBusObjectPath> reply = *watcher;
+    if (reply.isError()) {
+        qDebug() << "Service control: LoadUnit" << unit << reply.error().message();
+        m_activeStates.remove(unit);
+        return;
+    }
+    QString path = reply.value().path();
+    m_unitPaths.insert(path, unit);
+    m_bus.connect(SYSTEMD_SERVICE, path, DBUS_PROPERTIES, "PropertiesChanged",
+                  this, SLOT(unitPropertiesChanged(QDBusMessage)));
+}
+
+void ServiceControl::unitPropertiesChanged(const QDBusMessage &message)
+{
+    QList<QVariant> args = message.arguments();
+    if (args.count() < 2 || args.at(0).toString() != SYSTEMD_UNIT)
+        return;
+    QString unit = m_unitPaths.value(message.path());
+    QVariantMap changed = qdbus_cast<QVariantMap>(args.at(1));
+    if (unit.isEmpty() || !changed.contains("ActiveState"))
+        return;
+    QString state = changed.value("ActiveState").toString();
+    if (state == m_activeStates.value(unit))
+        return;
+    m_activeStates.insert(unit, state);
+    emit unitStateChanged(unit, state);
+}
+
+/* Mock systemd manager */
+
+MockSystemdManager::MockSystemdManager(QObject *parent)
+    : QObject(parent)
+    , m_bus(QDBusConnection::connectToBus(QDBusConnection::SessionBus, SYSTEMD_MOCK_BUS))
+    , m_nextJob(1)
+    , m_result(qEnvironmentVariable("SINM_SYSTEMD_MOCK_RESULT", "done"))
+{
+}
+
+bool MockSystemdManager::registerService()
+{
+    if (!m_bus.registerObject(SYSTEMD_PATH, this, QDBusConnection::ExportAllSlots | QDBusConnection::ExportAllSignals)
+            || !m_bus.registerService(SYSTEMD_SERVICE)) {
+        qDebug() << "Mock systemd: can't register:" << m_bus.lastError().message();
+        return false;
+    }
+    return true;
+}
+
+QDBusObjectPath MockSystemdManager::StartUnit(const QString &name, const QString &mode)
+{
+    Q_UNUSED(mode)
+    setActiveState(name, "activating");
+    return queueJob(name, "active");
+}
+
+QDBusObjectPath MockSystemdManager::StopUnit(const QString &name, const QString &mode)
+{
+    Q_UNUSED(mode)
+    setActiveState(name, "deactivating");
+    return queueJob(name, "inactive");
+}
+
+QDBusObjectPath MockSystemdManager::LoadUnit(const QString &name)
+{
+    return QDBusObjectPath(unitPath(name));
+}
+
+void MockSystemdManager::Subscribe()
+{
+}
+
+QDBusObjectPath MockSystemdManager::queueJob(const QString &name, const QString &activeState)
+{
+    uint id = m_nextJob++;
+    QDBusObjectPath job(QString(SYSTEMD_PATH) + "/job/" + QString::number(id));
+    QString result = m_result;
+    QTimer::singleShot(SYSTEMD_MOCK_DELAY, this, [this, id, job, name, activeState, result]() {
+        setActiveState(name, result == "done" ? activeState : QString("failed"));
+        emit JobRemoved(id, job, name, result);
+    });
+    return job;
+}
+
+void MockSystemdManager::setActiveState(const QString &name, const QString &state)
+{
+    QDBusMessage message = QDBusMessage::createSignal(unitPath(name), DBUS_PROPERTIES, "PropertiesChanged");
+    message << QString(SYSTEMD_UNIT) << QVariantMap({ { "ActiveState", state } }) << QStringList();
+    m_bus.send(message);
+}
+
+/* systemd's bus path escaping: anything but [A-Za-z0-9] as _xx */
+QString MockSystemdManager::unitPath(const QString &name)
+{
+    QString escaped;
+    for (char c : name.toUtf8()) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+            escaped += QLatin1Char(c);
+        else
+            escaped += QString("_%1").arg((uint)(uchar)c, 2, 16, QLatin1Char('0'));
+    }
+    return QString(SYSTEMD_PATH) + "/unit/" + escaped;
+}
@@ -0,0 +1,133 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef SERVICECONTROL_H
+#define SERVICECONTROL_H
+
+#include <QObject>
+#include <QHash>
+#include <QDBusConnection>
+#include <QDBusObjectPath>
+
+class QDBusMessage;
+class QDBusPendingCallWatcher;
+
+#define SYSTEMD_SERVICE         "org.freedesktop.systemd1"
+#define SYSTEMD_PATH            "/org/freedesktop/systemd1"
+#define SYSTEMD_MANAGER         "org.freedesktop.systemd1.Manager"
+
+/*
+ * systemd unit control over D-Bus. StartUnit/StopUnit are queued with
+ * mode "replace" and reported done when systemd's JobRemoved arrives
+ * for the job, i.e. when the unit really is up (or down). ActiveState
+ * changes of units started here are followed as well, so a unit that
+ * dies later is noticed.
+ */
+class ServiceControl : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ServiceControl(const QDBusConnection &bus, QObject *parent = nullptr);
+    /* System bus, or the mock on the session bus with SINM_SYSTEMD=mock */
+    static ServiceControl *create(QObject *parent = nullptr);
+
+    QString activeState(const QString &unit) const;
+
+public slots:
+    void startUnit(const QString &unit);
+    void stopUnit(const QString &unit);
+    /* Have systemd load the unit ahead of a start */
+    void loadUnit(const QString &unit);
+
+signals:
+    void unitStarted(const QString &unit);
+    void unitStopped(const QString &unit);
+    /* Job result other than "done": failed, timeout, canceled, ... */
+    void unitFailed(const QString &unit, const QString &result);
+    void unitStateChanged(const QString &unit, const QString &activeState);
+
+private slots:
+    void jobQueued(QDBusPendingCallWatcher *watcher);
+    void jobRemoved(uint id, const QDBusObjectPath &job, const QString &unit, const QString &result);
+    void unitLoaded(QDBusPendingCallWatcher *watcher);
+    void unitPropertiesChanged(const QDBusMessage &message);
+
+private:
+    enum Operation { Start, Stop };
+    struct PendingJob
+    {
+        QString unit;
+        Operation operation;
+    };
+
+    void queueJob(const QString &method, const QString &unit, Operation operation);
+    void jobDone(const PendingJob &job, const QString &result);
+    void watchUnit(const QString &unit);
+
+    QDBusConnection m_bus;
+    QHash<QString, PendingJob> m_jobs;
+    /* JobRemoved that arrived before the StartUnit/StopUnit reply,
+       kept only while a reply is outstanding */
+    QHash<QString, QString> m_earlyResults;
+    int m_pendingReplies;
+    QHash<QString, QString> m_unitPaths;
+    QHash<QString, QString> m_activeStates;
+};
+
+/*
+ * Minimal stand-in for systemd's manager, for tests and for running
+ * the UI without systemd (SINM_SYSTEMD=mock). Registers itself on the
+ * session bus under the systemd name; jobs complete after
+ * SYSTEMD_MOCK_DELAY with the result from SINM_SYSTEMD_MOCK_RESULT
+ * ("done" if unset).
+ */
+class MockSystemdManager : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.systemd1.Manager")
+
+public:
+    explicit MockSystemdManager(QObject *parent = nullptr);
+    bool registerService();
+
+public slots:
+    QDBusObjectPath StartUnit(const QString &name, const QString &mode);
+    QDBusObjectPath StopUnit(const QString &name, const QString &mode);
+    QDBusObjectPath LoadUnit(const QString &name);
+    void Subscribe();
+
+signals:
+    void JobRemoved(uint id, const QDBusObjectPath &job, const QString &unit, const QString &result);
+
+private:
+    QDBusObjectPath queueJob(const QString &name, const QString &activeState);
+    void setActiveState(const QString &name, const QString &state);
+    static QString unitPath(const QString &name);
+
+    QDBusConnection m_bus;
+    uint m_nextJob;
+    QString m_result;
+};
+
+#endif // SERVICECONTROL_H
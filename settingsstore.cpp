@@ -0,0 +1,144 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#include "settingsstore.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+SettingsStore::SettingsStore(const QString &fileName, QObject *parent)
+    : QObject(parent)
+    , m_fileName(fileName)
+    , m_dirty(false)
+{
+    m_writeTimer.setSingleShot(true);
+    connect(&m_writeTimer, SIGNAL(timeout()), this, SLOT(flush()));
+    load();
+}
+
+SettingsStore::~SettingsStore()
+{
+    flush();
+}
+
+void SettingsStore::load()
+{
+    QSettings settings(m_fileName, QSettings::IniFormat);
+    const QStringList keys = settings.allKeys();
+    for (const QString &key : keys)
+        m_values.insert(key, settings.value(key));
+}
+
+/* Unsaved values stay over the file's, the write timer keeps running */
+bool SettingsStore::reload()
+{
+    QVariantMap previous = m_values;
+    m_values.clear();
+    load();
+    for (const QString &key : m_dirtyKeys)
+        m_values.insert(key, previous.value(key));
+    return m_values != previous;
+}
+
+QString SettingsStore::string(const QString &key, const QString &defaultValue) const
+{
+    return m_values.value(key, defaultValue).toString();
+}
+
+int SettingsStore::integer(const QString &key, int defaultValue) const
+{
+    return m_values.value(key, defaultValue).toInt();
+}
+
+bool SettingsStore::boolean(const QString &key, bool defaultValue) const
+{
+    return m_values.value(key, defaultValue).toBool();
+}
+
+bool SettingsStore::contains(const QString &key) const
+{
+    return m_values.contains(key);
+}
+
+void SettingsStore::setValue(const QString &key, const QVariant &value)
+{
+    if (m_values.contains(key) && m_values.value(key) == value)
+        return;
+    m_values.insert(key, value);
+    m_dirtyKeys.insert(key);
+    m_dirty = true;
+    /* Restart: write once the value has settled */
+    m_writeTimer.start(SETTINGS_WRITE_DELAY);
+    emit valueChanged(key);
+}
+
+bool SettingsStore::isDirty() const
+{
+    return m_dirty;
+}
+
+bool SettingsStore::flush()
+{
+    m_writeTimer.stop();
+    if (!m_dirty)
+        return true;
+
+    QString tmpName = m_fileName + ".tmp";
+    QFile::remove(tmpName);
+    {
+        QSettings settings(tmpName, QSettings::IniFormat);
+        for (auto it = m_values.constBegin(); it != m_values.constEnd(); ++it)
+            settings.setValue(it.key(), it.value());
+        settings.sync();
+        if (settings.status() != QSettings::NoError) {
+            qDebug() << "Settings write error:" << tmpName;
+            return false;
+        }
+    }
+
+    QByteArray tmpPath = QFile::encodeName(tmpName);
+    QByteArray finalPath = QFile::encodeName(m_fileName);
+    int fd = open(tmpPath.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    if (rename(tmpPath.constData(), finalPath.constData()) != 0) {
+        qErrnoWarning(errno, "Settings rename failed: %s", finalPath.constData());
+        return false;
+    }
+    /* Make the rename itself durable */
+    QByteArray dirPath = QFile::encodeName(QFileInfo(m_fileName).absolutePath());
+    int dirFd = open(dirPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    m_dirty = false;
+    m_dirtyKeys.clear();
+    return true;
+}
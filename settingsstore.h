@@ -0,0 +1,73 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SETTINGSSTORE_H
+#define SETTINGSSTORE_H
+
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#include <QVariantMap>
+
+#define SETTINGS_WRITE_DELAY    2000
+
+/*
+ * In-memory INI settings. File is read once at construction, changes
+ * are kept in memory and written behind after SETTINGS_WRITE_DELAY of
+ * quiet. Writes go to a temporary file which is fsync'd and renamed
+ * over the original, so a power cut leaves either old or new file.
+ * reload() takes the file's values and keeps unsaved ones over them.
+ */
+class SettingsStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SettingsStore(const QString &fileName, QObject *parent = nullptr);
+    ~SettingsStore();
+
+    QString string(const QString &key, const QString &defaultValue = QString()) const;
+    int integer(const QString &key, int defaultValue = 0) const;
+    bool boolean(const QString &key, bool defaultValue = false) const;
+    bool contains(const QString &key) const;
+    void setValue(const QString &key, const QVariant &value);
+    bool isDirty() const;
+
+public slots:
+    bool flush();
+    /* true when a value changed */
+    bool reload();
+
+signals:
+    void valueChanged(const QString &key);
+
+private:
+    void load();
+
+    QString m_fileName;
+    QVariantMap m_values;
+    QSet<QString> m_dirtyKeys;
+    bool m_dirty;
+    QTimer m_writeTimer;
+};
+
+#endif // SETTINGSSTORE_H
@@ -0,0 +1,428 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "spawner.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open          434
+#endif
+
+/* Exit polling interval where pidfd_open() is not available */
+#define SPAWN_EXIT_POLL         50
+
+extern char **environ;
+
+/* Called from the notifier's own activated(), so not deleted there */
+static void dropNotifier(QSocketNotifier *&notifier)
+{
+    if (!notifier)
+        return;
+    notifier->setEnabled(false);
+    notifier->deleteLater();
+    notifier = nullptr;
+}
+
+static int pidfdOpen(pid_t pid)
+{
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+SpawnedProcess::SpawnedProcess(QObject *parent)
+    : QObject(parent)
+    , m_pid(0)
+    , m_pidFd(-1)
+    , m_stdoutFd(-1)
+    , m_stderrFd(-1)
+    , m_exitNotifier(nullptr)
+    , m_stdoutNotifier(nullptr)
+    , m_stderrNotifier(nullptr)
+    , m_exitPoll(nullptr)
+    , m_exitCode(0)
+    , m_exitStatus(QProcess::NormalExit)
+    , m_detached(false)
+{
+}
+
+/* Like QProcess: a child still running is killed and reaped */
+SpawnedProcess::~SpawnedProcess()
+{
+    if (m_pid > 0 && !m_detached) {
+        ::kill(m_pid, SIGKILL);
+        waitpid(m_pid, nullptr, 0);
+    }
+    if (m_pidFd >= 0)
+        close(m_pidFd);
+    closePipes();
+}
+
+QProcess::ProcessState SpawnedProcess::state() const
+{
+    return m_pid > 0 ? QProcess::Running : QProcess::NotRunning;
+}
+
+bool SpawnedProcess::spawn(bool detached, pid_t *pid)
+{
+    int outPipe[2] = { -1, -1 };
+    int errPipe[2] = { -1, -1 };
+    QByteArray program = QFile::encodeName(m_program);
+    QByteArray outFile = QFile::encodeName(m_stdoutFile);
+    QByteArray errFile = QFile::encodeName(m_stderrFile);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    if (!outFile.isEmpty()) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, outFile.constData(),
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    } else if (!detached && pipe2(outPipe, O_CLOEXEC) == 0) {
+        posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+    }
+    if (!errFile.isEmpty()) {
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, errFile.constData(),
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    } else if (!detached && pipe2(errPipe, O_CLOEXEC) == 0) {
+        posix_spawn_file_actions_adddup2(&actions, errPipe[1], STDERR_FILENO);
+    }
+
+    /* Child starts with no blocked signals and default dispositions */
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGCHLD);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if (detached) {
+        /* Own process group, not hit by signals meant for the UI */
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, 0);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    QList<QByteArray> args;
+    args.append(program);
+    for (const QString &argument : qAsConst(m_arguments))
+        args.append(argument.toLocal8Bit());
+    QVector<char *> argv;
+    for (QByteArray &arg : args)
+        argv.append(arg.data());
+    argv.append(nullptr);
+
+    int err = posix_spawnp(pid, program.constData(), &actions, &attr, argv.data(), environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    for (int fd : { outPipe[1], errPipe[1] }) {
+        if (fd >= 0)
+            close(fd);
+    }
+    if (err != 0) {
+        m_errorString = QString::fromLocal8Bit(strerror(err));
+        for (int fd : { outPipe[0], errPipe[0] }) {
+            if (fd >= 0)
+                close(fd);
+        }
+        return false;
+    }
+    m_stdoutFd = outPipe[0];
+    m_stderrFd = errPipe[0];
+    for (int fd : { m_stdoutFd, m_stderrFd }) {
+        if (fd >= 0)
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return true;
+}
+
+void SpawnedProcess::start()
+{
+    if (m_pid > 0)
+        return;
+    m_stdout.clear();
+    m_stderr.clear();
+    m_exitCode = 0;
+    m_exitStatus = QProcess::NormalExit;
+
+    pid_t pid;
+    if (!spawn(false, &pid)) {
+        qDebug() << "Spawn failed:" << m_program << m_errorString;
+        emit errorOccurred(QProcess::FailedToStart);
+        return;
+    }
+    if (m_stdoutFd >= 0) {
+        m_stdoutNotifier = new QSocketNotifier(m_stdoutFd, QSocketNotifier::Read, this);
+        connect(m_stdoutNotifier, SIGNAL(activated(int)), this, SLOT(readStdout()));
+    }
+    if (m_stderrFd >= 0) {
+        m_stderrNotifier = new QSocketNotifier(m_stderrFd, QSocketNotifier::Read, this);
+        connect(m_stderrNotifier, SIGNAL(activated(int)), this, SLOT(readStderr()));
+    }
+    watchExit(pid);
+}
+
+void SpawnedProcess::watchExit(pid_t pid)
+{
+    m_pid = pid;
+    m_pidFd = pidfdOpen(pid);
+    if (m_pidFd >= 0) {
+        m_exitNotifier = new QSocketNotifier(m_pidFd, QSocketNotifier::Read, this);
+        connect(m_exitNotifier, SIGNAL(activated(int)), this, SLOT(checkExited()));
+    } else {
+        m_exitPoll = new QTimer(this);
+        connect(m_exitPoll, SIGNAL(timeout()), this, SLOT(checkExited()));
+        m_exitPoll->start(SPAWN_EXIT_POLL);
+    }
+}
+
+bool SpawnedProcess::startDetached(qint64 *pid)
+{
+    pid_t child;
+    if (!spawn(true, &child)) {
+        qDebug() << "Spawn failed:" << m_program << m_errorString;
+        return false;
+    }
+    /* Detached children are still ours to reap. The reaper is left
+       alone at exit, the child outlives the UI. */
+    SpawnedProcess *reaper = new SpawnedProcess(QCoreApplication::instance());
+    reaper->m_program = m_program;
+    reaper->m_detached = true;
+    reaper->watchExit(child);
+    connect(reaper, SIGNAL(finished(int,QProcess::ExitStatus)), reaper, SLOT(deleteLater()));
+    if (pid)
+        *pid = child;
+    return true;
+}
+
+/* Reads what's available. Returns true on end of file. */
+bool SpawnedProcess::readPipe(int fd, QByteArray &buffer)
+{
+    char chunk[4096];
+    for (;;) {
+        ssize_t len = read(fd, chunk, sizeof(chunk));
+        if (len > 0) {
+            buffer.append(chunk, len);
+            continue;
+        }
+        if (len < 0 && errno == EINTR)
+            continue;
+        return len == 0;
+    }
+}
+
+void SpawnedProcess::readStdout()
+{
+    if (m_stdoutFd < 0)
+        return;
+    int size = m_stdout.size();
+    if (readPipe(m_stdoutFd, m_stdout)) {
+        dropNotifier(m_stdoutNotifier);
+        close(m_stdoutFd);
+        m_stdoutFd = -1;
+    }
+    if (m_stdout.size() > size)
+        emit readyReadStandardOutput();
+}
+
+void SpawnedProcess::readStderr()
+{
+    if (m_stderrFd < 0)
+        return;
+    int size = m_stderr.size();
+    if (readPipe(m_stderrFd, m_stderr)) {
+        dropNotifier(m_stderrNotifier);
+        close(m_stderrFd);
+        m_stderrFd = -1;
+    }
+    if (m_stderr.size() > size)
+        emit readyReadStandardError();
+}
+
+void SpawnedProcess::closePipes()
+{
+    dropNotifier(m_stdoutNotifier);
+    dropNotifier(m_stderrNotifier);
+    for (int *fd : { &m_stdoutFd, &m_stderrFd }) {
+        if (*fd >= 0)
+            close(*fd);
+        *fd = -1;
+    }
+}
+
+void SpawnedProcess::checkExited()
+{
+    if (m_pid <= 0)
+        return;
+    int status = 0;
+    pid_t ret = waitpid(m_pid, &status, WNOHANG);
+    if (ret == 0 || (ret < 0 && errno == EINTR))
+        return;
+
+    /* Output written just before exit */
+    readStdout();
+    readStderr();
+    closePipes();
+    dropNotifier(m_exitNotifier);
+    if (m_exitPoll) {
+        m_exitPoll->stop();
+        m_exitPoll->deleteLater();
+        m_exitPoll = nullptr;
+    }
+    if (m_pidFd >= 0)
+        close(m_pidFd);
+    m_pidFd = -1;
+    m_pid = 0;
+
+    if (ret > 0 && WIFEXITED(status)) {
+        m_exitCode = WEXITSTATUS(status);
+        m_exitStatus = QProcess::NormalExit;
+    } else {
+        m_exitCode = ret > 0 && WIFSIGNALED(status) ? WTERMSIG(status) : -1;
+        m_exitStatus = QProcess::CrashExit;
+    }
+    emit finished(m_exitCode, m_exitStatus);
+}
+
+QByteArray SpawnedProcess::readAllStandardOutput()
+{
+    QByteArray data = m_stdout;
+    m_stdout.clear();
+    return data;
+}
+
+QByteArray SpawnedProcess::readAllStandardError()
+{
+    QByteArray data = m_stderr;
+    m_stderr.clear();
+    return data;
+}
+
+bool SpawnedProcess::waitForFinished(int msecs)
+{
+    QElapsedTimer clock;
+    clock.start();
+    while (m_pid > 0) {
+        int remaining = msecs < 0 ? -1 : qMax(0, msecs - (int)clock.elapsed());
+        if (msecs >= 0 && remaining == 0)
+            return false;
+        struct pollfd fds[3];
+        int count = 0;
+        for (int fd : { m_pidFd, m_stdoutFd, m_stderrFd }) {
+            if (fd >= 0)
+                fds[count++] = { fd, POLLIN, 0 };
+        }
+        int timeout = m_pidFd >= 0 ? remaining : SPAWN_EXIT_POLL;
+        if (m_pidFd < 0 && remaining >= 0)
+            timeout = qMin(timeout, remaining);
+        if (poll(fds, count, timeout) < 0 && errno != EINTR)
+            return false;
+        readStdout();
+        readStderr();
+        checkExited();
+    }
+    return true;
+}
+
+void SpawnedProcess::terminate()
+{
+    if (m_pid > 0)
+        ::kill(m_pid, SIGTERM);
+}
+
+void SpawnedProcess::kill()
+{
+    if (m_pid > 0)
+        ::kill(m_pid, SIGKILL);
+}
+
+static QString benchmarkSummary(const QString &name, QVector<qint64> samples)
+{
+    if (samples.isEmpty())
+        return name + ": no samples";
+    std::sort(samples.begin(), samples.end());
+    qint64 total = 0;
+    for (qint64 sample : qAsConst(samples))
+        total += sample;
+    auto percentile = [&samples](int p) {
+        return samples.at(qMin(samples.count() - 1, samples.count() * p / 100));
+    };
+    return QString("%1: n=%2 mean=%3us p50=%4us p95=%5us max=%6us")
+            .arg(name, -24).arg(samples.count())
+            .arg(total / samples.count()).arg(percentile(50))
+            .arg(percentile(95)).arg(samples.last());
+}
+
+/* Time from start() to start() returning and to the exit being seen,
+   run in the GUI process so fork has its real address space to copy. */
+QString SpawnedProcess::benchmark(const QString &program, int iterations)
+{
+    QVector<qint64> qprocessStart, qprocessTotal, spawnStart, spawnTotal;
+    QElapsedTimer clock;
+
+    for (int i = 0; i < iterations; i++) {
+        QProcess process;
+        process.setProgram(program);
+        clock.start();
+        process.start();
+        process.waitForStarted();
+        qprocessStart.append(clock.nsecsElapsed() / 1000);
+        process.waitForFinished();
+        qprocessTotal.append(clock.nsecsElapsed() / 1000);
+    }
+    for (int i = 0; i < iterations; i++) {
+        SpawnedProcess process;
+        process.setProgram(program);
+        clock.start();
+        process.start();
+        spawnStart.append(clock.nsecsElapsed() / 1000);
+        process.waitForFinished();
+        spawnTotal.append(clock.nsecsElapsed() / 1000);
+    }
+
+    QStringList report;
+    report << "Spawn benchmark: " + program + " x" + QString::number(iterations);
+    report << benchmarkSummary("QProcess start", qprocessStart);
+    report << benchmarkSummary("QProcess to exit", qprocessTotal);
+    report << benchmarkSummary("posix_spawn start", spawnStart);
+    report << benchmarkSummary("posix_spawn to exit", spawnTotal);
+    return report.join("\n");
+}
@@ -0,0 +1,122 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef SPAWNER_H
+#define SPAWNER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QStringList>
+#include <sys/types.h>
+
+#define SPAWN_BENCHMARK_PROGRAM "/bin/true"
+#define SPAWN_BENCHMARK_FILE    "/tmp/sinm-spawn.benchmark"
+
+class QSocketNotifier;
+class QTimer;
+
+/*
+ * External process started with posix_spawnp(). glibc implements it
+ * with clone(CLONE_VM | CLONE_VFORK): the child execs straight from
+ * the parent's address space, nothing of the GUI process is copied.
+ *
+ * API is the subset of QProcess used here, same names and signals.
+ * Exit is detected through a pidfd (polled with waitpid() on kernels
+ * without pidfd_open). Output is captured through non-blocking pipes.
+ */
+class SpawnedProcess : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SpawnedProcess(QObject *parent = nullptr);
+    ~SpawnedProcess();
+
+    void setProgram(const QString &program) { m_program = program; }
+    void setArguments(const QStringList &arguments) { m_arguments = arguments; }
+    QString program() const { return m_program; }
+    QStringList arguments() const { return m_arguments; }
+    /* Redirect to a file instead of capturing, e.g. QProcess::nullDevice() */
+    void setStandardOutputFile(const QString &fileName) { m_stdoutFile = fileName; }
+    void setStandardErrorFile(const QString &fileName) { m_stderrFile = fileName; }
+
+    void start();
+    /* Child is not tracked by this object, output is inherited unless
+       redirected. The process is reaped in the background. */
+    bool startDetached(qint64 *pid = nullptr);
+
+    QProcess::ProcessState state() const;
+    qint64 processId() const { return m_pid; }
+    int exitCode() const { return m_exitCode; }
+    QProcess::ExitStatus exitStatus() const { return m_exitStatus; }
+    QString errorString() const { return m_errorString; }
+    QByteArray readAllStandardOutput();
+    QByteArray readAllStandardError();
+
+    bool waitForFinished(int msecs = 30000);
+
+    /* Spawn latency of QProcess against SpawnedProcess, report text */
+    static QString benchmark(const QString &program, int iterations);
+
+public slots:
+    void terminate();
+    void kill();
+
+signals:
+    void readyReadStandardOutput();
+    void readyReadStandardError();
+    void finished(int exitCode, QProcess::ExitStatus exitStatus);
+    void errorOccurred(QProcess::ProcessError error);
+
+private slots:
+    void readStdout();
+    void readStderr();
+    void checkExited();
+
+private:
+    bool spawn(bool detached, pid_t *pid);
+    void watchExit(pid_t pid);
+    void closePipes();
+    static bool readPipe(int fd, QByteArray &buffer);
+
+    QString m_program;
+    QStringList m_arguments;
+    QString m_stdoutFile;
+    QString m_stderrFile;
+    pid_t m_pid;
+    int m_pidFd;
+    int m_stdoutFd;
+    int m_stderrFd;
+    QSocketNotifier *m_exitNotifier;
+    QSocketNotifier *m_stdoutNotifier;
+    QSocketNotifier *m_stderrNotifier;
+    QTimer *m_exitPoll;
+    QByteArray m_stdout;
+    QByteArray m_stderr;
+    int m_exitCode;
+    QProcess::ExitStatus m_exitStatus;
+    QString m_errorString;
+    bool m_detached;
+};
+
+#endif // SPAWNER_H
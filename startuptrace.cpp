@@ -0,0 +1,87 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "startuptrace.h"
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+#include <time.h>
+#include <unistd.h>
+
+qint64 StartupTrace::s_originUs = 0;
+QVector<StartupTrace::Phase> StartupTrace::s_phases;
+
+qint64 StartupTrace::bootTimeNowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (qint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Process start time from /proc/self/stat (field 22, clock ticks since
+   boot). Falls back to now if it can't be read. */
+qint64 StartupTrace::processStartUs()
+{
+    QFile stat("/proc/self/stat");
+    if (!stat.open(QIODevice::ReadOnly))
+        return bootTimeNowUs();
+    QByteArray line = stat.readAll();
+    /* Command name may contain spaces, fields are counted after it */
+    int commEnd = line.lastIndexOf(')');
+    QList<QByteArray> fields = line.mid(commEnd + 2).split(' ');
+    if (commEnd < 0 || fields.count() < 20)
+        return bootTimeNowUs();
+    qint64 ticks = fields.at(19).toLongLong();
+    return ticks * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+void StartupTrace::begin()
+{
+    s_phases.clear();
+    s_originUs = processStartUs();
+    mark("main");
+}
+
+void StartupTrace::mark(const QString &phase)
+{
+    s_phases.append({ phase, bootTimeNowUs() });
+}
+
+void StartupTrace::report()
+{
+    QFile file(STARTUP_TRACE_FILE);
+    bool writeFile = file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text);
+    QTextStream out(&file);
+
+    qint64 previousUs = s_originUs;
+    for (const Phase &phase : qAsConst(s_phases)) {
+        QString line = QString("%1 %2 ms (at %3 ms)")
+                .arg(phase.name, -20)
+                .arg((phase.endUs - previousUs) / 1000.0, 8, 'f', 1)
+                .arg((phase.endUs - s_originUs) / 1000.0, 0, 'f', 1);
+        qDebug() << "Startup:" << qPrintable(line);
+        if (writeFile)
+            out << line << Qt::endl;
+        previousUs = phase.endUs;
+    }
+}
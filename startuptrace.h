@@ -0,0 +1,59 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+#include <QString>
+#include <QVector>
+
+#define STARTUP_TRACE_FILE      "/tmp/sinm-startup.trace"
+
+/*
+ * Startup phase timing. Times are measured from process start (exec),
+ * so dynamic linking and QApplication setup are included. mark() ends
+ * the current phase, report() logs the phases and writes them to
+ * STARTUP_TRACE_FILE. GUI thread only.
+ */
+class StartupTrace
+{
+public:
+    static void begin();
+    static void mark(const QString &phase);
+    static void report();
+
+private:
+    struct Phase
+    {
+        QString name;
+        qint64 endUs;
+    };
+
+    static qint64 bootTimeNowUs();
+    static qint64 processStartUs();
+
+    static qint64 s_originUs;
+    static QVector<Phase> s_phases;
+};
+
+#endif // STARTUPTRACE_H
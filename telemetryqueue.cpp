@@ -0,0 +1,88 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "telemetryqueue.h"
+#include <QDebug>
+
+TelemetryQueue::TelemetryQueue(QObject *parent)
+    : QObject(parent)
+    , m_waiting(false)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+void TelemetryQueue::request(QObject *owner, const QString &peerIp, const QString &command,
+                             Callback callback, int timeout)
+{
+    m_requests.append({ owner, peerIp, command, callback, timeout });
+    send();
+}
+
+void TelemetryQueue::cancel(QObject *owner)
+{
+    for (int x = m_requests.size() - 1; x >= (m_waiting ? 1 : 0); x--) {
+        if ( m_requests[x].owner == owner )
+            m_requests.removeAt(x);
+    }
+    if ( m_waiting && m_requests.first().owner == owner ) {
+        m_requests.first().owner = nullptr;
+        m_requests.first().callback = nullptr;
+    }
+}
+
+void TelemetryQueue::send()
+{
+    if ( m_waiting || m_requests.isEmpty() )
+        return;
+    m_waiting = true;
+    m_timer.start(m_requests.first().timeout);
+    emit command(m_requests.first().command);
+}
+
+void TelemetryQueue::reply(const QString &ip, const QString &status)
+{
+    if ( !m_waiting )
+        return;
+    if ( ip != m_requests.first().peerIp || status == "available" )
+        return;
+    m_timer.stop();
+    complete(true);
+}
+
+void TelemetryQueue::timeout()
+{
+    if ( !m_waiting )
+        return;
+    qDebug() << "Telemetry: no reply to" << m_requests.first().command;
+    complete(false);
+}
+
+void TelemetryQueue::complete(bool replied)
+{
+    m_waiting = false;
+    Request done = m_requests.takeFirst();
+    if ( done.callback )
+        done.callback(replied);
+    send();
+}
@@ -0,0 +1,84 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef TELEMETRYQUEUE_H
+#define TELEMETRYQUEUE_H
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <functional>
+
+/*
+ * Telemetry FIFO commands that expect a reply. Replies carry no
+ * request id: a line from the peer the oldest request went to answers
+ * it, so only one is sent at a time, whichever call session it belongs
+ * to. Lines from other peers are left to their sessions, and
+ * 'available' (the answer to a pre-warm 'status') is skipped.
+ */
+class TelemetryQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    /* false: no reply within timeout */
+    typedef std::function<void(bool replied)> Callback;
+
+    explicit TelemetryQueue(QObject *parent = nullptr);
+
+    void request(QObject *owner, const QString &peerIp, const QString &command,
+                 Callback callback, int timeout);
+    /* Drop owner's requests. The one sent still holds the queue until
+       its reply or timeout, but its callback is not run. */
+    void cancel(QObject *owner);
+
+public slots:
+    /* Every line read from the telemetry FIFO */
+    void reply(const QString &ip, const QString &status);
+
+signals:
+    /* Line for the telemetry FIFO */
+    void command(const QString &line);
+
+private slots:
+    void timeout();
+
+private:
+    struct Request
+    {
+        QObject *owner;
+        QString peerIp;
+        QString command;
+        Callback callback;
+        int timeout;
+    };
+
+    void send();
+    void complete(bool replied);
+
+    QList<Request> m_requests;
+    bool m_waiting;
+    QTimer m_timer;
+};
+
+#endif // TELEMETRYQUEUE_H
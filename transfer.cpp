@@ -0,0 +1,664 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "transfer.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QSettings>
+#include <QtEndian>
+#include <functional>
+#include <stdio.h>
+#include <errno.h>
+
+/* Largest frame: a chunk with its index, or a manifest of
+   TRANSFER_MAX_SIZE / TRANSFER_CHUNK_SIZE hashes */
+#define TRANSFER_MAX_FRAME      (TRANSFER_CHUNK_SIZE + 1024)
+#define TRANSFER_HEADER_SIZE    5
+#define TRANSFER_HASH_SIZE      32
+
+static QByteArray sha256(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+static QDataStream &operator<<(QDataStream &out, const TransferManifest &manifest)
+{
+    return out << manifest.id << manifest.size << qint32(manifest.chunkSize) << manifest.chunks;
+}
+
+static QDataStream &operator>>(QDataStream &in, TransferManifest &manifest)
+{
+    qint32 chunkSize;
+    in >> manifest.id >> manifest.size >> chunkSize >> manifest.chunks;
+    manifest.chunkSize = chunkSize;
+    return in;
+}
+
+/* Payloads are built and read with the same stream version on both ends */
+static QByteArray encode(const std::function<void(QDataStream &)> &fill)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+    fill(out);
+    return payload;
+}
+
+static void prepare(QDataStream &in)
+{
+    in.setVersion(QDataStream::Qt_5_12);
+}
+
+/* Manifest */
+
+int TransferManifest::chunkLength(int index) const
+{
+    return int(qMin<qint64>(chunkSize, size - chunkOffset(index)));
+}
+
+bool TransferManifest::isValid() const
+{
+    if (id.size() != TRANSFER_HASH_SIZE || size <= 0 || size > TRANSFER_MAX_SIZE)
+        return false;
+    if (chunkSize <= 0 || chunkSize > TRANSFER_CHUNK_SIZE)
+        return false;
+    if (chunks.size() != (size + chunkSize - 1) / chunkSize)
+        return false;
+    for (const QByteArray &hash : chunks) {
+        if (hash.size() != TRANSFER_HASH_SIZE)
+            return false;
+    }
+    return true;
+}
+
+/* Link */
+
+void TransferLink::write(QTcpSocket *socket, Type type, const QByteArray &payload)
+{
+    char header[TRANSFER_HEADER_SIZE];
+    qToBigEndian<quint32>(quint32(payload.size() + 1), header);
+    header[4] = char(type);
+    socket->write(header, sizeof(header));
+    socket->write(payload);
+}
+
+bool TransferLink::take(QByteArray &buffer, Type &type, QByteArray &payload)
+{
+    if (buffer.size() < TRANSFER_HEADER_SIZE)
+        return false;
+    quint32 length = qFromBigEndian<quint32>(buffer.constData());
+    if (length == 0 || length > TRANSFER_MAX_FRAME) {
+        type = Invalid;
+        buffer.clear();
+        return true;
+    }
+    if (quint32(buffer.size()) < length + 4)
+        return false;
+    type = Type(quint8(buffer.at(4)));
+    payload = buffer.mid(TRANSFER_HEADER_SIZE, length - 1);
+    buffer.remove(0, length + 4);
+    return true;
+}
+
+/* Sender */
+
+TransferSender::TransferSender(QObject *parent)
+    : QObject(parent)
+    , m_next(0)
+    , m_retries(0)
+    , m_busy(false)
+    , m_reached(false)
+    , m_socket(nullptr)
+    , m_sessionBytes(0)
+{
+    m_retryTimer.setSingleShot(true);
+    connect(&m_retryTimer, SIGNAL(timeout()), this, SLOT(connectToPeer()));
+    m_idleTimer.setSingleShot(true);
+    connect(&m_idleTimer, SIGNAL(timeout()), this, SLOT(idleTimeout()));
+}
+
+bool TransferSender::send(const QString &peerIp, const QString &fileName)
+{
+    if (m_busy)
+        return false;
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Transfer open failed:" << fileName << m_file.errorString();
+        return false;
+    }
+    if (m_file.size() <= 0 || m_file.size() > TRANSFER_MAX_SIZE) {
+        qDebug() << "Transfer size not accepted:" << fileName << m_file.size();
+        m_file.close();
+        return false;
+    }
+
+    /* One read builds both the chunk hashes and the file hash */
+    m_manifest = TransferManifest();
+    m_manifest.size = m_file.size();
+    QCryptographicHash whole(QCryptographicHash::Sha256);
+    for (int index = 0; m_manifest.chunkOffset(index) < m_manifest.size; index++) {
+        QByteArray data = m_file.read(m_manifest.chunkLength(index));
+        if (data.size() != m_manifest.chunkLength(index)) {
+            qDebug() << "Transfer read failed:" << fileName << m_file.errorString();
+            m_file.close();
+            return false;
+        }
+        whole.addData(data);
+        m_manifest.chunks.append(sha256(data));
+    }
+    m_manifest.id = whole.result();
+
+    m_peerIp = peerIp;
+    QSettings state(TRANSFER_STATE_FILE, QSettings::IniFormat);
+    m_acked = state.value(stateKey()).toBitArray();
+    if (m_acked.size() != m_manifest.chunkCount())
+        m_acked = QBitArray(m_manifest.chunkCount());
+    m_retries = 0;
+    m_busy = true;
+    m_reached = false;
+    m_clock.start();
+    m_sessionBytes = 0;
+    reportProgress();
+    connectToPeer();
+    return true;
+}
+
+/* Acked chunks stay in the state file, sending the same file resumes */
+void TransferSender::cancel()
+{
+    if (!m_busy)
+        return;
+    closeSocket();
+    m_retryTimer.stop();
+    m_file.close();
+    m_busy = false;
+}
+
+void TransferSender::connectToPeer()
+{
+    closeSocket();
+    m_buffer.clear();
+    m_inFlight.clear();
+    m_socket = new QTcpSocket(this);
+    connect(m_socket, SIGNAL(connected()), this, SLOT(connected()));
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(readFrames()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(disconnected()));
+    connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(disconnected()));
+    m_socket->connectToHost(m_peerIp, TRANSFER_PORT);
+    m_idleTimer.start(TRANSFER_IDLE_TIMEOUT);
+}
+
+void TransferSender::connected()
+{
+    m_reached = true;
+    m_idleTimer.start(TRANSFER_IDLE_TIMEOUT);
+    TransferLink::write(m_socket, TransferLink::Offer,
+                        encode([this](QDataStream &out) { out << m_manifest; }));
+}
+
+void TransferSender::readFrames()
+{
+    if (!m_socket)
+        return;
+    m_idleTimer.start(TRANSFER_IDLE_TIMEOUT);
+    m_buffer.append(m_socket->readAll());
+    TransferLink::Type type;
+    QByteArray payload;
+    while (m_socket && TransferLink::take(m_buffer, type, payload)) {
+        switch (type) {
+        case TransferLink::Have:
+            handleHave(payload);
+            break;
+        case TransferLink::Ack:
+            handleAck(payload);
+            break;
+        case TransferLink::Nack:
+            handleNack(payload);
+            break;
+        case TransferLink::Done:
+            handleDone(payload);
+            break;
+        default:
+            retry("protocol error");
+            break;
+        }
+    }
+}
+
+void TransferSender::disconnected()
+{
+    if (!m_busy || !m_socket)
+        return;
+    if (!m_reached && m_socket->error() == QAbstractSocket::ConnectionRefusedError)
+        fail("peer has no transfer service");
+    else
+        retry(m_socket->errorString());
+}
+
+void TransferSender::idleTimeout()
+{
+    if (m_busy)
+        retry("peer not responding");
+}
+
+/* The receiver knows what actually reached its disk */
+void TransferSender::handleHave(const QByteArray &payload)
+{
+    QDataStream in(payload);
+    prepare(in);
+    QBitArray have;
+    in >> have;
+    if (have.size() != m_manifest.chunkCount()) {
+        fail("peer refused the offer");
+        return;
+    }
+    m_acked = have;
+    saveState();
+    m_next = 0;
+    reportProgress();
+    fillWindow();
+}
+
+void TransferSender::handleAck(const QByteArray &payload)
+{
+    QDataStream in(payload);
+    prepare(in);
+    qint32 index;
+    in >> index;
+    if (!m_inFlight.removeOne(index))
+        return;
+    m_acked.setBit(index);
+    m_sessionBytes += m_manifest.chunkLength(index);
+    m_retries = 0;
+    saveState();
+    reportProgress();
+    fillWindow();
+}
+
+void TransferSender::handleNack(const QByteArray &payload)
+{
+    QDataStream in(payload);
+    prepare(in);
+    qint32 index;
+    in >> index;
+    if (!m_inFlight.removeOne(index))
+        return;
+    if (++m_retries > TRANSFER_MAX_RETRIES) {
+        fail("chunk rejected by peer");
+        return;
+    }
+    qDebug() << "Transfer chunk rejected, resending:" << index;
+    sendChunk(index);
+}
+
+void TransferSender::handleDone(const QByteArray &payload)
+{
+    QDataStream in(payload);
+    prepare(in);
+    bool ok;
+    in >> ok;
+    clearState();
+    if (!ok) {
+        fail("file rejected by peer");
+        return;
+    }
+    closeSocket();
+    m_file.close();
+    m_busy = false;
+    emit finished();
+}
+
+void TransferSender::fillWindow()
+{
+    while (m_socket && m_inFlight.size() < TRANSFER_WINDOW) {
+        while (m_next < m_manifest.chunkCount()
+               && (m_acked.testBit(m_next) || m_inFlight.contains(m_next)))
+            m_next++;
+        if (m_next >= m_manifest.chunkCount())
+            return;
+        sendChunk(m_next++);
+    }
+}
+
+void TransferSender::sendChunk(int index)
+{
+    if (!m_file.seek(m_manifest.chunkOffset(index))) {
+        fail(m_file.errorString());
+        return;
+    }
+    QByteArray data = m_file.read(m_manifest.chunkLength(index));
+    if (data.size() != m_manifest.chunkLength(index)) {
+        fail("file changed while sending");
+        return;
+    }
+    TransferLink::write(m_socket, TransferLink::Chunk,
+                        encode([index, &data](QDataStream &out) { out << qint32(index) << data; }));
+    m_inFlight.append(index);
+}
+
+QString TransferSender::stateKey() const
+{
+    return m_peerIp + "/" + QString::fromLatin1(m_manifest.id.toHex());
+}
+
+void TransferSender::saveState()
+{
+    QSettings state(TRANSFER_STATE_FILE, QSettings::IniFormat);
+    state.setValue(stateKey(), m_acked);
+}
+
+void TransferSender::clearState()
+{
+    QSettings state(TRANSFER_STATE_FILE, QSettings::IniFormat);
+    state.remove(stateKey());
+}
+
+void TransferSender::reportProgress()
+{
+    qint64 bytes = 0;
+    for (int index = 0; index < m_acked.size(); index++) {
+        if (m_acked.testBit(index))
+            bytes += m_manifest.chunkLength(index);
+    }
+    qint64 elapsed = qMax<qint64>(1, m_clock.elapsed());
+    emit progress(bytes, m_manifest.size, m_sessionBytes * 1000 / elapsed);
+}
+
+void TransferSender::retry(const QString &reason)
+{
+    if (m_retryTimer.isActive())
+        return;
+    closeSocket();
+    if (++m_retries > TRANSFER_MAX_RETRIES) {
+        fail(reason);
+        return;
+    }
+    qDebug() << "Transfer interrupted, retrying:" << reason;
+    m_retryTimer.start(TRANSFER_RETRY_DELAY);
+}
+
+void TransferSender::fail(const QString &error)
+{
+    qDebug() << "Transfer failed:" << m_peerIp << error;
+    closeSocket();
+    m_retryTimer.stop();
+    m_file.close();
+    m_busy = false;
+    emit failed(error);
+}
+
+/* Called from the socket's own signals, so the socket is deleted later */
+void TransferSender::closeSocket()
+{
+    m_idleTimer.stop();
+    if (!m_socket)
+        return;
+    disconnect(m_socket, nullptr, this, nullptr);
+    m_socket->abort();
+    m_socket->deleteLater();
+    m_socket = nullptr;
+}
+
+/* Receiver */
+
+TransferReceiver::TransferReceiver(const QString &fileName, QObject *parent)
+    : QObject(parent)
+    , m_fileName(fileName)
+    , m_dir(QFileInfo(fileName).absolutePath())
+    , m_bytes(0)
+    , m_sessionBytes(0)
+{
+    connect(&m_server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+    if (!m_server.listen(QHostAddress::Any, TRANSFER_PORT))
+        qDebug() << "Transfer listen failed:" << m_server.errorString();
+}
+
+void TransferReceiver::newConnection()
+{
+    const QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(TRANSFER_PEER_SUBNET);
+    while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+        bool ok;
+        QHostAddress address(socket->peerAddress().toIPv4Address(&ok));
+        if (!ok || !address.isInSubnet(subnet)) {
+            qDebug() << "Transfer refused from:" << socket->peerAddress().toString();
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+        /* A reconnecting sender replaces its dead connection, another
+           sender waits for the current one */
+        if (m_socket && address.toString() != m_peerIp
+                && m_lastActivity.isValid() && !m_lastActivity.hasExpired(TRANSFER_IDLE_TIMEOUT)) {
+            qDebug() << "Transfer busy, refused:" << address.toString();
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+        if (m_socket) {
+            disconnect(m_socket, nullptr, this, nullptr);
+            m_socket->abort();
+            m_socket->deleteLater();
+        }
+        m_socket = socket;
+        m_peerIp = address.toString();
+        m_lastActivity.start();
+        m_buffer.clear();
+        m_completedId.clear();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readFrames()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(disconnected()));
+    }
+}
+
+void TransferReceiver::readFrames()
+{
+    if (!m_socket)
+        return;
+    m_lastActivity.start();
+    m_buffer.append(m_socket->readAll());
+    TransferLink::Type type;
+    QByteArray payload;
+    while (m_socket && TransferLink::take(m_buffer, type, payload)) {
+        switch (type) {
+        case TransferLink::Offer:
+            handleOffer(payload);
+            break;
+        case TransferLink::Chunk:
+            handleChunk(payload);
+            break;
+        default:
+            drop("protocol error");
+            break;
+        }
+    }
+}
+
+/* Part file and state stay for the next offer */
+void TransferReceiver::disconnected()
+{
+    if (m_socket) {
+        m_socket->deleteLater();
+        m_socket = nullptr;
+    }
+    m_part.close();
+}
+
+void TransferReceiver::handleOffer(const QByteArray &payload)
+{
+    TransferManifest manifest;
+    QDataStream in(payload);
+    prepare(in);
+    in >> manifest;
+    if (!manifest.isValid()) {
+        drop("invalid manifest");
+        return;
+    }
+    m_part.close();
+    m_manifest = manifest;
+    m_completedId.clear();
+
+    /* Other peers' pictures in progress stay, abandoned ones go */
+    QDir dir(m_dir);
+    const QDateTime expired = QDateTime::currentDateTime().addSecs(-TRANSFER_PART_MAX_AGE);
+    const QFileInfoList stale = dir.entryInfoList({ ".*.part", ".*.state" }, QDir::Files | QDir::Hidden);
+    for (const QFileInfo &info : stale) {
+        if (info.absoluteFilePath() != partFile() && info.absoluteFilePath() != stateFile()
+                && info.lastModified() < expired)
+            dir.remove(info.fileName());
+    }
+
+    QSettings state(stateFile(), QSettings::IniFormat);
+    m_have = state.value("have").toBitArray();
+    m_part.setFileName(partFile());
+    if (m_have.size() != m_manifest.chunkCount() || !m_part.exists())
+        m_have = QBitArray(m_manifest.chunkCount());
+    if (!m_part.open(QIODevice::ReadWrite) || !m_part.resize(m_manifest.size)) {
+        drop("cannot write " + partFile() + ": " + m_part.errorString());
+        return;
+    }
+
+    m_bytes = 0;
+    for (int index = 0; index < m_have.size(); index++) {
+        if (m_have.testBit(index))
+            m_bytes += m_manifest.chunkLength(index);
+    }
+    m_sessionBytes = 0;
+    m_clock.start();
+    if (m_bytes == 0)
+        emit started();
+    emit progress(m_bytes, m_manifest.size, 0);
+    TransferLink::write(m_socket, TransferLink::Have,
+                        encode([this](QDataStream &out) { out << m_have; }));
+    if (m_have.count(true) == m_manifest.chunkCount())
+        complete();
+}
+
+void TransferReceiver::handleChunk(const QByteArray &payload)
+{
+    QDataStream in(payload);
+    prepare(in);
+    qint32 index;
+    QByteArray data;
+    in >> index >> data;
+    /* Resent chunks still in flight when the file completed */
+    if (!m_completedId.isEmpty())
+        return;
+    if (!m_part.isOpen() || index < 0 || index >= m_manifest.chunkCount()) {
+        drop("unexpected chunk");
+        return;
+    }
+    if (data.size() != m_manifest.chunkLength(index) || sha256(data) != m_manifest.chunks.at(index)) {
+        TransferLink::write(m_socket, TransferLink::Nack,
+                            encode([index](QDataStream &out) { out << index; }));
+        return;
+    }
+    if (!m_have.testBit(index)) {
+        /* Straight to its place in the final file */
+        if (!m_part.seek(m_manifest.chunkOffset(index)) || m_part.write(data) != data.size()) {
+            drop("write failed: " + m_part.errorString());
+            return;
+        }
+        m_have.setBit(index);
+        m_bytes += data.size();
+        m_sessionBytes += data.size();
+        saveState();
+        qint64 elapsed = qMax<qint64>(1, m_clock.elapsed());
+        emit progress(m_bytes, m_manifest.size, m_sessionBytes * 1000 / elapsed);
+    }
+    TransferLink::write(m_socket, TransferLink::Ack,
+                        encode([index](QDataStream &out) { out << index; }));
+    if (m_have.count(true) == m_manifest.chunkCount())
+        complete();
+}
+
+/* The whole file hash also catches chunks lost from the page cache
+   in a power cut after their state was saved */
+bool TransferReceiver::complete()
+{
+    QCryptographicHash whole(QCryptographicHash::Sha256);
+    bool ok = m_part.flush() && m_part.seek(0) && whole.addData(&m_part)
+              && whole.result() == m_manifest.id;
+    m_part.close();
+    QFile::remove(stateFile());
+    if (ok) {
+        QByteArray from = QFile::encodeName(partFile());
+        QByteArray to = QFile::encodeName(m_fileName);
+        if (rename(from.constData(), to.constData()) != 0) {
+            qErrnoWarning(errno, "Transfer rename failed: %s", to.constData());
+            ok = false;
+        }
+    }
+    if (!ok)
+        QFile::remove(partFile());
+    TransferLink::write(m_socket, TransferLink::Done,
+                        encode([ok](QDataStream &out) { out << ok; }));
+    QByteArray id = m_manifest.id;
+    reset();
+    m_completedId = id;
+    if (ok)
+        emit received(m_fileName, m_peerIp);
+    else
+        emit failed("file hash mismatch");
+    return ok;
+}
+
+void TransferReceiver::saveState()
+{
+    QSettings state(stateFile(), QSettings::IniFormat);
+    state.setValue("have", m_have);
+}
+
+void TransferReceiver::reset()
+{
+    m_part.close();
+    m_manifest = TransferManifest();
+    m_have.clear();
+    m_bytes = 0;
+}
+
+void TransferReceiver::drop(const QString &error)
+{
+    qDebug() << "Transfer dropped:" << error;
+    m_part.close();
+    if (m_socket) {
+        disconnect(m_socket, nullptr, this, nullptr);
+        m_socket->abort();
+        m_socket->deleteLater();
+        m_socket = nullptr;
+    }
+    emit failed(error);
+}
+
+QString TransferReceiver::partFile() const
+{
+    return m_dir + "/." + QString::fromLatin1(m_manifest.id.toHex()) + ".part";
+}
+
+QString TransferReceiver::stateFile() const
+{
+    return m_dir + "/." + QString::fromLatin1(m_manifest.id.toHex()) + ".state";
+}
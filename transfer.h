@@ -0,0 +1,211 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <QObject>
+#include <QBitArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#define TRANSFER_PORT           7731
+#define TRANSFER_CHUNK_SIZE     65536
+#define TRANSFER_WINDOW         4
+#define TRANSFER_RETRY_DELAY    3000
+#define TRANSFER_MAX_RETRIES    10
+#define TRANSFER_IDLE_TIMEOUT   20000
+#define TRANSFER_MAX_SIZE       (64 * 1024 * 1024)
+#define TRANSFER_STATE_FILE     "/tmp/sinm-transfer.ini"
+/* Part files untouched this long are given up */
+#define TRANSFER_PART_MAX_AGE   (30 * 60)
+/* Only the OTP tunnel addresses may push files */
+#define TRANSFER_PEER_SUBNET    "10.10.0.0/24"
+
+/* Description of a file, sent before any data */
+struct TransferManifest
+{
+    TransferManifest() : size(0), chunkSize(TRANSFER_CHUNK_SIZE) {}
+
+    QByteArray id;              /* SHA-256 of the whole file */
+    qint64 size;
+    int chunkSize;
+    QList<QByteArray> chunks;   /* SHA-256 of each chunk */
+
+    int chunkCount() const { return chunks.size(); }
+    qint64 chunkOffset(int index) const { return qint64(index) * chunkSize; }
+    int chunkLength(int index) const;
+    bool isValid() const;
+};
+
+/*
+ * Framing shared by both ends: quint32 length, quint8 type, then a
+ * QDataStream encoded payload. Frames are complete or not taken.
+ */
+class TransferLink
+{
+public:
+    enum Type { Invalid = 0, Offer, Have, Chunk, Ack, Nack, Done };
+
+    static void write(QTcpSocket *socket, Type type, const QByteArray &payload);
+    /* Next complete frame from the buffer, false until one is there.
+       An oversized frame comes out as Invalid. */
+    static bool take(QByteArray &buffer, Type &type, QByteArray &payload);
+};
+
+/*
+ * Sends one file at a time to a peer. The file is split into
+ * TRANSFER_CHUNK_SIZE chunks, each hashed into the manifest, and up to
+ * TRANSFER_WINDOW chunks are kept in flight. Chunks the peer acked are
+ * remembered per peer and file in TRANSFER_STATE_FILE; the peer's own
+ * list (Have) wins when it answers the offer. A dropped connection is
+ * retried after TRANSFER_RETRY_DELAY and continues where it stopped.
+ * A peer that refuses the connection before ever taking one has no
+ * transfer service, that fails at once; peerReached() tells the caller
+ * whether another way of sending is worth a try.
+ */
+class TransferSender : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransferSender(QObject *parent = nullptr);
+
+    bool isBusy() const { return m_busy; }
+    /* The peer accepted a connection during the last send() */
+    bool peerReached() const { return m_reached; }
+
+public slots:
+    bool send(const QString &peerIp, const QString &fileName);
+    void cancel();
+
+signals:
+    void progress(qint64 bytes, qint64 total, qint64 bytesPerSecond);
+    void finished();
+    void failed(const QString &error);
+
+private slots:
+    void connectToPeer();
+    void connected();
+    void readFrames();
+    void disconnected();
+    void idleTimeout();
+
+private:
+    void handleHave(const QByteArray &payload);
+    void handleAck(const QByteArray &payload);
+    void handleNack(const QByteArray &payload);
+    void handleDone(const QByteArray &payload);
+    void fillWindow();
+    void sendChunk(int index);
+    void saveState();
+    void clearState();
+    void reportProgress();
+    void retry(const QString &reason);
+    void fail(const QString &error);
+    void closeSocket();
+    QString stateKey() const;
+
+    QString m_peerIp;
+    QFile m_file;
+    TransferManifest m_manifest;
+    QBitArray m_acked;
+    QList<int> m_inFlight;
+    int m_next;
+    int m_retries;
+    bool m_busy;
+    bool m_reached;
+    QTcpSocket *m_socket;
+    QByteArray m_buffer;
+    QTimer m_retryTimer;
+    QTimer m_idleTimer;
+    QElapsedTimer m_clock;
+    qint64 m_sessionBytes;
+};
+
+/*
+ * Accepts files from the peer. Each chunk is checked against the
+ * manifest and written straight to its offset in a hidden part file
+ * next to the target, so nothing is copied when the file completes:
+ * the whole file hash is checked and the part file renamed over the
+ * target. The list of good chunks is kept next to the part file, a
+ * repeated offer resumes from it.
+ *
+ * One sender at a time: a second peer is refused while the current
+ * one is active and retries later, its part file is kept. Only the
+ * same peer reconnecting, or a peer quiet for TRANSFER_IDLE_TIMEOUT,
+ * is replaced.
+ */
+class TransferReceiver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransferReceiver(const QString &fileName, QObject *parent = nullptr);
+
+    bool isListening() const { return m_server.isListening(); }
+
+signals:
+    void started();
+    void progress(qint64 bytes, qint64 total, qint64 bytesPerSecond);
+    void received(const QString &fileName, const QString &peerIp);
+    void failed(const QString &error);
+
+private slots:
+    void newConnection();
+    void readFrames();
+    void disconnected();
+
+private:
+    void handleOffer(const QByteArray &payload);
+    void handleChunk(const QByteArray &payload);
+    bool complete();
+    void saveState();
+    void reset();
+    void drop(const QString &error);
+    QString partFile() const;
+    QString stateFile() const;
+
+    QString m_fileName;
+    QString m_dir;
+    QTcpServer m_server;
+    QPointer<QTcpSocket> m_socket;
+    QString m_peerIp;
+    QElapsedTimer m_lastActivity;
+    QByteArray m_buffer;
+    TransferManifest m_manifest;
+    /* Last file finished on this connection, until the next offer */
+    QByteArray m_completedId;
+    QBitArray m_have;
+    QFile m_part;
+    qint64 m_bytes;
+    qint64 m_sessionBytes;
+    QElapsedTimer m_clock;
+};
+
+#endif // TRANSFER_H
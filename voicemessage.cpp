@@ -0,0 +1,430 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "voicemessage.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QRandomGenerator>
+#include <QVector>
+#include <alsa/asoundlib.h>
+#include <codec2/codec2.h>
+
+#define VOICE_LATENCY_US        500000
+#define VOICE_ASSEMBLY_CHECK    1000
+#define VOICE_MAX_CHUNKS        40
+#define VOICE_DONE_KEEP         16
+
+/* Recorder */
+
+VoiceRecorder::VoiceRecorder(QObject *parent)
+    : QThread(parent)
+{
+}
+
+VoiceRecorder::~VoiceRecorder()
+{
+    stop();
+    wait();
+}
+
+void VoiceRecorder::record()
+{
+    if (isRunning())
+        return;
+    m_stop.storeRelaxed(0);
+    start();
+}
+
+void VoiceRecorder::run()
+{
+    QByteArray device = qEnvironmentVariable("SINM_VOICE_DEVICE", VOICE_DEVICE).toLocal8Bit();
+    snd_pcm_t *pcm;
+    int err = snd_pcm_open(&pcm, device.constData(), SND_PCM_STREAM_CAPTURE, 0);
+    if (err < 0) {
+        emit failed(QString("capture open: ") + snd_strerror(err));
+        return;
+    }
+    err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                             1, VOICE_SAMPLE_RATE, 1, VOICE_LATENCY_US);
+    if (err < 0) {
+        snd_pcm_close(pcm);
+        emit failed(QString("capture setup: ") + snd_strerror(err));
+        return;
+    }
+
+    struct CODEC2 *codec = codec2_create(CODEC2_MODE_1200);
+    const int samples = codec2_samples_per_frame(codec);
+    const int bytes = codec2_bytes_per_frame(codec);
+    const int maxFrames = VOICE_MAX_SECONDS * VOICE_SAMPLE_RATE / samples;
+    QVector<short> frame(samples);
+    QByteArray clip;
+    int frames = 0;
+    while (!m_stop.loadRelaxed() && frames < maxFrames) {
+        snd_pcm_sframes_t got = snd_pcm_readi(pcm, frame.data(), samples);
+        if (got < 0) {
+            err = snd_pcm_recover(pcm, int(got), 1);
+            if (err < 0) {
+                qDebug() << "Voice capture error:" << snd_strerror(err);
+                break;
+            }
+            continue;
+        }
+        for (int i = int(got); i < samples; i++)
+            frame[i] = 0;
+        QByteArray encoded(bytes, 0);
+        codec2_encode(codec, reinterpret_cast<unsigned char *>(encoded.data()), frame.data());
+        clip.append(encoded);
+        frames++;
+    }
+    codec2_destroy(codec);
+    snd_pcm_close(pcm);
+    emit recorded(clip, frames * samples * 1000 / VOICE_SAMPLE_RATE);
+}
+
+/* Player */
+
+VoicePlayer::VoicePlayer(QObject *parent)
+    : QThread(parent)
+{
+}
+
+VoicePlayer::~VoicePlayer()
+{
+    requestInterruption();
+    wait();
+}
+
+/* One clip at a time, a tap while playing is ignored */
+void VoicePlayer::play(const QByteArray &clip)
+{
+    if (isRunning() || clip.isEmpty())
+        return;
+    m_clip = clip;
+    start();
+}
+
+void VoicePlayer::run()
+{
+    QByteArray device = qEnvironmentVariable("SINM_VOICE_DEVICE", VOICE_DEVICE).toLocal8Bit();
+    snd_pcm_t *pcm;
+    int err = snd_pcm_open(&pcm, device.constData(), SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        qDebug() << "Voice playback open error:" << snd_strerror(err);
+        return;
+    }
+    err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                             1, VOICE_SAMPLE_RATE, 1, VOICE_LATENCY_US);
+    if (err < 0) {
+        qDebug() << "Voice playback setup error:" << snd_strerror(err);
+        snd_pcm_close(pcm);
+        return;
+    }
+
+    struct CODEC2 *codec = codec2_create(CODEC2_MODE_1200);
+    const int samples = codec2_samples_per_frame(codec);
+    const int bytes = codec2_bytes_per_frame(codec);
+    QVector<short> frame(samples);
+    for (int offset = 0; offset + bytes <= m_clip.size() && !isInterruptionRequested(); offset += bytes) {
+        codec2_decode(codec, frame.data(), reinterpret_cast<const unsigned char *>(m_clip.constData() + offset));
+        snd_pcm_sframes_t written = snd_pcm_writei(pcm, frame.constData(), samples);
+        if (written < 0 && snd_pcm_recover(pcm, int(written), 1) < 0) {
+            qDebug() << "Voice playback error:" << snd_strerror(int(written));
+            break;
+        }
+    }
+    if (isInterruptionRequested())
+        snd_pcm_drop(pcm);
+    else
+        snd_pcm_drain(pcm);
+    codec2_destroy(codec);
+    snd_pcm_close(pcm);
+}
+
+/* Messenger */
+
+VoiceMessenger::VoiceMessenger(QObject *parent)
+    : QObject(parent)
+    , m_nextId(1)
+{
+    connect(&m_sendTimer, SIGNAL(timeout()), this, SLOT(sendNext()));
+    connect(&m_assemblyTimer, SIGNAL(timeout()), this, SLOT(assemblyTimeout()));
+}
+
+bool VoiceMessenger::isVoicePayload(const QString &payload)
+{
+    return payload.startsWith("voice;") || payload.startsWith("voice_missing;");
+}
+
+int VoiceMessenger::send(const QString &peer, const QByteArray &clip, int durationMs)
+{
+    if (peer.isEmpty())
+        return 0;
+    int id = m_nextId++;
+    m_clips.insert(id, clip);
+    m_clipPeers.insert(id, peer);
+
+    Outgoing outgoing;
+    outgoing.peer = peer;
+    outgoing.id = QString::number(QRandomGenerator::global()->generate(), 16);
+    outgoing.durationMs = durationMs;
+    for (int offset = 0; offset < clip.size(); offset += VOICE_CHUNK_BYTES)
+        outgoing.chunks.append(clip.mid(offset, VOICE_CHUNK_BYTES));
+    if (m_connected.contains(peer))
+        startSending(outgoing);
+    else
+        m_outbox.append(outgoing);
+    return id;
+}
+
+/* Queued clips for the peer go out once it is there */
+void VoiceMessenger::setConnected(const QString &peer, bool connected)
+{
+    if (peer.isEmpty())
+        return;
+    if (!connected) {
+        m_connected.remove(peer);
+        return;
+    }
+    m_connected.insert(peer);
+    for (int x = 0; x < m_outbox.size(); ) {
+        if (m_outbox[x].peer == peer)
+            startSending(m_outbox.takeAt(x));
+        else
+            x++;
+    }
+    if (!m_pending.isEmpty() && !m_sendTimer.isActive())
+        m_sendTimer.start(VOICE_CHUNK_INTERVAL);
+}
+
+void VoiceMessenger::handlePayload(const QString &peer, const QString &payload)
+{
+    QStringList fields = payload.trimmed().split(';');
+    if (fields.first() == "voice")
+        handleChunk(peer, fields);
+    else if (fields.first() == "voice_missing")
+        handleMissing(peer, fields);
+}
+
+/* Erase: clips, half received ones and anything not yet sent */
+void VoiceMessenger::clear()
+{
+    m_sendTimer.stop();
+    m_assemblyTimer.stop();
+    m_outbox.clear();
+    m_sent.clear();
+    m_pending.clear();
+    m_incoming.clear();
+    m_done.clear();
+    m_clips.clear();
+    m_clipPeers.clear();
+}
+
+/* End of one peer's session: its clips both ways, the others stay */
+void VoiceMessenger::clear(const QString &peer)
+{
+    for (int x = m_outbox.size() - 1; x >= 0; x--) {
+        if (m_outbox[x].peer == peer)
+            m_outbox.removeAt(x);
+    }
+    for (int x = m_pending.size() - 1; x >= 0; x--) {
+        const Outgoing *outgoing = sentClip(m_pending[x].first);
+        if (!outgoing || outgoing->peer == peer)
+            m_pending.removeAt(x);
+    }
+    for (int x = m_sent.size() - 1; x >= 0; x--) {
+        if (m_sent[x].peer == peer)
+            m_sent.removeAt(x);
+    }
+    for (auto it = m_incoming.begin(); it != m_incoming.end(); ) {
+        if (it.value().peer == peer)
+            it = m_incoming.erase(it);
+        else
+            ++it;
+    }
+    for (int x = m_done.size() - 1; x >= 0; x--) {
+        if (m_done[x].startsWith(peer + ";"))
+            m_done.removeAt(x);
+    }
+    for (auto it = m_clipPeers.begin(); it != m_clipPeers.end(); ) {
+        if (it.value() == peer) {
+            m_clips.remove(it.key());
+            it = m_clipPeers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void VoiceMessenger::startSending(const Outgoing &outgoing)
+{
+    m_sent.append(outgoing);
+    while (m_sent.size() > VOICE_SENT_KEEP)
+        m_sent.removeFirst();
+    for (int seq = 0; seq < outgoing.chunks.size(); seq++)
+        queue(outgoing.id, seq);
+}
+
+void VoiceMessenger::queue(const QString &id, int seq)
+{
+    m_pending.append(qMakePair(id, seq));
+    if (!m_connected.isEmpty() && !m_sendTimer.isActive())
+        m_sendTimer.start(VOICE_CHUNK_INTERVAL);
+}
+
+const VoiceMessenger::Outgoing *VoiceMessenger::sentClip(const QString &id) const
+{
+    for (const Outgoing &outgoing : m_sent) {
+        if (outgoing.id == id)
+            return &outgoing;
+    }
+    return nullptr;
+}
+
+/* One chunk per tick, the message path is not flooded. Chunks of
+   peers not connected wait, those of clips no longer kept are
+   dropped. */
+void VoiceMessenger::sendNext()
+{
+    for (int x = 0; x < m_pending.size(); ) {
+        QPair<QString, int> next = m_pending.at(x);
+        const Outgoing *outgoing = sentClip(next.first);
+        if (!outgoing || next.second >= outgoing->chunks.size()) {
+            m_pending.removeAt(x);
+            continue;
+        }
+        if (!m_connected.contains(outgoing->peer)) {
+            x++;
+            continue;
+        }
+        m_pending.removeAt(x);
+        const QByteArray &chunk = outgoing->chunks.at(next.second);
+        emit message(outgoing->peer, QString("voice;%1;%2;%3;%4;%5;%6")
+                     .arg(outgoing->id).arg(next.second).arg(outgoing->chunks.size())
+                     .arg(outgoing->durationMs)
+                     .arg(qChecksum(chunk.constData(), uint(chunk.size())), 0, 16)
+                     .arg(QString::fromLatin1(chunk.toBase64())));
+        return;
+    }
+    m_sendTimer.stop();
+}
+
+void VoiceMessenger::handleChunk(const QString &peer, const QStringList &fields)
+{
+    if (fields.size() != 7)
+        return;
+    const QString id = fields.at(1);
+    const QString key = peer + ";" + id;
+    int seq = fields.at(2).toInt();
+    int count = fields.at(3).toInt();
+    if (m_done.contains(key) || count <= 0 || count > VOICE_MAX_CHUNKS || seq < 0 || seq >= count)
+        return;
+
+    Incoming &incoming = m_incoming[key];
+    if (incoming.chunks.isEmpty()) {
+        incoming.peer = peer;
+        incoming.id = id;
+        incoming.count = count;
+        incoming.durationMs = fields.at(4).toInt();
+        incoming.retries = 0;
+    }
+    if (incoming.count != count)
+        return;
+    /* Damaged on the way: ask for it again, the clip waits for it */
+    QByteArray chunk = QByteArray::fromBase64(fields.at(6).toLatin1());
+    bool ok;
+    if (fields.at(5).toUInt(&ok, 16) != qChecksum(chunk.constData(), uint(chunk.size())) || !ok) {
+        qDebug() << "Voice chunk checksum mismatch:" << peer << id << seq;
+        incoming.lastChunk = QDateTime::currentMSecsSinceEpoch();
+        if (!m_assemblyTimer.isActive())
+            m_assemblyTimer.start(VOICE_ASSEMBLY_CHECK);
+        if (m_connected.contains(peer))
+            emit message(peer, QString("voice_missing;%1;%2").arg(id).arg(seq));
+        return;
+    }
+    incoming.chunks.insert(seq, chunk);
+    incoming.lastChunk = QDateTime::currentMSecsSinceEpoch();
+
+    if (incoming.chunks.size() < incoming.count) {
+        if (!m_assemblyTimer.isActive())
+            m_assemblyTimer.start(VOICE_ASSEMBLY_CHECK);
+        return;
+    }
+    QByteArray clip;
+    for (int i = 0; i < incoming.count; i++)
+        clip.append(incoming.chunks.value(i));
+    int durationMs = incoming.durationMs;
+    m_incoming.remove(key);
+    m_done.append(key);
+    while (m_done.size() > VOICE_DONE_KEEP)
+        m_done.removeFirst();
+
+    int localId = m_nextId++;
+    m_clips.insert(localId, clip);
+    m_clipPeers.insert(localId, peer);
+    emit received(peer, localId, durationMs);
+}
+
+/* Only the peer a clip went to may ask for its chunks */
+void VoiceMessenger::handleMissing(const QString &peer, const QStringList &fields)
+{
+    if (fields.size() != 3)
+        return;
+    const Outgoing *outgoing = sentClip(fields.at(1));
+    if (!outgoing || outgoing->peer != peer)
+        return;
+    const QStringList seqs = fields.at(2).split('.', Qt::SkipEmptyParts);
+    for (const QString &seq : seqs)
+        queue(fields.at(1), seq.toInt());
+}
+
+/* Quiet clips ask for what they lack, then give up */
+void VoiceMessenger::assemblyTimeout()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = m_incoming.begin(); it != m_incoming.end(); ) {
+        Incoming &incoming = it.value();
+        if (now - incoming.lastChunk < VOICE_ASSEMBLY_TIMEOUT) {
+            ++it;
+            continue;
+        }
+        if (incoming.retries >= VOICE_MISSING_RETRIES) {
+            qDebug() << "Voice message incomplete:" << incoming.peer << incoming.id;
+            QString peer = incoming.peer;
+            it = m_incoming.erase(it);
+            emit failed(peer, "voice message incomplete");
+            continue;
+        }
+        incoming.retries++;
+        incoming.lastChunk = now;
+        QStringList missing;
+        for (int seq = 0; seq < incoming.count; seq++) {
+            if (!incoming.chunks.contains(seq))
+                missing.append(QString::number(seq));
+        }
+        if (m_connected.contains(incoming.peer))
+            emit message(incoming.peer, "voice_missing;" + incoming.id + ";" + missing.join('.'));
+        ++it;
+    }
+    if (m_incoming.isEmpty())
+        m_assemblyTimer.stop();
+}
@@ -0,0 +1,177 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef VOICEMESSAGE_H
+#define VOICEMESSAGE_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+
+#define VOICE_DEVICE            "default"
+#define VOICE_SAMPLE_RATE       8000
+#define VOICE_MAX_SECONDS       30
+/* Under the 190 character message limit once base64'd with its header */
+#define VOICE_CHUNK_BYTES       114
+#define VOICE_CHUNK_INTERVAL    50
+#define VOICE_ASSEMBLY_TIMEOUT  5000
+#define VOICE_MISSING_RETRIES   3
+#define VOICE_SENT_KEEP         4
+
+/*
+ * Records from ALSA until stop() or VOICE_MAX_SECONDS, encoding each
+ * 40 ms frame with Codec2 1200 bit/s as it comes in.
+ */
+class VoiceRecorder : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit VoiceRecorder(QObject *parent = nullptr);
+    ~VoiceRecorder();
+
+    void record();
+    void stop() { m_stop.storeRelaxed(1); }
+
+signals:
+    void recorded(const QByteArray &clip, int durationMs);
+    void failed(const QString &error);
+
+protected:
+    void run() override;
+
+private:
+    QAtomicInt m_stop;
+};
+
+/* Decodes a Codec2 clip and plays it to the end */
+class VoicePlayer : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit VoicePlayer(QObject *parent = nullptr);
+    ~VoicePlayer();
+
+    void play(const QByteArray &clip);
+
+protected:
+    void run() override;
+
+private:
+    QByteArray m_clip;
+};
+
+/*
+ * Voice messages over the text message path, held in RAM only. A clip
+ * is cut into base64 chunks of the form
+ *     voice;<id>;<seq>;<count>;<ms>;<crc>;<data>
+ * and written out paced, or kept in the outbox until the peer is
+ * connected. <crc> is the qChecksum() of the chunk in hex; a chunk
+ * that does not match is asked for again at once. The receiver asks
+ * for lost chunks once the clip has been quiet for
+ * VOICE_ASSEMBLY_TIMEOUT with
+ *     voice_missing;<id>;<seq>.<seq>...
+ * which is answered from the last VOICE_SENT_KEEP clips.
+ *
+ * Every clip belongs to one peer, by its OTP ip: it is sent to that
+ * peer only while that peer is connected, and clips coming in are
+ * assembled per peer. Clips without a peer are refused.
+ */
+class VoiceMessenger : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit VoiceMessenger(QObject *parent = nullptr);
+
+    static bool isVoicePayload(const QString &payload);
+    QByteArray clip(int id) const { return m_clips.value(id); }
+
+public slots:
+    /* Returns the local id for replay, 0 when refused */
+    int send(const QString &peer, const QByteArray &clip, int durationMs);
+    void setConnected(const QString &peer, bool connected);
+    void handlePayload(const QString &peer, const QString &payload);
+    void clear();
+    void clear(const QString &peer);
+
+signals:
+    /* Payload for the peer, to go out as a message */
+    void message(const QString &peer, const QString &payload);
+    void received(const QString &peer, int id, int durationMs);
+    void failed(const QString &peer, const QString &error);
+
+private slots:
+    void sendNext();
+    void assemblyTimeout();
+
+private:
+    struct Outgoing
+    {
+        QString peer;
+        QString id;
+        int durationMs;
+        QList<QByteArray> chunks;
+    };
+    struct Incoming
+    {
+        QString peer;
+        QString id;
+        int count;
+        int durationMs;
+        int retries;
+        QHash<int, QByteArray> chunks;
+        qint64 lastChunk;
+    };
+
+    void startSending(const Outgoing &outgoing);
+    void queue(const QString &id, int seq);
+    const Outgoing *sentClip(const QString &id) const;
+    void handleChunk(const QString &peer, const QStringList &fields);
+    void handleMissing(const QString &peer, const QStringList &fields);
+
+    QSet<QString> m_connected;
+    int m_nextId;
+    QList<Outgoing> m_outbox;
+    QList<Outgoing> m_sent;
+    /* Chunks waiting to be written, by clip id and sequence */
+    QList<QPair<QString, int>> m_pending;
+    /* By peer and clip id */
+    QHash<QString, Incoming> m_incoming;
+    /* Recently completed, by peer and clip id, late resends are ignored */
+    QStringList m_done;
+    QHash<int, QByteArray> m_clips;
+    /* Local clip id -> peer it went to or came from */
+    QHash<int, QString> m_clipPeers;
+    QTimer m_sendTimer;
+    QTimer m_assemblyTimer;
+};
+
+#endif // VOICEMESSAGE_H
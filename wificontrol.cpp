@@ -0,0 +1,621 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "wificontrol.h"
+#include <QDebug>
+#include <QDBusError>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+#include <QTimer>
+#include <algorithm>
+
+#define IWD_DEVICE              "net.connman.iwd.Device"
+#define IWD_STATION             "net.connman.iwd.Station"
+#define IWD_NETWORK             "net.connman.iwd.Network"
+#define IWD_KNOWN_NETWORK       "net.connman.iwd.KnownNetwork"
+#define IWD_AGENT_MANAGER       "net.connman.iwd.AgentManager"
+#define IWD_AGENT               "net.connman.iwd.Agent"
+#define IWD_ERROR_BUSY          "net.connman.iwd.Busy"
+#define IWD_ERROR_FAILED        "net.connman.iwd.Failed"
+#define IWD_AGENT_CANCELED      "net.connman.iwd.Agent.Error.Canceled"
+#define DBUS_PROPERTIES         "org.freedesktop.DBus.Properties"
+#define DBUS_OBJECT_MANAGER     "org.freedesktop.DBus.ObjectManager"
+#define WIFI_AGENT_PATH         "/sinm/wifiagent"
+#define IWD_MOCK_BUS            "sinm-iwd-mock"
+#define IWD_MOCK_STATION_PATH   "/net/connman/iwd/0/3"
+#define IWD_MOCK_SCAN_DELAY     1000
+#define IWD_MOCK_CONNECT_DELAY  800
+
+QDBusArgument &operator<<(QDBusArgument &argument, const IwdOrderedNetwork &network)
+{
+    argument.beginStructure();
+    argument << network.path << network.signal;
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, IwdOrderedNetwork &network)
+{
+    argument.beginStructure();
+    argument >> network.path >> network.signal;
+    argument.endStructure();
+    return argument;
+}
+
+static void registerIwdTypes()
+{
+    static bool registered = false;
+    if (registered)
+        return;
+    registered = true;
+    qDBusRegisterMetaType<IwdOrderedNetwork>();
+    qDBusRegisterMetaType<QList<IwdOrderedNetwork>>();
+    qDBusRegisterMetaType<IwdInterfaces>();
+    qDBusRegisterMetaType<IwdManagedObjects>();
+}
+
+/* WifiControl */
+
+WifiControl::WifiControl(const QDBusConnection &bus, const QString &interface, QObject *parent)
+    : QObject(parent)
+    , m_bus(bus)
+    , m_interface(interface)
+    , m_agent(new WifiAgent(this))
+    , m_serviceWatcher(nullptr)
+    , m_scanning(false)
+    , m_scanPending(false)
+{
+    registerIwdTypes();
+    if (!m_bus.isConnected()) {
+        qDebug() << "Wi-Fi control: no D-Bus connection:" << m_bus.lastError().message();
+        return;
+    }
+    if (!m_bus.registerObject(WIFI_AGENT_PATH, m_agent, QDBusConnection::ExportAllSlots))
+        qDebug() << "Wi-Fi control: can't register agent:" << m_bus.lastError().message();
+    /* iwd restarted: agent registration and object paths are gone */
+    m_serviceWatcher = new QDBusServiceWatcher(IWD_SERVICE, m_bus,
+                                               QDBusServiceWatcher::WatchForRegistration, this);
+    connect(m_serviceWatcher, SIGNAL(serviceRegistered(QString)), this, SLOT(registerAgent()));
+    connect(m_serviceWatcher, SIGNAL(serviceRegistered(QString)), this, SLOT(refresh()));
+    registerAgent();
+    refresh();
+}
+
+WifiControl *WifiControl::create(QObject *parent)
+{
+    if (qEnvironmentVariable("SINM_IWD") == "mock") {
+        MockIwd *mock = new MockIwd(parent);
+        if (mock->registerService())
+            return new WifiControl(QDBusConnection::sessionBus(), WIFI_INTERFACE, parent);
+        delete mock;
+    }
+    return new WifiControl(QDBusConnection::systemBus(), WIFI_INTERFACE, parent);
+}
+
+QString WifiControl::connectedNetwork() const
+{
+    return m_networks.value(m_connectedPath).value("Name").toString();
+}
+
+QStringList WifiControl::knownNetworks() const
+{
+    QStringList names;
+    for (const QVariantMap &properties : m_knownNetworks)
+        names.append(properties.value("Name").toString());
+    names.sort();
+    return names;
+}
+
+QDBusPendingCallWatcher *WifiControl::call(const QString &path, const QString &interface,
+                                           const QString &method, const QVariantList &args)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(IWD_SERVICE, path, interface, method);
+    message.setArguments(args);
+    return new QDBusPendingCallWatcher(m_bus.asyncCall(message), this);
+}
+
+QString WifiControl::findByName(const QHash<QString, QVariantMap> &objects, const QString &name)
+{
+    for (auto it = objects.constBegin(); it != objects.constEnd(); ++it) {
+        if (it.value().value("Name").toString() == name)
+            return it.key();
+    }
+    return QString();
+}
+
+void WifiControl::registerAgent()
+{
+    QDBusPendingCallWatcher *watcher = call(IWD_MANAGER_PATH, IWD_AGENT_MANAGER, "RegisterAgent",
+                                            { QVariant::fromValue(QDBusObjectPath(WIFI_AGENT_PATH)) });
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(agentRegistered(QDBusPendingCallWatcher*)));
+}
+
+void WifiControl::agentRegistered(QDBusPendingCallWatcher *watcher)
+{
+    watcher->deleteLater();
+    if (watcher->isError())
+        qDebug() << "Wi-Fi control: RegisterAgent:" << watcher->error().message();
+}
+
+void WifiControl::refresh()
+{
+    QDBusPendingCallWatcher *watcher = call("/", DBUS_OBJECT_MANAGER, "GetManagedObjects");
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(objectsReceived(QDBusPendingCallWatcher*)));
+}
+
+void WifiControl::objectsReceived(QDBusPendingCallWatcher *watcher)
+{
+    watcher->deleteLater();
+    QDBusPendingReply<IwdManagedObjects> reply = *watcher;
+    if (reply.isError()) {
+        qDebug() << "Wi-Fi control: GetManagedObjects:" << reply.error().message();
+        if (m_scanPending) {
+            m_scanPending = false;
+            emit scanFailed(reply.error().message());
+        }
+        return;
+    }
+
+    const IwdManagedObjects objects = reply.value();
+    QString stationPath;
+    QVariantMap station;
+    QStringList known = knownNetworks();
+    m_networks.clear();
+    m_knownNetworks.clear();
+    for (auto it = objects.constBegin(); it != objects.constEnd(); ++it) {
+        const IwdInterfaces &interfaces = it.value();
+        QString path = it.key().path();
+        if (interfaces.contains(IWD_STATION)
+                && interfaces.value(IWD_DEVICE).value("Name").toString() == m_interface) {
+            stationPath = path;
+            station = interfaces.value(IWD_STATION);
+        }
+        if (interfaces.contains(IWD_NETWORK))
+            m_networks.insert(path, interfaces.value(IWD_NETWORK));
+        if (interfaces.contains(IWD_KNOWN_NETWORK))
+            m_knownNetworks.insert(path, interfaces.value(IWD_KNOWN_NETWORK));
+    }
+
+    if (stationPath != m_stationPath) {
+        if (!m_stationPath.isEmpty())
+            m_bus.disconnect(IWD_SERVICE, m_stationPath, DBUS_PROPERTIES, "PropertiesChanged",
+                             this, SLOT(stationPropertiesChanged(QDBusMessage)));
+        m_stationPath = stationPath;
+        if (!m_stationPath.isEmpty())
+            m_bus.connect(IWD_SERVICE, m_stationPath, DBUS_PROPERTIES, "PropertiesChanged",
+                          this, SLOT(stationPropertiesChanged(QDBusMessage)));
+        else
+            qDebug() << "Wi-Fi control: no iwd station for" << m_interface;
+    }
+    m_scanning = station.value("Scanning").toBool();
+    m_connectedPath = station.value("ConnectedNetwork").value<QDBusObjectPath>().path();
+    QString state = station.value("State").toString();
+    if (state != m_state)
+        setState(state);
+    if (knownNetworks() != known)
+        emit knownNetworksChanged();
+
+    if (m_scanPending && !m_scanning) {
+        if (m_stationPath.isEmpty()) {
+            m_scanPending = false;
+            emit scanFailed("no station");
+        } else {
+            requestOrderedNetworks();
+        }
+    }
+}
+
+void WifiControl::setState(const QString &state)
+{
+    m_state = state;
+    emit stateChanged(m_state, connectedNetwork());
+}
+
+/* Results are fetched once the station's Scanning drops back to false */
+void WifiControl::scan()
+{
+    m_scanPending = true;
+    if (m_stationPath.isEmpty()) {
+        refresh();
+        return;
+    }
+    QDBusPendingCallWatcher *watcher = call(m_stationPath, IWD_STATION, "Scan");
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(scanStarted(QDBusPendingCallWatcher*)));
+}
+
+void WifiControl::scanStarted(QDBusPendingCallWatcher *watcher)
+{
+    watcher->deleteLater();
+    if (!watcher->isError())
+        return;
+    /* Busy: a scan is already running, its results will do */
+    if (watcher->error().name() != IWD_ERROR_BUSY) {
+        qDebug() << "Wi-Fi control: Scan:" << watcher->error().message();
+        refresh();
+    }
+}
+
+void WifiControl::requestOrderedNetworks()
+{
+    QDBusPendingCallWatcher *watcher = call(m_stationPath, IWD_STATION, "GetOrderedNetworks");
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(orderedNetworksReceived(QDBusPendingCallWatcher*)));
+}
+
+void WifiControl::orderedNetworksReceived(QDBusPendingCallWatcher *watcher)
+{
+    watcher->deleteLater();
+    m_scanPending = false;
+    QDBusPendingReply<QList<IwdOrderedNetwork>> reply = *watcher;
+    QList<WifiNetwork> networks;
+    if (reply.isError()) {
+        qDebug() << "Wi-Fi control: GetOrderedNetworks:" << reply.error().message();
+        emit scanFailed(reply.error().message());
+        return;
+    }
+    const QList<IwdOrderedNetwork> ordered = reply.value();
+    for (const IwdOrderedNetwork &entry : ordered) {
+        QString path = entry.path.path();
+        if (!m_networks.contains(path))
+            continue;
+        const QVariantMap properties = m_networks.value(path);
+        WifiNetwork network;
+        network.ssid = properties.value("Name").toString();
+        network.path = path;
+        network.security = properties.value("Type").toString();
+        network.signal = entry.signal / 100;
+        network.known = properties.contains("KnownNetwork");
+        networks.append(network);
+    }
+    emit scanFinished(networks);
+}
+
+void WifiControl::stationPropertiesChanged(const QDBusMessage &message)
+{
+    QList<QVariant> args = message.arguments();
+    if (args.count() < 3 || args.at(0).toString() != IWD_STATION)
+        return;
+    QVariantMap changed = qdbus_cast<QVariantMap>(args.at(1));
+    QStringList invalidated = args.at(2).toStringList();
+
+    if (changed.contains("ConnectedNetwork"))
+        m_connectedPath = changed.value("ConnectedNetwork").value<QDBusObjectPath>().path();
+    else if (invalidated.contains("ConnectedNetwork"))
+        m_connectedPath.clear();
+    if (changed.contains("State"))
+        setState(changed.value("State").toString());
+    if (changed.contains("Scanning")) {
+        m_scanning = changed.value("Scanning").toBool();
+        /* Networks come and go during a scan, refresh before listing */
+        if (!m_scanning && m_scanPending)
+            refresh();
+    }
+}
+
+/* iwd replies to Connect once associated, or with the failure */
+void WifiControl::connectNetwork(const QString &ssid, const QString &passphrase)
+{
+    QString path = findByName(m_networks, ssid);
+    if (path.isEmpty()) {
+        emit connectFailed(ssid, "Network not in range");
+        return;
+    }
+    m_agent->setPassphrase(path, passphrase);
+    QDBusPendingCallWatcher *watcher = call(path, IWD_NETWORK, "Connect");
+    watcher->setProperty("ssid", ssid);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(connectReplied(QDBusPendingCallWatcher*)));
+}
+
+void WifiControl::connectReplied(QDBusPendingCallWatcher *watcher)
+{
+    watcher->deleteLater();
+    m_agent->clear();
+    QString ssid = watcher->property("ssid").toString();
+    if (watcher->isError()) {
+        qDebug() << "Wi-Fi control: connect" << ssid << watcher->error().name();
+        emit connectFailed(ssid, watcher->error().message());
+        return;
+    }
+    emit connected(ssid);
+    /* Network is a known network now */
+    refresh();
+}
+
+void WifiControl::forgetNetwork(const QString &ssid)
+{
+    QString path = findByName(m_knownNetworks, ssid);
+    if (path.isEmpty()) {
+        qDebug() << "Wi-Fi control: not a known network:" << ssid;
+        return;
+    }
+    QDBusPendingCallWatcher *watcher = call(path, IWD_KNOWN_NETWORK, "Forget");
+    watcher->setProperty("ssid", ssid);
+    watcher->setProperty("path", path);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(forgetReplied(QDBusPendingCallWatcher*)));
+}
+
+void WifiControl::forgetReplied(QDBusPendingCallWatcher *watcher)
+{
+    watcher->deleteLater();
+    QString ssid = watcher->property("ssid").toString();
+    if (watcher->isError()) {
+        qDebug() << "Wi-Fi control: forget" << ssid << watcher->error().message();
+        return;
+    }
+    m_knownNetworks.remove(watcher->property("path").toString());
+    emit networkForgotten(ssid);
+    emit knownNetworksChanged();
+}
+
+/* WifiAgent */
+
+WifiAgent::WifiAgent(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void WifiAgent::setPassphrase(const QString &network, const QString &passphrase)
+{
+    m_network = network;
+    m_passphrase = passphrase;
+}
+
+void WifiAgent::clear()
+{
+    m_network.clear();
+    m_passphrase.clear();
+}
+
+QString WifiAgent::RequestPassphrase(const QDBusObjectPath &network)
+{
+    if (network.path() != m_network || m_passphrase.isEmpty()) {
+        sendErrorReply(IWD_AGENT_CANCELED, "No passphrase for this network");
+        return QString();
+    }
+    return m_passphrase;
+}
+
+void WifiAgent::Release()
+{
+    clear();
+}
+
+void WifiAgent::Cancel(const QString &reason)
+{
+    qDebug() << "Wi-Fi agent: request canceled:" << reason;
+}
+
+/* Mock iwd */
+
+MockIwd::MockIwd(QObject *parent)
+    : QDBusVirtualObject(parent)
+    , m_bus(QDBusConnection::connectToBus(QDBusConnection::SessionBus, IWD_MOCK_BUS))
+    , m_state("disconnected")
+    , m_connected(-1)
+    , m_scanning(false)
+    , m_passphrase(qEnvironmentVariable("SINM_IWD_MOCK_PASSPHRASE"))
+{
+    registerIwdTypes();
+    m_networks.append({ "sinm-lab", "psk", -4500, false });
+    m_networks.append({ "Guest", "open", -7000, false });
+    m_networks.append({ "Field-AP", "psk", -8000, true });
+}
+
+bool MockIwd::registerService()
+{
+    if (!m_bus.registerVirtualObject("/", this, QDBusConnection::SubPath)
+            || !m_bus.registerService(IWD_SERVICE)) {
+        qDebug() << "Mock iwd: can't register:" << m_bus.lastError().message();
+        return false;
+    }
+    return true;
+}
+
+QString MockIwd::introspect(const QString &path) const
+{
+    Q_UNUSED(path)
+    return QString();
+}
+
+/* iwd's object naming: hex encoded SSID and the security type */
+QString MockIwd::networkPath(int index) const
+{
+    const Network &network = m_networks.at(index);
+    return QString(IWD_MOCK_STATION_PATH) + "/" + network.name.toUtf8().toHex() + "_" + network.security;
+}
+
+QString MockIwd::knownNetworkPath(int index) const
+{
+    const Network &network = m_networks.at(index);
+    return QString(IWD_MANAGER_PATH) + "/" + network.name.toUtf8().toHex() + "_" + network.security;
+}
+
+bool MockIwd::handleMessage(const QDBusMessage &message, const QDBusConnection &connection)
+{
+    QString interface = message.interface();
+    QString member = message.member();
+    QString path = message.path();
+
+    if (interface == DBUS_OBJECT_MANAGER && member == "GetManagedObjects") {
+        connection.send(message.createReply(QVariant::fromValue(managedObjects())));
+        return true;
+    }
+    if (interface == IWD_AGENT_MANAGER && member == "RegisterAgent") {
+        m_agentService = message.service();
+        m_agentPath = message.arguments().value(0).value<QDBusObjectPath>().path();
+        connection.send(message.createReply());
+        return true;
+    }
+    if (interface == IWD_STATION && path == IWD_MOCK_STATION_PATH) {
+        if (member == "Scan") {
+            scan(message);
+            return true;
+        }
+        if (member == "GetOrderedNetworks") {
+            connection.send(message.createReply(QVariant::fromValue(orderedNetworks())));
+            return true;
+        }
+    }
+    for (int i = 0; i < m_networks.count(); i++) {
+        if (interface == IWD_NETWORK && member == "Connect" && path == networkPath(i)) {
+            connectNetwork(message, i);
+            return true;
+        }
+        if (interface == IWD_KNOWN_NETWORK && member == "Forget"
+                && path == knownNetworkPath(i) && m_networks.at(i).known) {
+            m_networks[i].known = false;
+            if (m_connected == i) {
+                m_connected = -1;
+                setStationState("disconnected");
+            }
+            connection.send(message.createReply());
+            return true;
+        }
+    }
+    connection.send(message.createErrorReply(QDBusError::UnknownMethod,
+                                             "Mock iwd: " + interface + "." + member + " on " + path));
+    return true;
+}
+
+IwdManagedObjects MockIwd::managedObjects() const
+{
+    IwdManagedObjects objects;
+    QVariantMap station = { { "State", m_state }, { "Scanning", m_scanning } };
+    if (m_connected >= 0)
+        station.insert("ConnectedNetwork", QVariant::fromValue(QDBusObjectPath(networkPath(m_connected))));
+    objects.insert(QDBusObjectPath(IWD_MOCK_STATION_PATH), {
+                       { IWD_DEVICE, { { "Name", WIFI_INTERFACE }, { "Mode", "station" }, { "Powered", true } } },
+                       { IWD_STATION, station } });
+    for (int i = 0; i < m_networks.count(); i++) {
+        const Network &network = m_networks.at(i);
+        QVariantMap properties = { { "Name", network.name },
+                                   { "Type", network.security },
+                                   { "Connected", i == m_connected },
+                                   { "Device", QVariant::fromValue(QDBusObjectPath(IWD_MOCK_STATION_PATH)) } };
+        if (network.known) {
+            properties.insert("KnownNetwork", QVariant::fromValue(QDBusObjectPath(knownNetworkPath(i))));
+            objects.insert(QDBusObjectPath(knownNetworkPath(i)), {
+                               { IWD_KNOWN_NETWORK, { { "Name", network.name }, { "Type", network.security } } } });
+        }
+        objects.insert(QDBusObjectPath(networkPath(i)), { { IWD_NETWORK, properties } });
+    }
+    return objects;
+}
+
+QList<IwdOrderedNetwork> MockIwd::orderedNetworks() const
+{
+    QList<IwdOrderedNetwork> ordered;
+    for (int i = 0; i < m_networks.count(); i++)
+        ordered.append({ QDBusObjectPath(networkPath(i)), m_networks.at(i).signal });
+    std::sort(ordered.begin(), ordered.end(), [](const IwdOrderedNetwork &a, const IwdOrderedNetwork &b) {
+        return a.signal > b.signal;
+    });
+    return ordered;
+}
+
+void MockIwd::scan(const QDBusMessage &message)
+{
+    if (m_scanning) {
+        m_bus.send(message.createErrorReply(IWD_ERROR_BUSY, "Operation already in progress"));
+        return;
+    }
+    m_scanning = true;
+    sendStationProperties({ { "Scanning", true } });
+    m_bus.send(message.createReply());
+    QTimer::singleShot(IWD_MOCK_SCAN_DELAY, this, [this]() {
+        m_scanning = false;
+        sendStationProperties({ { "Scanning", false } });
+    });
+}
+
+/* Unknown psk networks ask the registered agent for the passphrase */
+void MockIwd::connectNetwork(const QDBusMessage &message, int index)
+{
+    const Network &network = m_networks.at(index);
+    if (network.security != "psk" || network.known) {
+        finishConnect(message, index, true);
+        return;
+    }
+    if (m_agentPath.isEmpty()) {
+        m_bus.send(message.createErrorReply("net.connman.iwd.NoAgent", "No agent registered"));
+        return;
+    }
+    QDBusMessage request = QDBusMessage::createMethodCall(m_agentService, m_agentPath,
+                                                          IWD_AGENT, "RequestPassphrase");
+    request << QVariant::fromValue(QDBusObjectPath(networkPath(index)));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(m_bus.asyncCall(request), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this,
+            [this, message, index](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+        QDBusPendingReply<QString> reply = *watcher;
+        bool accepted = false;
+        if (!reply.isError())
+            accepted = m_passphrase.isEmpty() ? reply.value().length() >= 8
+                                              : reply.value() == m_passphrase;
+        finishConnect(message, index, accepted);
+    });
+}
+
+void MockIwd::finishConnect(const QDBusMessage &message, int index, bool accepted)
+{
+    m_connected = -1;
+    setStationState("connecting");
+    QTimer::singleShot(IWD_MOCK_CONNECT_DELAY, this, [this, message, index, accepted]() {
+        if (!accepted) {
+            setStationState("disconnected");
+            m_bus.send(message.createErrorReply(IWD_ERROR_FAILED, "Operation failed"));
+            return;
+        }
+        m_connected = index;
+        m_networks[index].known = true;
+        setStationState("connected");
+        m_bus.send(message.createReply());
+    });
+}
+
+void MockIwd::setStationState(const QString &state)
+{
+    m_state = state;
+    QVariantMap changed = { { "State", state } };
+    QStringList invalidated;
+    if (m_connected >= 0)
+        changed.insert("ConnectedNetwork", QVariant::fromValue(QDBusObjectPath(networkPath(m_connected))));
+    else
+        invalidated << "ConnectedNetwork";
+    sendStationProperties(changed, invalidated);
+}
+
+void MockIwd::sendStationProperties(const QVariantMap &changed, const QStringList &invalidated)
+{
+    QDBusMessage message = QDBusMessage::createSignal(IWD_MOCK_STATION_PATH, DBUS_PROPERTIES, "PropertiesChanged");
+    message << QString(IWD_STATION) << changed << invalidated;
+    m_bus.send(message);
+}
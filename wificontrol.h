@@ -0,0 +1,213 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef WIFICONTROL_H
+#define WIFICONTROL_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QStringList>
+#include <QVariantMap>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusContext>
+#include <QDBusObjectPath>
+#include <QDBusVirtualObject>
+
+class QDBusMessage;
+class QDBusPendingCallWatcher;
+class QDBusServiceWatcher;
+
+#define IWD_SERVICE             "net.connman.iwd"
+#define IWD_MANAGER_PATH        "/net/connman/iwd"
+#define WIFI_INTERFACE          "wlan0"
+
+/* Network seen in a scan */
+struct WifiNetwork
+{
+    QString ssid;
+    QString path;
+    /* iwd Network.Type: "open", "psk", "8021x" */
+    QString security;
+    /* dBm */
+    int signal;
+    bool known;
+};
+
+/* Station.GetOrderedNetworks() entry, signal in 100 * dBm */
+struct IwdOrderedNetwork
+{
+    QDBusObjectPath path;
+    qint16 signal;
+};
+Q_DECLARE_METATYPE(IwdOrderedNetwork)
+
+QDBusArgument &operator<<(QDBusArgument &argument, const IwdOrderedNetwork &network);
+const QDBusArgument &operator>>(const QDBusArgument &argument, IwdOrderedNetwork &network);
+
+/* ObjectManager.GetManagedObjects(): properties per interface per object */
+typedef QMap<QString, QVariantMap> IwdInterfaces;
+typedef QMap<QDBusObjectPath, IwdInterfaces> IwdManagedObjects;
+
+class WifiAgent;
+
+/*
+ * Wi-Fi station control through iwd's D-Bus API: scan, connect,
+ * known networks and forget, without iwctl. The station's State is
+ * followed through PropertiesChanged, so association success or
+ * failure is reported when iwd sees it. Passphrases are handed to iwd
+ * by a WifiAgent registered with iwd's AgentManager.
+ */
+class WifiControl : public QObject
+{
+    Q_OBJECT
+
+public:
+    WifiControl(const QDBusConnection &bus, const QString &interface, QObject *parent = nullptr);
+    /* System bus, or the mock on the session bus with SINM_IWD=mock */
+    static WifiControl *create(QObject *parent = nullptr);
+
+    QString state() const { return m_state; }
+    QString connectedNetwork() const;
+    QStringList knownNetworks() const;
+
+public slots:
+    void scan();
+    void connectNetwork(const QString &ssid, const QString &passphrase);
+    void forgetNetwork(const QString &ssid);
+
+signals:
+    /* Strongest first */
+    void scanFinished(const QList<WifiNetwork> &networks);
+    /* No result, the previous one still stands */
+    void scanFailed(const QString &error);
+    /* Station State: "connected", "disconnected", "connecting", ... */
+    void stateChanged(const QString &state, const QString &ssid);
+    void connected(const QString &ssid);
+    void connectFailed(const QString &ssid, const QString &error);
+    void networkForgotten(const QString &ssid);
+    void knownNetworksChanged();
+
+private slots:
+    void refresh();
+    void registerAgent();
+    void agentRegistered(QDBusPendingCallWatcher *watcher);
+    void objectsReceived(QDBusPendingCallWatcher *watcher);
+    void scanStarted(QDBusPendingCallWatcher *watcher);
+    void orderedNetworksReceived(QDBusPendingCallWatcher *watcher);
+    void connectReplied(QDBusPendingCallWatcher *watcher);
+    void forgetReplied(QDBusPendingCallWatcher *watcher);
+    void stationPropertiesChanged(const QDBusMessage &message);
+
+private:
+    QDBusPendingCallWatcher *call(const QString &path, const QString &interface,
+                                  const QString &method, const QVariantList &args = QVariantList());
+    void requestOrderedNetworks();
+    void setState(const QString &state);
+    static QString findByName(const QHash<QString, QVariantMap> &objects, const QString &name);
+
+    QDBusConnection m_bus;
+    QString m_interface;
+    WifiAgent *m_agent;
+    QDBusServiceWatcher *m_serviceWatcher;
+    QString m_stationPath;
+    /* Network and KnownNetwork properties by object path */
+    QHash<QString, QVariantMap> m_networks;
+    QHash<QString, QVariantMap> m_knownNetworks;
+    QString m_state;
+    QString m_connectedPath;
+    bool m_scanning;
+    bool m_scanPending;
+};
+
+/* Answers iwd's passphrase request for the connect in progress */
+class WifiAgent : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "net.connman.iwd.Agent")
+
+public:
+    explicit WifiAgent(QObject *parent = nullptr);
+    void setPassphrase(const QString &network, const QString &passphrase);
+    void clear();
+
+public slots:
+    QString RequestPassphrase(const QDBusObjectPath &network);
+    void Release();
+    void Cancel(const QString &reason);
+
+private:
+    QString m_network;
+    QString m_passphrase;
+};
+
+/*
+ * Minimal stand-in for iwd, for tests and for running the UI without
+ * Wi-Fi hardware (SINM_IWD=mock). Registers on the session bus under
+ * iwd's name with one station and a few networks. A psk passphrase is
+ * accepted if it equals SINM_IWD_MOCK_PASSPHRASE, or when that is
+ * unset, if it is at least 8 characters.
+ */
+class MockIwd : public QDBusVirtualObject
+{
+    Q_OBJECT
+
+public:
+    explicit MockIwd(QObject *parent = nullptr);
+    bool registerService();
+
+    QString introspect(const QString &path) const override;
+    bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override;
+
+private:
+    struct Network
+    {
+        QString name;
+        QString security;
+        qint16 signal;
+        bool known;
+    };
+
+    IwdManagedObjects managedObjects() const;
+    QList<IwdOrderedNetwork> orderedNetworks() const;
+    void scan(const QDBusMessage &message);
+    void connectNetwork(const QDBusMessage &message, int index);
+    void finishConnect(const QDBusMessage &message, int index, bool accepted);
+    void setStationState(const QString &state);
+    void sendStationProperties(const QVariantMap &changed, const QStringList &invalidated = QStringList());
+    QString networkPath(int index) const;
+    QString knownNetworkPath(int index) const;
+
+    QDBusConnection m_bus;
+    QList<Network> m_networks;
+    QString m_state;
+    int m_connected;
+    bool m_scanning;
+    QString m_agentService;
+    QString m_agentPath;
+    QString m_passphrase;
+};
+
+#endif // WIFICONTROL_H
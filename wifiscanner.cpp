@@ -0,0 +1,140 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#include "wifiscanner.h"
+
+WifiScanner::WifiScanner(WifiControl *control, QObject *parent)
+    : QObject(parent)
+    , m_control(control)
+    , m_interval(WIFI_SCAN_MIN_INTERVAL)
+    , m_started(false)
+    , m_active(false)
+    , m_paused(false)
+    , m_scanning(false)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(scanNow()));
+    connect(m_control, SIGNAL(scanFinished(QList<WifiNetwork>)),
+            this, SLOT(scanFinished(QList<WifiNetwork>)));
+    connect(m_control, SIGNAL(scanFailed(QString)), this, SLOT(scanFailed(QString)));
+    connect(m_control, SIGNAL(knownNetworksChanged()), this, SIGNAL(updated()));
+}
+
+QStringList WifiScanner::knownNetworks() const
+{
+    return m_control->knownNetworks();
+}
+
+qint64 WifiScanner::age() const
+{
+    return m_age.isValid() ? m_age.elapsed() : -1;
+}
+
+void WifiScanner::start()
+{
+    if (m_started)
+        return;
+    m_started = true;
+    m_timer.start(WIFI_SCAN_FIRST_DELAY);
+}
+
+void WifiScanner::scanNow()
+{
+    m_timer.stop();
+    if (m_scanning)
+        return;
+    m_scanning = true;
+    m_control->scan();
+}
+
+void WifiScanner::setActive(bool active)
+{
+    if (active == m_active)
+        return;
+    m_active = active;
+    if (!m_scanning)
+        schedule();
+}
+
+void WifiScanner::setPaused(bool paused)
+{
+    if (paused == m_paused)
+        return;
+    m_paused = paused;
+    if (m_paused)
+        m_timer.stop();
+    else if (!m_scanning)
+        schedule();
+}
+
+/* Also results of scans not started here, they are as fresh */
+void WifiScanner::scanFinished(const QList<WifiNetwork> &networks)
+{
+    m_scanning = false;
+    if (sameNetworks(networks, m_networks))
+        m_interval = qMin(m_interval * 2, WIFI_SCAN_MAX_INTERVAL);
+    else
+        m_interval = WIFI_SCAN_MIN_INTERVAL;
+    m_networks = networks;
+    m_age.start();
+    emit updated();
+    schedule();
+}
+
+/* Retried after an interval of its own, the cache's age is not reset */
+void WifiScanner::scanFailed(const QString &error)
+{
+    Q_UNUSED(error)
+    m_scanning = false;
+    if (!m_started || m_paused)
+        return;
+    m_timer.start(m_active ? WIFI_SCAN_ACTIVE_INTERVAL : WIFI_SCAN_MIN_INTERVAL);
+}
+
+/* Next scan counted from the last result, so a resume or a page
+   open after a long pause scans right away */
+void WifiScanner::schedule()
+{
+    if (!m_started || m_paused) {
+        m_timer.stop();
+        return;
+    }
+    qint64 interval = m_active ? WIFI_SCAN_ACTIVE_INTERVAL : m_interval;
+    qint64 due = m_age.isValid() ? qMax<qint64>(0, interval - m_age.elapsed()) : 0;
+    m_timer.start((int)due);
+}
+
+/* Same SSIDs and security, signal changes alone don't count */
+bool WifiScanner::sameNetworks(const QList<WifiNetwork> &a, const QList<WifiNetwork> &b)
+{
+    if (a.count() != b.count())
+        return false;
+    QStringList left, right;
+    for (const WifiNetwork &network : a)
+        left.append(network.ssid + "/" + network.security);
+    for (const WifiNetwork &network : b)
+        right.append(network.ssid + "/" + network.security);
+    left.sort();
+    right.sort();
+    return left == right;
+}
@@ -0,0 +1,88 @@
+/*
+ * Out Of Band (OOB-Comm) user interface for reTerminal
+ *
+ * (C) 2022 Resilience Theatre
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+
+#ifndef WIFISCANNER_H
+#define WIFISCANNER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QTimer>
+#include "wificontrol.h"
+
+/* Settings page open */
+#define WIFI_SCAN_ACTIVE_INTERVAL   10000
+/* Background, doubled while results stay the same */
+#define WIFI_SCAN_MIN_INTERVAL      30000
+#define WIFI_SCAN_MAX_INTERVAL      300000
+#define WIFI_SCAN_FIRST_DELAY       5000
+
+/*
+ * Keeps the last scan result so the settings page can be drawn
+ * without waiting for a scan. Scans run in the background through
+ * WifiControl: every WIFI_SCAN_ACTIVE_INTERVAL while the page is open,
+ * otherwise from WIFI_SCAN_MIN_INTERVAL up to WIFI_SCAN_MAX_INTERVAL as
+ * the visible networks stay unchanged. A failed scan keeps the cached
+ * list and its age. Nothing is scheduled while paused (screen blanked).
+ */
+class WifiScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit WifiScanner(WifiControl *control, QObject *parent = nullptr);
+
+    QList<WifiNetwork> networks() const { return m_networks; }
+    QStringList knownNetworks() const;
+    /* Milliseconds since the last result, -1 before the first one */
+    qint64 age() const;
+    bool isScanning() const { return m_scanning; }
+
+public slots:
+    void start();
+    void scanNow();
+    void setActive(bool active);
+    void setPaused(bool paused);
+
+signals:
+    void updated();
+
+private slots:
+    void scanFinished(const QList<WifiNetwork> &networks);
+    void scanFailed(const QString &error);
+
+private:
+    void schedule();
+    static bool sameNetworks(const QList<WifiNetwork> &a, const QList<WifiNetwork> &b);
+
+    WifiControl *m_control;
+    QList<WifiNetwork> m_networks;
+    QElapsedTimer m_age;
+    QTimer m_timer;
+    int m_interval;
+    bool m_started;
+    bool m_active;
+    bool m_paused;
+    bool m_scanning;
+};
+
+#endif // WIFISCANNER_H